@@ -1,4 +1,12 @@
 #include "BokehDemo.h"
+#include "aperture.h"
+#include "blurFormat.h"
+#include "blurKernel.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 
 using namespace mini;
 using namespace gk2;
@@ -7,13 +15,50 @@ using namespace std;
 using namespace directx;
 using namespace utils;
 
+// Format of the blurTexture<k> targets between the blur passes, see blurFormat.hlsli. bokeh::BokehEngine::MeasureFormat
+// reports the bytes per pixel and the error of each.
+constexpr auto BLUR_FORMAT = bokeh::BlurFormat::R11G11B10F;
+
+// Edge of the square pixel tiles the CoC is classified in. Must match TILE_SIZE in the cocTiles and bokeh shaders.
+constexpr LONG COC_TILE_SIZE = 16;
+
+// The autofocus region is a square this many times shorter than the window is high. bokehCli --bench times the
+// histogram of its 135 x 135 depths at 1080p, 0.07 to 0.09 ms on one core of the test machine, and of the whole
+// 1080p frame, 8 to 10 ms there: only the region fits the 0.1 ms a frame can spare.
+constexpr LONG FOCUS_REGION_DIVISOR = 8;
+
+// Scene colour. The CoC is written by its own pass into cocTexture, so the scene needs no alpha channel.
+constexpr DXGI_FORMAT SCENE_FORMAT = DXGI_FORMAT_R11G11B10_FLOAT;
+
+DXGI_FORMAT blurTextureFormat(const bokeh::BlurFormat format) {
+    switch (format) {
+        case bokeh::BlurFormat::Float32:
+            return DXGI_FORMAT_R32G32B32A32_FLOAT;
+        case bokeh::BlurFormat::Rgba8:
+            return DXGI_FORMAT_R8G8B8A8_UNORM;
+        case bokeh::BlurFormat::Rgba16F:
+            return DXGI_FORMAT_R16G16B16A16_FLOAT;
+        case bokeh::BlurFormat::R11G11B10F:
+            return DXGI_FORMAT_R11G11B10_FLOAT;
+        case bokeh::BlurFormat::B5G6R5:
+            return DXGI_FORMAT_B5G6R5_UNORM;
+    }
+    return DXGI_FORMAT_R8G8B8A8_UNORM;
+}
+
+// Size of the targets of a bokeh_downscale level, rounded up so the reduced targets cover the window.
+SIZE levelSize(const SIZE& screenSize, const int level) {
+    const LONG scale = 1 << level;
+    return {(screenSize.cx + scale - 1) / scale, (screenSize.cy + scale - 1) / scale};
+}
+
 auto operator/(const SIZE& s, const float f) -> SIZE {
     const auto x = static_cast<float>(s.cx);
     const auto y = static_cast<float>(s.cy);
     return {static_cast<LONG>(x / f), static_cast<LONG>(y / f)};
 }
 
-BokehDemo::BokehDemo(HINSTANCE hInst): BokehDemoBase(hInst) {
+BokehDemo::BokehDemo(HINSTANCE hInst): BokehDemoBase(hInst), m_dofTimer(m_device) {
     // Shader Variables
     m_variables.AddSemanticVariable("modelMtx", VariableSemantic::MatM);
     m_variables.AddSemanticVariable("modelInvTMtx", VariableSemantic::MatMInvT);
@@ -69,12 +114,75 @@ BokehDemo::BokehDemo(HINSTANCE hInst): BokehDemoBase(hInst) {
     constexpr auto angle = 0.0F;
     constexpr auto coc_factor = 1.0F;
     constexpr auto NUM_SAMPLES = 16.0F;
-    m_variables.AddGuiVariable("NUM_SAMPLES", NUM_SAMPLES, 1, 32, 1);
+    m_numSamples = m_variables.AddGuiVariable("NUM_SAMPLES", NUM_SAMPLES, 1, 32, 1);
+    // taps per pixel of blur length, so small CoCs take fewer; 0 - NUM_SAMPLES taps for every CoC
+    constexpr auto sample_density = 0.0F;
+    constexpr auto max_samples = 32.0F;
+    m_sampleDensity = m_variables.AddGuiVariable("sample_density", sample_density, 0, 2, 0.05f);
+    m_maxSamples = m_variables.AddGuiVariable("max_samples", max_samples, 1, 64, 1);
     m_variables.AddGuiVariable("coc_factor", coc_factor, 0.8f, 1.2f);
-    m_variables.AddGuiVariable("angle", angle, -XM_PI, XM_PI, 0.1f);
+    m_angle = m_variables.AddGuiVariable("angle", angle, -XM_PI, XM_PI, 0.1f);
+    // 6 - hexagon, 10 is close to a circle; the rhombi only approximate an odd number of sides
+    m_apertureSides = m_variables.AddGuiVariable("aperture_sides", 6.0f, bokeh::Aperture::MinSides,
+                                                 bokeh::Aperture::MaxSides, 1);
+    // tables of aperture.hlsli, filled by _updateApertureTable
+    constexpr XMFLOAT4 apertureEdges[bokeh::ApertureTable::MaxEdges]{};
+    constexpr XMFLOAT4 apertureRhombi[bokeh::ApertureTable::MaxEdges * bokeh::ApertureTable::MaxEdges]{};
+    constexpr XMFLOAT4 apertureNormals[bokeh::Aperture::MaxSides]{};
+    constexpr XMFLOAT4 apertureSteps[(BOKEH_MAX_DOWNSCALE + 1) * bokeh::ApertureTable::MaxEdges]{};
+    m_apertureEdges = m_variables.AddNamedVariable("aperture_edges", apertureEdges);
+    m_apertureRhombi = m_variables.AddNamedVariable("aperture_rhombi", apertureRhombi);
+    m_apertureNormals = m_variables.AddNamedVariable("aperture_normals", apertureNormals);
+    m_apertureSteps = m_variables.AddNamedVariable("aperture_steps", apertureSteps);
+    m_variables.AddNamedVariable("blur_format", static_cast<float>(BLUR_FORMAT));
+    // 1 - cheap fallback sampling a mip chain of the scene instead of the two blur passes, see bokehMipPS.hlsl
+    m_mipBlur = m_variables.AddGuiVariable("mip_blur", 0.0f, 0, 1, 1);
+    // 0 - full, 1 - half, 2 - quarter resolution blur
+    constexpr auto bokeh_downscale = 0.0F;
+    m_downscale = m_variables.AddGuiVariable("bokeh_downscale", bokeh_downscale, 0, BOKEH_MAX_DOWNSCALE, 1);
+    // GPU milliseconds for the passes from the CoC to tonemapping; above 0 bokeh_downscale and max_samples follow it
+    m_dofBudget = m_variables.AddGuiVariable("dof_budget", 0.0f, 0, 8, 0.25f);
+    // thin lens: focal length and sensor width in mm, focus distance in scene units (m)
+    constexpr bokeh::ThinLens lens;
+    m_focalLength = m_variables.AddGuiVariable("focal_length", lens.focalLength, 10, 300, 1);
+    m_fStop = m_variables.AddGuiVariable("f_stop", lens.fStop, 1, 22, 0.1f);
+    m_focusDistance = m_variables.AddGuiVariable("focus_distance", lens.focusDistance, 0.6f, 50, 0.05f);
+    // 0 - focus_distance as set, 1 - focus on the centre of the window, 2 - on the last point clicked with the middle
+    // button; autofocus moves focus_distance
+    m_autofocus = m_variables.AddGuiVariable("autofocus", 0.0f, 0, 2, 1);
+    m_sensorWidth = m_variables.AddGuiVariable("sensor_width", lens.sensorWidth, 5, 70, 0.1f);
+    // 1 - blurred foreground spreads over what lies behind it
+    m_variables.AddGuiVariable("near_field", 0.0f, 0, 1, 1);
+    // 1 - out-of-focus pixels brighter than highlight_threshold are drawn as aperture sprites instead of being
+    // gathered, if their blur reaches highlight_min_radius pixels
+    m_highlightScatter = m_variables.AddGuiVariable("highlight_scatter", 0.0f, 0, 1, 1);
+    // luminance of the linear scene
+    m_variables.AddGuiVariable("highlight_threshold", 4.0f, 0, 16, 0.1f);
+    m_variables.AddGuiVariable("highlight_min_radius", 4.0f, 0, 32, 1);
+    // every frame takes one of temporal_frames interleaved subsets of the taps and blends the result into the
+    // reprojected history with weight temporal_blend; 1 - all taps every frame, no history
+    m_temporalFrames = m_variables.AddGuiVariable("temporal_frames", 1.0f, 1, 8, 1);
+    m_variables.AddGuiVariable("temporal_blend", 0.1f, 0.02f, 1, 0.01f);
+    m_temporalFrame = m_variables.AddNamedVariable("temporal_frame", 0.0f);
+    // preview quality: every blur takes stochastic_taps jittered taps instead of up to max_samples and an edge-aware
+    // denoise follows, see temporal.hlsli and bokehDenoisePS.hlsl; 0 - every tap
+    m_stochasticTaps = m_variables.AddGuiVariable("stochastic_taps", 0.0f, 0, 16, 1);
+    m_stochasticFrame = m_variables.AddNamedVariable("stochastic_frame", 0.0f);
+    m_variables.AddSemanticVariable("viewProjInvMtx", VariableSemantic::MatVPInv);
+    m_prevViewProj = m_variables.AddNamedVariable("prevViewProjMtx", m_viewProj);
 
     auto screenSize = get_window().client_size();
-    m_variables.AddRenderableTexture(m_device, "sceneTexture", screenSize);
+    directx::tex2d_info sceneDesc(screenSize.cx, screenSize.cy, SCENE_FORMAT, 1);
+    sceneDesc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+    m_variables.AddRenderableTexture(m_device, "sceneTexture", sceneDesc);
+    auto cocDesc = sceneDesc;
+    // CoC and the CoC of the near field, see cocPS.hlsl
+    cocDesc.Format = DXGI_FORMAT_R16G16_UNORM;
+    m_variables.AddRenderableTexture(m_device, "cocTexture", cocDesc);
+    // the finished frame in linear HDR, tonemapped into the window by the last pass
+    auto hdrDesc = sceneDesc;
+    hdrDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    m_variables.AddRenderableTexture(m_device, "hdrTexture", hdrDesc);
 
     // Samplers // BOKEH
     sampler_info sDesc;
@@ -85,12 +193,30 @@ BokehDemo::BokehDemo(HINSTANCE hInst): BokehDemoBase(hInst) {
     m_variables.AddSampler(m_device, "blurSampler", sDesc);
 
     m_variables.AddSemanticVariable("nearZ", VariableSemantic::FloatNearPlane);
+    m_variables.AddSemanticVariable("farZ", VariableSemantic::FloatFarPlane);
+
+    // CoC over linear depth for the CoC pass, see cocLut.hlsli
+    m_cocLutTexture = m_device.CreateTexture(tex2d_info(static_cast<UINT>(bokeh::CocLut::DefaultSize), 1,
+                                                        DXGI_FORMAT_R32_FLOAT, 1));
+    m_variables.AddTexture(m_device, "cocLutTexture", m_cocLutTexture);
+    m_variables.AddSampler(m_device, "cocLutSampler", sDesc);
+
     m_variables.AddTexture(m_device, "screenColor",
                            tex2d_info(screenSize.cx, screenSize.cy,
                                       DXGI_FORMAT_R8G8B8A8_UNORM, 1));
     m_variables.AddTexture(m_device, "screenDepth",
         tex2d_info(screenSize.cx, screenSize.cy,
             DXGI_FORMAT_R24_UNORM_X8_TYPELESS, 1));
+    ID3D11Resource* screenDepth = nullptr;
+    m_variables.GetTexture("screenDepth")->GetResource(&screenDepth);
+    m_screenDepth.reset(screenDepth);
+    const auto focusSide = static_cast<UINT>(max(1L, screenSize.cy / FOCUS_REGION_DIVISOR));
+    tex2d_info readbackDesc(focusSide, focusSide, DXGI_FORMAT_R24_UNORM_X8_TYPELESS, 1);
+    readbackDesc.Usage = D3D11_USAGE_STAGING;
+    readbackDesc.BindFlags = 0;
+    readbackDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    for (auto& readback : m_focusReadback)
+        readback = m_device.CreateTexture(readbackDesc);
 
     // Models
     const auto teapot = addModelFromFile("models/Teapot.3ds");
@@ -167,24 +293,394 @@ BokehDemo::BokehDemo(HINSTANCE hInst): BokehDemoBase(hInst) {
     const auto passEnv = addPass(L"envVS.cso", L"envPS.cso", "sceneTexture");
     addModelToPass(passEnv, envModel);
     addRasterizerState(passEnv, rasterizer_info(true));
+    // depth of everything but the environment, which lies at the far plane anyway
+    copyDepthBuffer(passEnv, "screenDepth");
+
+    // CoC BOKEH
+    // from the depth buffer in one full screen pass, so materials do not have to know about the lens
+    const auto passCoc = addPass(L"fullScreenQuadVS.cso", L"cocPS.cso", "cocTexture");
+    addModelToPass(passCoc, quad);
+    pass(passCoc).AddEffect(m_dofTimer.StartEffect());
+
+    // CoC tile classification BOKEH
+    // per-tile CoC range first, then the range over the neighbourhood the blurs of a tile can reach
+    const SIZE tileCount{
+        (screenSize.cx + COC_TILE_SIZE - 1) / COC_TILE_SIZE,
+        (screenSize.cy + COC_TILE_SIZE - 1) / COC_TILE_SIZE
+    };
+    directx::tex2d_info tileDesc(tileCount.cx, tileCount.cy, DXGI_FORMAT_R32G32B32A32_FLOAT, 1);
+    tileDesc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+    m_variables.AddRenderableTexture(m_device, "cocRangeTexture", tileDesc);
+    m_variables.AddRenderableTexture(m_device, "cocTileTexture", tileDesc);
+
+    const auto passCocTiles = addPass(L"fullScreenQuadVS.cso", L"cocTilesPS.cso", "cocRangeTexture");
+    addModelToPass(passCocTiles, quad);
+    const auto passCocTilesDilate = addPass(L"fullScreenQuadVS.cso", L"cocTilesDilatePS.cso", "cocTileTexture");
+    addModelToPass(passCocTilesDilate, quad);
 
 
     // blur filtering BOKEH
-    // add textures as double render target
-    directx::tex2d_info desc(screenSize.cx, screenSize.cy);
+    for (auto level = 0; level <= BOKEH_MAX_DOWNSCALE; ++level)
+        _addBokehPasses(quad, level, m_downscale);
+
+    // tonemapping and gamma, once per pixel of the window
+    const auto passTonemap = addPass(L"fullScreenQuadVS.cso", L"tonemapPS.cso", window_target());
+    addModelToPass(passTonemap, quad);
+    pass(passTonemap).AddEffect(m_dofTimer.StopEffect());
+}
+
+void BokehDemo::update(utils::clock const& clock) {
+    BokehDemoBase::update(clock);
+    _updateAutofocus(clock.frame_time());
+    _updateApertureTable();
+    _updateCocLut();
+    _updateTemporal();
+    _updateBudget();
+    _updateBlurVariants();
+}
+
+void BokehDemo::_updateBlurVariants() {
+    // the permutations take every tap of a blur length of n in every frame
+    const auto fixedTaps = m_sampleDensity->value <= 0.0f && lround(m_temporalFrames->value) <= 1 &&
+                           m_stochasticTaps->value < 0.5f;
+    const auto& counts = bokeh::FixedSampleCounts;
+    for (auto level = 0; level <= BOKEH_MAX_DOWNSCALE; ++level) {
+        const auto taps = static_cast<int>(ceil(m_numSamples->value / static_cast<float>(1 << level)));
+        const auto fixed = fixedTaps && find(counts.begin(), counts.end(), taps) != counts.end();
+        m_blurVariants[level] = fixed ? taps : 0;
+    }
+}
+
+void BokehDemo::_updateApertureTable() {
+    // rounding keeps a dragged value on a whole count
+    const auto sides = static_cast<int>(lround(m_apertureSides->value));
+    if (m_angle->value == m_tableAngle && sides == m_tableSides)
+        return;
+    m_tableAngle = m_angle->value;
+    m_tableSides = sides;
+    m_aperture.Build(sides, m_tableAngle);
+    m_apertureTable.Build(m_aperture);
+    static_assert(sizeof(m_apertureEdges->value) == sizeof(m_apertureTable.edges));
+    static_assert(sizeof(m_apertureRhombi->value) == sizeof(m_apertureTable.rhombi));
+    static_assert(sizeof(m_apertureNormals->value) == sizeof(m_apertureTable.normals));
+    memcpy(m_apertureEdges->value, m_apertureTable.edges, sizeof(m_apertureTable.edges));
+    memcpy(m_apertureRhombi->value, m_apertureTable.rhombi, sizeof(m_apertureTable.rhombi));
+    memcpy(m_apertureNormals->value, m_apertureTable.normals, sizeof(m_apertureTable.normals));
+    // the window keeps its size, so only the angle moves the steps
+    const auto screenSize = get_window().client_size();
+    for (auto level = 0; level <= BOKEH_MAX_DOWNSCALE; ++level) {
+        const auto size = levelSize(screenSize, level);
+        float steps[bokeh::ApertureTable::MaxEdges][4];
+        m_apertureTable.BuildSteps(static_cast<size_t>(size.cx), static_cast<size_t>(size.cy), steps);
+        memcpy(m_apertureSteps->value + level * bokeh::ApertureTable::MaxEdges, steps, sizeof(steps));
+    }
+}
+
+void BokehDemo::_updateBudget() {
+    const auto measured = m_dofTimer.NextFrame(m_device.context());
+    const auto slot = m_dofTimer.slot();
+    if (m_dofBudget->value <= 0.0f) {
+        m_budget.Reset();
+        m_budgetQualities[slot] = {static_cast<int>(lround(m_downscale->value)),
+                                   static_cast<int>(lround(m_maxSamples->value))};
+        return;
+    }
+    auto settings = m_budget.settings();
+    settings.budgetMilliseconds = m_dofBudget->value;
+    settings.maxDownscale = BOKEH_MAX_DOWNSCALE;
+    // the taps of the longest blur at full resolution; without a sample density every blur takes NUM_SAMPLES
+    settings.sampleSteps = m_sampleDensity->value > 0.0f;
+    settings.maxSamples = static_cast<int>(ceil(m_numSamples->value * max(m_sampleDensity->value, 1.0f)));
+    if (settings.budgetMilliseconds != m_budget.settings().budgetMilliseconds ||
+        settings.sampleSteps != m_budget.settings().sampleSteps ||
+        settings.maxSamples != m_budget.settings().maxSamples)
+        m_budget.SetSettings(settings);
+
+    // the measurement belongs to the frame that issued these queries, the quality it ran at was stored with it
+    const auto quality = measured ? m_budget.Update(*measured, m_budgetQualities[slot])
+                                  : m_budgetQualities[(slot + GpuTimer::Latency - 1) % GpuTimer::Latency];
+    *m_downscale = static_cast<float>(quality.downscale);
+    *m_maxSamples = static_cast<float>(quality.maxSamples);
+    m_budgetQualities[slot] = quality;
+}
+
+void BokehDemo::_updateAutofocus(const float seconds) {
+    const auto mode = lround(m_autofocus->value);
+    if (mode == 0) {
+        m_focusTracker.Reset();
+        m_focusRegions.fill({});
+        return;
+    }
+    const auto& context = m_device.context();
+    const auto slot = m_frame % FOCUS_READBACK_FRAMES;
+    auto& region = m_focusRegions[slot];
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (region.width > 0 && SUCCEEDED(context->Map(m_focusReadback[slot].get(), 0, D3D11_MAP_READ,
+                                                   D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped))) {
+        // 24-bit depth in the low bits, linearized as LinearDepth in cocLut.hlsli
+        const auto nearZ = frustrum().nearPlane();
+        const auto farZ = frustrum().farPlane();
+        m_focusDepth.resize(region.width * region.height);
+        for (size_t y = 0; y < region.height; ++y) {
+            const auto* row = reinterpret_cast<const uint32_t*>(static_cast<const char*>(mapped.pData) +
+                                                                y * mapped.RowPitch);
+            for (size_t x = 0; x < region.width; ++x) {
+                const auto z = static_cast<float>(row[x] & 0xFFFFFFu) / 16777215.0f;
+                m_focusDepth[y * region.width + x] = nearZ * farZ / (farZ - z * (farZ - nearZ));
+            }
+        }
+        context->Unmap(m_focusReadback[slot].get(), 0);
+        const bokeh::FocusRegion all{0, 0, region.width, region.height};
+        *m_focusDistance = m_focusTracker.Update(m_focusDepth.data(), region.width, all, nearZ, farZ, seconds,
+                                                 m_focusPool);
+    }
+
+    // screenDepth still holds the last frame
+    const auto screenSize = get_window().client_size();
+    const auto point = mode == 1 ? POINT{screenSize.cx / 2, screenSize.cy / 2} : focusPoint();
+    const auto side = static_cast<size_t>(max(1L, screenSize.cy / FOCUS_REGION_DIVISOR));
+    region = bokeh::FocusRegion::Around(static_cast<float>(point.x), static_cast<float>(point.y), side,
+                                        static_cast<size_t>(screenSize.cx), static_cast<size_t>(screenSize.cy));
+    const D3D11_BOX box{static_cast<UINT>(region.left), static_cast<UINT>(region.top), 0,
+                        static_cast<UINT>(region.left + region.width), static_cast<UINT>(region.top + region.height),
+                        1};
+    context->CopySubresourceRegion(m_focusReadback[slot].get(), 0, 0, 0, 0, m_screenDepth.get(), 0, &box);
+}
+
+void BokehDemo::_updateTemporal() {
+    *m_prevViewProj = m_viewProj;
+    m_variables.GetVariable("viewProjMtx")->copyTo(&m_viewProj, sizeof(m_viewProj));
+    ++m_frame;
+    // the second blur pass walks through the phase pairs over temporal_frames squared frames, see temporal.hlsli
+    const auto frames = static_cast<size_t>(max(1L, lround(m_temporalFrames->value)));
+    *m_temporalFrame = static_cast<float>(m_frame % (frames * frames));
+    // moves the jitter of the stochastic taps on every frame; wrapped so the golden ratio steps keep their precision
+    *m_stochasticFrame = static_cast<float>(m_frame % 1024);
+}
+
+void BokehDemo::_updateCocLut() {
+    const bokeh::ThinLens lens{m_focalLength->value, m_fStop->value, m_focusDistance->value, m_sensorWidth->value};
+    const auto width = static_cast<float>(get_window().client_size().cx);
+    // a CoC of 1 blurs NUM_SAMPLES pixels to each side, so the hexagon is twice that across
+    if (!m_cocLut.Build(lens, frustrum().nearPlane(), frustrum().farPlane(), width, 2 * m_numSamples->value))
+        return;
+    const auto& values = m_cocLut.values();
+    m_device.context()->UpdateSubresource(m_cocLutTexture.get(), 0, nullptr, values.data(),
+                                          static_cast<UINT>(values.size() * sizeof(float)), 0);
+}
+
+void BokehDemo::_addBokehPasses(const size_t quad, const int level, const GUIVariable<float>* downscale) {
+    const auto size = levelSize(get_window().client_size(), level);
+    const auto name = [level](const string& texture) {
+        return level == 0 ? texture : texture + (level == 1 ? "Half" : "Quarter");
+    };
+    vector<size_t> passes;
+
+    // the blurs hold linear HDR colour
+    directx::tex2d_info desc(size.cx, size.cy, DXGI_FORMAT_R16G16B16A16_FLOAT);
     desc.BindFlags |= D3D11_BIND_RENDER_TARGET;
     desc.MipLevels = 1;
-    auto verticalBlurTexture = m_device.CreateTexture(desc);
-    m_variables.AddTexture(m_device, "verticalBlurTexture", verticalBlurTexture);
-    auto diagonalBlurTexture = m_device.CreateTexture(desc);
-    m_variables.AddTexture(m_device, "diagonalBlurTexture", diagonalBlurTexture);
-
-    SIZE s{ static_cast<LONG>(desc.Width), static_cast<LONG>(desc.Height) };
-    auto doubleTextureTarget = RenderTargetsEffect(directx::viewport{ s }, m_device.CreateDepthStencilView(s.cx, s.cy));
-    doubleTextureTarget.SetRenderTargets({ m_device.CreateRenderTargetView(verticalBlurTexture).get(), m_device.CreateRenderTargetView(diagonalBlurTexture).get() });
-
-    auto passBlurBokeh1 = addPass(L"fullScreenQuadVS.cso", L"bokeh1PS.cso", doubleTextureTarget, true);
-    addModelToPass(passBlurBokeh1, quad);
-    auto passBlurBokeh2 = addPass(L"fullScreenQuadVS.cso", L"bokeh2PS.cso", window_target());
-    addModelToPass(passBlurBokeh2, quad);
+    const auto& hdrTarget = m_variables.GetRenderTarget("hdrTexture");
+
+    // reduced scene and the CoC and depth guiding the upsample
+    dx_ptr<ID3D11Texture2D> guideTexture;
+    if (level > 0) {
+        auto sceneDesc = desc;
+        sceneDesc.Format = SCENE_FORMAT;
+        auto sceneTexture = m_device.CreateTexture(sceneDesc);
+        m_variables.AddTexture(m_device, name("sceneTexture"), sceneTexture);
+        auto guideDesc = desc;
+        guideDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+        guideTexture = m_device.CreateTexture(guideDesc);
+        m_variables.AddTexture(m_device, name("lowResGuideTexture"), guideTexture);
+
+        auto downsampleTarget = RenderTargetsEffect(directx::viewport{ size }, m_device.CreateDepthStencilView(size.cx, size.cy));
+        downsampleTarget.SetRenderTargets({ m_device.CreateRenderTargetView(sceneTexture).get(), m_device.CreateRenderTargetView(guideTexture).get() });
+        passes.push_back(addPass(L"fullScreenQuadVS.cso", L"bokehDownsamplePS.cso", downsampleTarget, true));
+    }
+
+    // the scene for the gather with the highlights clamped, and what they lose for the sprites; the gather scene has
+    // a full mip chain for mip_blur
+    auto gatherDesc = desc;
+    gatherDesc.Format = SCENE_FORMAT;
+    gatherDesc.MipLevels = 0;
+    gatherDesc.MiscFlags |= D3D11_RESOURCE_MISC_GENERATE_MIPS;
+    auto gatherTexture = m_device.CreateTexture(gatherDesc);
+    m_variables.AddTexture(m_device, name("gatherTexture"), gatherTexture);
+    auto highlightDesc = desc;
+    highlightDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    auto highlightTexture = m_device.CreateTexture(highlightDesc);
+    m_variables.AddTexture(m_device, name("highlightTexture"), highlightTexture);
+    auto highlightTarget = RenderTargetsEffect(directx::viewport{ size }, m_device.CreateDepthStencilView(size.cx, size.cy));
+    highlightTarget.SetRenderTargets({ m_device.CreateRenderTargetView(gatherTexture).get(), m_device.CreateRenderTargetView(highlightTexture).get() });
+    const auto passHighlights = addPass(L"fullScreenQuadVS.cso", L"bokehHighlightsPS.cso", highlightTarget, true);
+    passes.push_back(passHighlights);
+
+    // add textures as multiple render targets: blurs of the scene and of the premultiplied near field along each
+    // aperture edge but the last, in the order of the bokeh1PS outputs
+    const array<string, 2 * bokeh::Aperture::MaxFirstPassEdges> blurTextureNames = {
+        "blurTexture0", "blurTexture1", "blurTexture2", "blurTexture3",
+        "nearBlurTexture0", "nearBlurTexture1", "nearBlurTexture2", "nearBlurTexture3" };
+    auto blurDesc = desc;
+    blurDesc.Format = blurTextureFormat(BLUR_FORMAT);
+    // the near field needs its coverage in alpha
+    auto nearBlurDesc = bokeh::HasCocPlane(BLUR_FORMAT) ? desc : blurDesc;
+    auto doubleTextureTarget = RenderTargetsEffect(directx::viewport{ size }, m_device.CreateDepthStencilView(size.cx, size.cy));
+    for (unsigned slot = 0; slot < blurTextureNames.size(); ++slot) {
+        auto texture = m_device.CreateTexture(slot < bokeh::Aperture::MaxFirstPassEdges ? blurDesc : nearBlurDesc);
+        m_variables.AddTexture(m_device, name(blurTextureNames[slot]), texture);
+        doubleTextureTarget.SetRenderTarget(slot, m_device.CreateRenderTargetView(texture));
+    }
+
+    // the generic blur shaders, then their permutations with a fixed number of taps, see _updateBlurVariants
+    vector<int> variants{0};
+    variants.insert(variants.end(), bokeh::FixedSampleCounts.begin(), bokeh::FixedSampleCounts.end());
+    const auto variantShader = [](const wstring& shader, const int taps) {
+        return shader + (taps == 0 ? L"" : L"_" + to_wstring(taps)) + L".cso";
+    };
+    vector<size_t> passesBlurBokeh1, passesBlurBokeh2;
+    for (const auto taps : variants) {
+        const auto passBlurBokeh1 = addPass(L"fullScreenQuadVS.cso", variantShader(L"bokeh1PS", taps),
+                                            doubleTextureTarget, true);
+        passesBlurBokeh1.push_back(passBlurBokeh1);
+        bindTexture(passBlurBokeh1, "sceneTexture", name("gatherTexture"));
+    }
+    passes.insert(passes.end(), passesBlurBokeh1.begin(), passesBlurBokeh1.end());
+
+    // this frame's subsets of the taps, accumulated over frames by the temporal pass
+    auto currentTexture = m_device.CreateTexture(desc);
+    m_variables.AddTexture(m_device, name("currentBokehTexture"), currentTexture);
+    auto currentTarget = RenderTargetsEffect(directx::viewport{ size }, m_device.CreateDepthStencilView(size.cx, size.cy), m_device.CreateRenderTargetView(currentTexture));
+    for (const auto taps : variants)
+        passesBlurBokeh2.push_back(addPass(L"fullScreenQuadVS.cso", variantShader(L"bokeh2PS", taps), currentTarget,
+                                           true));
+    // stochastic_taps: the generic second pass into a noisy target, denoised along rows and then columns into the
+    // target of the blurs
+    auto noisyTexture = m_device.CreateTexture(desc);
+    auto denoiseRowsTexture = m_device.CreateTexture(desc);
+    m_variables.AddTexture(m_device, name("noisyBokehTexture"), noisyTexture);
+    m_variables.AddTexture(m_device, name("denoiseRowsTexture"), denoiseRowsTexture);
+    // names the denoise shader declares have to exist when its passes are created
+    if (level == 0)
+        m_variables.AddTexture(m_device, "denoiseTexture", noisyTexture);
+    auto noisyTarget = RenderTargetsEffect(directx::viewport{ size }, m_device.CreateDepthStencilView(size.cx, size.cy), m_device.CreateRenderTargetView(noisyTexture));
+    auto denoiseRowsTarget = RenderTargetsEffect(directx::viewport{ size }, m_device.CreateDepthStencilView(size.cx, size.cy), m_device.CreateRenderTargetView(denoiseRowsTexture));
+    const auto passStochastic = addPass(L"fullScreenQuadVS.cso", L"bokeh2PS.cso", noisyTarget, true);
+    passesBlurBokeh2.push_back(passStochastic);
+    passes.insert(passes.end(), passesBlurBokeh2.begin(), passesBlurBokeh2.end());
+    const auto passDenoiseRows = addPass(L"fullScreenQuadVS.cso", L"bokehDenoisePS.cso", denoiseRowsTarget);
+    const auto passDenoise = addPass(L"fullScreenQuadVS.cso", L"bokehDenoiseVerticalPS.cso", currentTarget);
+    passes.push_back(passDenoiseRows);
+    passes.push_back(passDenoise);
+    bindTexture(passDenoiseRows, "denoiseTexture", name("noisyBokehTexture"));
+    bindTexture(passDenoise, "denoiseTexture", name("denoiseRowsTexture"));
+    // fills the same target as the two blur passes when mip_blur replaces them
+    const auto passMipBlur = addPass(L"fullScreenQuadVS.cso", L"bokehMipPS.cso", currentTarget, true);
+    passes.push_back(passMipBlur);
+    bindTexture(passMipBlur, "sceneTexture", name("gatherTexture"));
+    generateMips(passMipBlur, name("gatherTexture"));
+
+    // The history and the depth and CoC it was taken at are swapped every frame: the pass of one parity reads the
+    // first of them and writes the second, and the other pass the other way round. Level 0 resolves straight into
+    // the frame to tonemap, the others into the texture the upsample reads.
+    dx_ptr<ID3D11Texture2D> bokehTexture;
+    dx_ptr<ID3D11RenderTargetView> bokehView;
+    if (level > 0) {
+        bokehTexture = m_device.CreateTexture(desc);
+        m_variables.AddTexture(m_device, name("lowResBokehTexture"), bokehTexture);
+        bokehView = m_device.CreateRenderTargetView(bokehTexture);
+    }
+    const auto& historyDesc = desc;
+    auto historyGuideDesc = desc;
+    historyGuideDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
+    array<dx_ptr<ID3D11RenderTargetView>, 2> historyViews, historyGuideViews;
+    for (auto parity = 0; parity < 2; ++parity) {
+        auto history = m_device.CreateTexture(historyDesc);
+        auto historyGuide = m_device.CreateTexture(historyGuideDesc);
+        m_variables.AddTexture(m_device, name("historyTexture" + to_string(parity)), history);
+        m_variables.AddTexture(m_device, name("historyGuideTexture" + to_string(parity)), historyGuide);
+        // names the temporal shader declares have to exist when its passes are created
+        if (level == 0 && parity == 0) {
+            m_variables.AddTexture(m_device, "historyTexture", history);
+            m_variables.AddTexture(m_device, "historyGuideTexture", historyGuide);
+        }
+        historyViews[parity] = m_device.CreateRenderTargetView(history);
+        historyGuideViews[parity] = m_device.CreateRenderTargetView(historyGuide);
+    }
+    array<size_t, 2> temporalPasses{};
+    for (auto parity = 0; parity < 2; ++parity) {
+        auto temporalTarget = RenderTargetsEffect(directx::viewport{ size }, m_device.CreateDepthStencilView(size.cx, size.cy));
+        temporalTarget.SetRenderTargets({ level == 0 ? hdrTarget.getRenderTarget(0) : bokehView.get(),
+                                          historyViews[1 - parity].get(), historyGuideViews[1 - parity].get() });
+        temporalPasses[parity] = addPass(L"fullScreenQuadVS.cso", L"bokehTemporalPS.cso", temporalTarget);
+        passes.push_back(temporalPasses[parity]);
+        bindTexture(temporalPasses[parity], "currentBokehTexture", name("currentBokehTexture"));
+        bindTexture(temporalPasses[parity], "historyTexture", name("historyTexture" + to_string(parity)));
+        bindTexture(temporalPasses[parity], "historyGuideTexture", name("historyGuideTexture" + to_string(parity)));
+    }
+
+    if (level > 0) {
+        // names declared only by the upsample shader have to exist when its pass is created; they start out as the
+        // half resolution textures and every level binds its own below
+        if (level == 1) {
+            m_variables.AddTexture(m_device, "lowResBokehTexture", bokehTexture);
+            m_variables.AddTexture(m_device, "lowResGuideTexture", guideTexture);
+        }
+        const auto passUpsample = addPass(L"fullScreenQuadVS.cso", L"bokehUpsamplePS.cso", hdrTarget);
+        passes.push_back(passUpsample);
+
+        bindTexture(passHighlights, "sceneTexture", name("sceneTexture"));
+        bindTexture(passHighlights, "cocTexture", name("lowResGuideTexture"));
+        for (const auto passBlurBokeh1 : passesBlurBokeh1)
+            bindTexture(passBlurBokeh1, "cocTexture", name("lowResGuideTexture"));
+        bindTexture(passMipBlur, "cocTexture", name("lowResGuideTexture"));
+        for (const auto passBlurBokeh2 : passesBlurBokeh2) {
+            bindTexture(passBlurBokeh2, "sceneTexture", name("sceneTexture"));
+            bindTexture(passBlurBokeh2, "cocTexture", name("lowResGuideTexture"));
+            for (const auto& texture : blurTextureNames)
+                bindTexture(passBlurBokeh2, texture, name(texture));
+        }
+        for (const auto texture : {"lowResBokehTexture", "lowResGuideTexture"})
+            bindTexture(passUpsample, texture, name(texture));
+    }
+
+    for (const auto passId : passes) {
+        addModelToPass(passId, quad);
+        pass(passId).SetCondition([downscale, level] { return lround(downscale->value) == level; });
+    }
+    for (size_t i = 0; i < variants.size(); ++i)
+        for (const auto passId : {passesBlurBokeh1[i], passesBlurBokeh2[i]})
+            pass(passId).SetCondition([this, downscale, level, taps = variants[i]] {
+                return lround(downscale->value) == level && m_mipBlur->value < 0.5f && m_blurVariants[level] == taps;
+            });
+    // the stochastic taps run the generic first pass and their own second pass
+    pass(passesBlurBokeh2[0]).SetCondition([this, downscale, level] {
+        return lround(downscale->value) == level && m_mipBlur->value < 0.5f && m_blurVariants[level] == 0 &&
+               m_stochasticTaps->value < 0.5f;
+    });
+    for (const auto passId : {passStochastic, passDenoiseRows, passDenoise})
+        pass(passId).SetCondition([this, downscale, level] {
+            return lround(downscale->value) == level && m_mipBlur->value < 0.5f && m_stochasticTaps->value >= 0.5f;
+        });
+    pass(passMipBlur).SetCondition([this, downscale, level] {
+        return lround(downscale->value) == level && m_mipBlur->value > 0.5f;
+    });
+    for (auto parity = 0; parity < 2; ++parity)
+        pass(temporalPasses[parity]).SetCondition([this, downscale, level, parity] {
+            return lround(downscale->value) == level && static_cast<int>(m_frame % 2) == parity;
+        });
+
+    // highlights added to the finished frame as aperture sprites, one point per texel of the level
+    auto spriteTarget = hdrTarget;
+    spriteTarget.SetDepthStencilBuffer(nullptr);
+    const auto passSprites = addPass(L"bokehSpriteVS.cso", L"bokehSpriteGS.cso", L"bokehSpritePS.cso", spriteTarget);
+    addBlendState(passSprites, blend_info::additive_blend());
+    rasterizer_info rs;
+    rs.CullMode = D3D11_CULL_NONE;
+    addRasterizerState(passSprites, rs);
+    addModelToPass(passSprites, addPointGrid(size.cx, size.cy));
+    bindTexture(passSprites, "highlightTexture", name("highlightTexture"));
+    pass(passSprites).SetCondition([this, downscale, level] {
+        return lround(downscale->value) == level && m_highlightScatter->value > 0.5f;
+    });
 }
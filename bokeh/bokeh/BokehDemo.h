@@ -1,9 +1,108 @@
 #pragma once
 #include "BokehDemoBase.h"
+#include "aperture.h"
+#include "autofocus.h"
+#include "dofBudget.h"
+#include "gpuTimer.h"
+#include "thinLens.h"
+#include "threadPool.h"
+#include <array>
+#include <limits>
+#include <vector>
 
 namespace mini::gk2 {
+    // Largest value of bokeh_downscale; the blur runs at 1 / 2^bokeh_downscale of the window resolution.
+    constexpr int BOKEH_MAX_DOWNSCALE = 2;
+    // Frames between copying the focus region of the depth buffer and reading it back, so the map never waits for
+    // the GPU.
+    constexpr size_t FOCUS_READBACK_FRAMES = 3;
+    // Threads of the autofocus histogram; regions larger than the inline threshold of DepthHistogram are split
+    // between this few, rather than every hardware thread being woken each frame.
+    constexpr unsigned FOCUS_THREADS = 2;
+
     class BokehDemo final: public BokehDemoBase {
     public:
         explicit BokehDemo(HINSTANCE hInst);
+
+    protected:
+        void update(utils::clock const& clock) override;
+
+    private:
+        //Blur passes for one bokeh_downscale level. Reduced levels downsample the scene first and upsample the
+        //result into the window; only the passes of the level selected in the GUI run.
+        void _addBokehPasses(size_t quad, int level, const GUIVariable<float>* downscale);
+
+        //Refills the aperture tables of the blur and sprite shaders from bokeh::ApertureTable when angle or
+        //aperture_sides changed.
+        void _updateApertureTable();
+
+        //Rebakes cocLutTexture when the lens variables, NUM_SAMPLES or the frustum changed.
+        void _updateCocLut();
+
+        //With autofocus on, reads back the focus region copied FOCUS_READBACK_FRAMES frames ago, moves focus_distance
+        //towards the peak of its depth histogram and copies the region of the last frame's depth.
+        void _updateAutofocus(float seconds);
+
+        //With dof_budget set, feeds the GPU time of the depth of field passes to the budget controller and writes
+        //the bokeh_downscale and max_samples it picks for the next frame.
+        void _updateBudget();
+
+        //Advances temporal_frame and keeps the view-projection of the previous frame for the temporal pass.
+        void _updateTemporal();
+
+        //Picks the blur shaders of every level: a permutation unrolled for a fixed number of taps when every blur
+        //takes one of bokeh::FixedSampleCounts taps, the generic shaders otherwise.
+        void _updateBlurVariants();
+
+        const GUIVariable<float>* m_numSamples = nullptr;
+        const GUIVariable<float>* m_sampleDensity = nullptr;
+        const GUIVariable<float>* m_focalLength = nullptr;
+        const GUIVariable<float>* m_fStop = nullptr;
+        GUIVariable<float>* m_focusDistance = nullptr;
+        const GUIVariable<float>* m_autofocus = nullptr;
+        const GUIVariable<float>* m_sensorWidth = nullptr;
+        const GUIVariable<float>* m_highlightScatter = nullptr;
+        const GUIVariable<float>* m_mipBlur = nullptr;
+        const GUIVariable<float>* m_angle = nullptr;
+        const GUIVariable<float>* m_apertureSides = nullptr;
+        CBVariable<DirectX::XMFLOAT4[bokeh::ApertureTable::MaxEdges]>* m_apertureEdges = nullptr;
+        CBVariable<DirectX::XMFLOAT4[bokeh::ApertureTable::MaxEdges * bokeh::ApertureTable::MaxEdges]>*
+            m_apertureRhombi = nullptr;
+        CBVariable<DirectX::XMFLOAT4[bokeh::Aperture::MaxSides]>* m_apertureNormals = nullptr;
+        //Steps of every bokeh_downscale level, MaxEdges per level.
+        CBVariable<DirectX::XMFLOAT4[(BOKEH_MAX_DOWNSCALE + 1) * bokeh::ApertureTable::MaxEdges]>*
+            m_apertureSteps = nullptr;
+        GUIVariable<float>* m_maxSamples = nullptr;
+        GUIVariable<float>* m_downscale = nullptr;
+        const GUIVariable<float>* m_dofBudget = nullptr;
+        const GUIVariable<float>* m_temporalFrames = nullptr;
+        CBVariable<float>* m_temporalFrame = nullptr;
+        const GUIVariable<float>* m_stochasticTaps = nullptr;
+        CBVariable<float>* m_stochasticFrame = nullptr;
+        CBVariable<DirectX::XMFLOAT4X4>* m_prevViewProj = nullptr;
+        DirectX::XMFLOAT4X4 m_viewProj{};
+        //Frames rendered so far; its parity picks which history the temporal pass reads.
+        size_t m_frame = 0;
+        //Taps of the blur shader permutation every bokeh_downscale level runs, 0 for the generic shaders.
+        std::array<int, BOKEH_MAX_DOWNSCALE + 1> m_blurVariants{};
+        //angle and sides the aperture tables were filled for.
+        float m_tableAngle = std::numeric_limits<float>::quiet_NaN();
+        int m_tableSides = 0;
+        bokeh::Aperture m_aperture;
+        bokeh::ApertureTable m_apertureTable;
+        bokeh::CocLut m_cocLut;
+        directx::dx_ptr<ID3D11Texture2D> m_cocLutTexture;
+        directx::dx_ptr<ID3D11Resource> m_screenDepth;
+        //Staging copies of the focus region of screenDepth, one per frame in flight, and the region each holds;
+        //an empty region for none.
+        std::array<directx::dx_ptr<ID3D11Texture2D>, FOCUS_READBACK_FRAMES> m_focusReadback;
+        std::array<bokeh::FocusRegion, FOCUS_READBACK_FRAMES> m_focusRegions{};
+        std::vector<float> m_focusDepth;
+        bokeh::ThreadPool m_focusPool{FOCUS_THREADS};
+        bokeh::Autofocus m_focusTracker;
+        //Time from the CoC pass to tonemapping, and the quality each frame in flight was rendered at.
+        GpuTimer m_dofTimer;
+        std::array<bokeh::DofQuality, GpuTimer::Latency> m_budgetQualities{};
+        bokeh::DofBudget m_budget;
     };
 }
@@ -1,6 +1,8 @@
 #include "BokehDemoBase.h"
 #include "model.h"
 #include "windowsx.h"
+#include <algorithm>
+#include <climits>
 
 using namespace std;
 using namespace DirectX;
@@ -101,10 +103,24 @@ protected:
     }
 };
 
+class GenerateMipsEffect: public EffectComponent {
+public:
+    explicit GenerateMipsEffect(const dx_ptr<ID3D11ShaderResourceView>& texture) : m_texture{clone(texture)} {}
+
+    void Begin(const dx_ptr<ID3D11DeviceContext>& context) const override {
+        context->GenerateMips(m_texture.get());
+    }
+
+private:
+    dx_ptr<ID3D11ShaderResourceView> m_texture;
+};
+
 BokehDemoBase::BokehDemoBase(HINSTANCE hInst) : dx_app(hInst, 1280, 720, L"Shader Demo"), m_loader(m_device),
                                                         m_layouts(m_device), m_camera(0.01f, 50.0f, 5),
                                                         m_frustrum(get_window().client_size(), XM_PIDIV4, 0.5f, 85.0f),
-                                                        m_gui(m_device, get_window()) {}
+                                                        m_gui(m_device, get_window()),
+                                                        m_focusPoint{get_window().client_size().cx / 2,
+                                                                     get_window().client_size().cy / 2} {}
 
 std::optional<LRESULT> BokehDemoBase::process_message(windows::message const& msg) {
     static bool hasCapture = false;
@@ -113,8 +129,10 @@ std::optional<LRESULT> BokehDemoBase::process_message(windows::message const& ms
     const ImGuiIO& io = ImGui::GetIO();
     switch (msg.type) {
         case WM_MBUTTONDOWN:
-            if (!io.WantCaptureMouse)
+            if (!io.WantCaptureMouse) {
+                m_focusPoint = {GET_X_LPARAM(msg.l_param), GET_Y_LPARAM(msg.l_param)};
                 return guiResult;
+            }
             [[fallthrough]];
         case WM_LBUTTONDOWN:
         case WM_RBUTTONDOWN:
@@ -190,6 +208,33 @@ size_t BokehDemoBase::addModelFromString(const std::string& model, const bool sm
     return m_models.size() - 1;
 }
 
+size_t BokehDemoBase::addPointGrid(const unsigned width, const unsigned height) {
+    static constexpr D3D11_INPUT_ELEMENT_DESC layout[1] = {
+        {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
+    };
+    const auto signature = m_layouts.registerVertexAttributesID(layout);
+    // meshes are drawn with 16-bit indices, so the grid is split into bands of whole rows
+    const auto bandRows = max(1u, static_cast<unsigned>(USHRT_MAX + 1) / max(1u, width));
+    auto grid = make_unique<Model>();
+    for (unsigned y0 = 0; y0 < height; y0 += bandRows) {
+        const auto rows = min(bandRows, height - y0);
+        vector<XMFLOAT2> points;
+        points.reserve(static_cast<size_t>(rows) * width);
+        for (auto y = y0; y < y0 + rows; ++y)
+            for (unsigned x = 0; x < width; ++x)
+                points.emplace_back((x + 0.5f) / width, (y + 0.5f) / height);
+        vector<unsigned short> indices(points.size());
+        for (size_t i = 0; i < indices.size(); ++i)
+            indices[i] = static_cast<unsigned short>(i);
+        ModelNode node;
+        node.meshIndex = grid->addMesh(m_device.CreateMesh(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST, indices, points),
+                                       signature);
+        grid->addNode(node);
+    }
+    m_models.push_back(move(grid));
+    return m_models.size() - 1;
+}
+
 size_t BokehDemoBase::addPass(const std::wstring& vsShader, const std::wstring& psShader) {
     m_passes.emplace_back(m_device, m_variables, &m_layouts, vsShader, psShader);
     return m_passes.size() - 1;
@@ -214,10 +259,22 @@ size_t BokehDemoBase::addPass(const std::wstring& vsShader, const std::wstring&
     return m_passes.size() - 1;
 }
 
+size_t BokehDemoBase::addPass(const std::wstring& vsShader, const std::wstring& gsShader,
+                              const std::wstring& psShader, const RenderTargetsEffect& renderTarget,
+                              bool clearRenderTarget) {
+    m_passes.emplace_back(m_device, m_variables, &m_layouts, renderTarget, clearRenderTarget, vsShader, gsShader,
+                          psShader);
+    return m_passes.size() - 1;
+}
+
 void BokehDemoBase::addRasterizerState(const size_t passId, const directx::rasterizer_info& desc) {
     m_passes[passId].AddEffect(make_unique<RasterizerEffect>(m_device.CreateRasterizerState(desc)));
 }
 
+void BokehDemoBase::addBlendState(const size_t passId, const directx::blend_info& desc) {
+    m_passes[passId].AddEffect(make_unique<BlendStateEffect>(m_device.CreateBlendState(desc)));
+}
+
 void BokehDemoBase::addModelToPass(const size_t passId, const size_t modelId) {
     m_passes[passId].AddModel(m_models[modelId].get());
 }
@@ -229,3 +286,11 @@ void BokehDemoBase::copyRenderTarget(const size_t passId, const std::string& dst
 void BokehDemoBase::copyDepthBuffer(const size_t passId, const std::string& dstTexture) {
     pass(passId).EmplaceEffect<CopyDephtBufferEffect>(m_variables.GetTexture(dstTexture));
 }
+
+void BokehDemoBase::generateMips(const size_t passId, const std::string& texture) {
+    pass(passId).EmplaceEffect<GenerateMipsEffect>(m_variables.GetTexture(texture));
+}
+
+void BokehDemoBase::bindTexture(const size_t passId, const std::string& shaderName, const std::string& texture) {
+    pass(passId).SetTexture(shaderName, m_variables.GetTexture(texture));
+}
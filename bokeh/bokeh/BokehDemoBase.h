@@ -25,6 +25,10 @@ namespace mini::gk2 {
 
         size_t addModelFromString(const std::string& model, bool smoothNormals = true);
 
+        //Point list with one point per texel of a width x height texture, its TEXCOORD0 at the texel centre, for
+        //geometry shaders that turn texels into sprites.
+        size_t addPointGrid(unsigned width, unsigned height);
+
         size_t addPass(const std::wstring& vsShader, const std::wstring& psShader);
 
         size_t addPass(const std::wstring& vsShader, const std::wstring& gsShader, const std::wstring& psShader);
@@ -35,8 +39,13 @@ namespace mini::gk2 {
         size_t addPass(const std::wstring& vsShader, const std::wstring& psShader,
                        const RenderTargetsEffect& renderTarget, bool clearRenderTarget = false);
 
+        size_t addPass(const std::wstring& vsShader, const std::wstring& gsShader, const std::wstring& psShader,
+                       const RenderTargetsEffect& renderTarget, bool clearRenderTarget = false);
+
         void addRasterizerState(size_t passId, const directx::rasterizer_info& desc);
 
+        void addBlendState(size_t passId, const directx::blend_info& desc);
+
         Model& model(const size_t modelId) { return *m_models[modelId]; }
 
         [[nodiscard]] const Model& model(const size_t modelId) const { return *m_models[modelId]; }
@@ -45,12 +54,24 @@ namespace mini::gk2 {
 
         [[nodiscard]] const RenderPass& pass(const size_t passId) const { return m_passes[passId]; }
 
+        [[nodiscard]] const ViewFrustrum& frustrum() const { return m_frustrum; }
+
+        //Client pixel last clicked with the middle button outside the GUI, the centre of the window until then.
+        [[nodiscard]] POINT focusPoint() const { return m_focusPoint; }
+
         void addModelToPass(size_t passId, size_t modelId);
 
         void copyRenderTarget(size_t passId, const std::string& dstTexture);
 
         void copyDepthBuffer(size_t passId, const std::string& dstTexture);
 
+        //Fills the mip chain of texture from its top level before the pass draws. The texture needs all mip levels
+        //and D3D11_RESOURCE_MISC_GENERATE_MIPS.
+        void generateMips(size_t passId, const std::string& texture);
+
+        //Makes the shaders of the pass read texture wherever they declare shaderName.
+        void bindTexture(size_t passId, const std::string& shaderName, const std::string& texture);
+
         CBVariableManager m_variables;
 
     private:
@@ -64,5 +85,6 @@ namespace mini::gk2 {
         directx::orbit_camera m_camera;
         ViewFrustrum m_frustrum;
         GUIRenderer m_gui;
+        POINT m_focusPoint;
     };
 }
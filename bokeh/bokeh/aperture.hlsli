@@ -0,0 +1,69 @@
+// Polygonal aperture of the bokeh passes, see Aperture in bokehCpu/aperture.h: a regular polygon with twice as many
+// sides as it has edges here, tiled by the rhombi spanned by pairs of them, or one side fewer, which the rhombi only
+// approximate. Every rhombus is a blur along one edge in the first pass and along the other in the second. The demo
+// fills the tables from ApertureTable whenever angle or aperture_sides change, so no pixel evaluates a sine.
+
+// Must match Aperture::MaxSides in bokehCpu/aperture.h.
+static const int MAX_SIDES = 10;
+static const int MAX_EDGES = MAX_SIDES / 2;
+// Must match BOKEH_MAX_DOWNSCALE + 1 in BokehDemo.h.
+static const int BLUR_LEVELS = 3;
+
+// 5 to 10, see Aperture in bokehCpu/aperture.h
+float aperture_sides;
+// xy - unit direction of edge k, z - its length relative to the circumradius
+float4 aperture_edges[MAX_EDGES];
+// xy - outward normal of side k, z - side length, w - apothem, both relative to the circumradius
+float4 aperture_normals[MAX_SIDES];
+// rhombus (k, j) at MAX_EDGES * k + j: xy - offset of its first corner in circumradii, z - its share of the area
+float4 aperture_rhombi[MAX_EDGES * MAX_EDGES];
+// xy - one pixel along edge k in texture coordinates of the targets of bokeh_downscale level l, at MAX_EDGES * l + k
+float4 aperture_steps[BLUR_LEVELS * MAX_EDGES];
+
+int Sides() {
+    return clamp((int)round(aperture_sides), 5, MAX_SIDES);
+}
+
+// Six sides take the hexagon passes.
+bool IsHexagon() {
+    return Sides() == 6;
+}
+
+// Half the sides, rounded up.
+int EdgeCount() {
+    return (Sides() + 1) / 2;
+}
+
+// Length of edge k relative to the circumradius; all are SideLength() but the outer two of an odd polygon.
+float EdgeLength(const int k) {
+    return aperture_edges[k].z;
+}
+
+// Length of a side relative to the circumradius.
+float SideLength() {
+    return aperture_normals[0].z;
+}
+
+// Distance of the sides from the centre relative to the circumradius.
+float Apothem() {
+    return aperture_normals[0].w;
+}
+
+float2 Edge(const int k) {
+    return aperture_edges[k].xy;
+}
+
+float2 Normal(const int k) {
+    return aperture_normals[k].xy;
+}
+
+// Edge(k) scaled to one pixel of the targets of level, in texture coordinates.
+float2 EdgeStep(const int level, const int k) {
+    return aperture_steps[MAX_EDGES * level + k].xy;
+}
+
+// Rhombus spanned by edges k < j: xy = offset of its first corner from the pixel in circumradii, z = its share of the
+// polygon's area.
+float3 Rhombus(const int k, const int j) {
+    return aperture_rhombi[MAX_EDGES * k + j].xyz;
+}
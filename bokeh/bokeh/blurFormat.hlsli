@@ -0,0 +1,37 @@
+// Storage of the blurTexture<k> targets between the two blur passes, BLUR_FORMAT in BokehDemo.cpp, in the order of
+// bokeh::BlurFormat. The near field targets keep an alpha channel.
+static const int BLUR_RGBA32F = 0;
+static const int BLUR_RGBA8 = 1;
+static const int BLUR_RGBA16F = 2;
+// no alpha, the CoC is read back from cocTexture
+static const int BLUR_R11G11B10F = 3;
+// 16 bits, the colour mapped to [0, 1) by c / (1 + c) so it keeps its range; the CoC is read back from cocTexture
+static const int BLUR_B5G6R5 = 4;
+// Smallest 1 - x the B5G6R5 decode divides by; caps the colour at 63.
+static const float MIN_PACKED_COMPLEMENT = 1.0f / 64.0f;
+
+float blur_format;
+
+int BlurFormat() {
+    return (int)round(blur_format);
+}
+
+// What bokeh1PS writes for a blurred colour and its CoC.
+float4 EncodeBlur(const float3 color, const float coc) {
+    if (BlurFormat() == BLUR_B5G6R5) {
+        return float4(color / (1.0f + max(color, 0.0f)), coc);
+    }
+    return float4(color, coc);
+}
+
+// Reverses EncodeBlur for a texel stored at uv, taking the CoC from alpha or from cocTexture, scaled as in bokeh1PS.
+float4 DecodeBlur(float4 stored, Texture2D cocPlane, const float2 uv) {
+    const int format = BlurFormat();
+    if (format == BLUR_B5G6R5) {
+        stored.rgb /= max(1.0f - stored.rgb, MIN_PACKED_COMPLEMENT);
+    }
+    if (format >= BLUR_R11G11B10F) {
+        stored.a = coc_factor * cocPlane.SampleLevel(blurSampler, uv, 0).r;
+    }
+    return stored;
+}
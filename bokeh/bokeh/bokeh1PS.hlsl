@@ -1,13 +1,20 @@
-static const float PI = 3.14159265322f;
 //static const int NUM_SAMPLES = 16; // static keyword is required
+// Must match COC_TILE_SIZE in BokehDemo.cpp.
+static const int TILE_SIZE = 16;
 
-float angle;
 float coc_factor;
 float NUM_SAMPLES;
+float bokeh_downscale;
+float sample_density;
+float max_samples;
 sampler blurSampler;
 Texture2D sceneTexture;
-Texture2D verticalBlurTexture;
-Texture2D diagonalBlurTexture;
+Texture2D cocTexture;
+Texture2D cocTileTexture;
+
+#include "aperture.hlsli"
+#include "temporal.hlsli"
+#include "blurFormat.hlsli"
 
 
 struct PSInput {
@@ -15,50 +22,208 @@ struct PSInput {
     float2 tex : TEXCOORD0;
 };
 
+// Full resolution pixels per pixel of the textures being blurred. The blur takes proportionally fewer, longer steps
+// at reduced resolution, so it keeps its size on screen.
+float BlurScale() {
+    return exp2(round(bokeh_downscale));
+}
+
+// bokeh_downscale level of the textures being blurred, which picks the aperture_steps of their size.
+int BlurLevel() {
+    return (int)round(bokeh_downscale);
+}
+
+// Length of the blurs in steps of one CoC.
+float BlurLength() {
+#ifdef FIXED_SAMPLES
+    return FIXED_SAMPLES;
+#else
+    return ceil(NUM_SAMPLES / BlurScale());
+#endif
+}
+
+// Taps of a blur over coc * BlurLength() pixels: sample_density per pixel, at least one and at most max_samples.
+// A zero sample_density keeps BlurLength() taps for every CoC.
+int SampleCount(const float coc) {
+#ifdef FIXED_SAMPLES
+    return FIXED_SAMPLES;
+#else
+    if (sample_density <= 0.0f) {
+        return (int)BlurLength();
+    }
+    return (int)clamp(ceil(coc * BlurLength() * sample_density), 1.0f, max(round(max_samples), 1.0f));
+#endif
+}
+
+// Blurs along the edges of the aperture but the last, of the scene and of the premultiplied near field. The hexagon
+// writes its vertical and diagonal blurs to the first two.
 struct PSOUTPUT {
-    float4 vertical : COLOR0;
-    float4 diagonal : COLOR1;
+    float4 blur[MAX_EDGES - 1] : COLOR0;
+    float4 nearBlur[MAX_EDGES - 1] : COLOR4;
 };
 
-float4 BlurTexture(Texture2D tex, float2 uv, const float2 direction) {
+// CoC at uv, and the CoC of the near field in y. At reduced resolution cocTexture is the guide of the downsample,
+// which has both in the same place.
+float SampleCoc(const float2 uv) {
+    return cocTexture.SampleLevel(blurSampler, uv, 0).r;
+}
+
+// Takes samples taps of the scene, direction apart, weighted by their CoC; this frame's subset of them. The taps are
+// counted per pixel, so they use SampleLevel, which needs no gradients inside the loop.
+float4 BlurTexture(float2 uv, const float2 direction, const int samples) {
     float4 finalColor = 0.0f;
     float blurAmount = 0.0f;
 
+    // The result is rescaled with the CoC half a CoC along the blur, however long the steps are.
+    const float coc = SampleCoc(uv + direction * (0.5f * samples / BlurLength()));
+
     // Remove Rhombi Overlap
     uv += direction * 0.5f;
 
-    const float coc = tex.Sample(blurSampler, uv).a;
-
-    for (int i = 0; i < NUM_SAMPLES; ++i) {
-        float4 color = tex.Sample(blurSampler, uv + direction * i);
+    const int taps = TapCount(samples, 0);
+    float cocSum = 0.0f;
+    TAP_LOOP
+    for (int n = 0; n < taps; ++n) {
+        const float2 tap = uv + direction * TapOffset(n, samples, 0);
+        float4 color = float4(sceneTexture.SampleLevel(blurSampler, tap, 0).rgb, SampleCoc(tap));
+        cocSum += color.a;
         color *= color.a;
         blurAmount += color.a;
         finalColor += color;
     }
 
-    return (finalColor / blurAmount) * coc;
+    // A few stochastic taps can all land on much smaller CoCs than coc, see MaxStochasticRescale in bokehCpu.
+    const float limit = MAX_STOCHASTIC_RESCALE * blurAmount / abs(cocSum);
+    const float rescale = StochasticTaps(samples) ? sign(coc) * min(abs(coc), limit) : coc;
+    return (finalColor / blurAmount) * rescale;
+}
+
+// Near field gather: samples taps, direction apart, of which only those whose own near CoC spreads a blur back over
+// uv count. Returns their colour premultiplied by the fraction of taps that do, and that fraction in alpha.
+float4 BlurNearField(float2 uv, const float2 direction, const float stepLength, const int samples) {
+    float4 finalColor = 0.0f;
+
+    // Remove Rhombi Overlap
+    uv += direction * 0.5f;
+
+    const int taps = TapCount(samples, 0);
+    TAP_LOOP
+    for (int n = 0; n < taps; ++n) {
+        const float offset = TapOffset(n, samples, 0);
+        const float2 tap = uv + direction * offset;
+        const float nearCoc = coc_factor * cocTexture.SampleLevel(blurSampler, tap, 0).g;
+        if (nearCoc > 0.0f && nearCoc * BlurLength() >= stepLength * (offset + 0.5f)) {
+            finalColor += float4(sceneTexture.SampleLevel(blurSampler, tap, 0).rgb, 1.0f);
+        }
+    }
+
+    return finalColor / taps;
+}
+
+// BlurTexture for tiles where every tap has the same CoC, so the per-sample weighting can be skipped.
+float4 BlurTextureUniform(float2 uv, const float2 direction, const int samples) {
+    float4 finalColor = 0.0f;
+
+    // Remove Rhombi Overlap
+    uv += direction * 0.5f;
+
+    const int taps = TapCount(samples, 0);
+    TAP_LOOP
+    for (int n = 0; n < taps; ++n) {
+        finalColor.rgb += sceneTexture.SampleLevel(blurSampler, uv + direction * TapOffset(n, samples, 0), 0).rgb;
+    }
+
+    // The CoC weights cancel: (sum(rgb * coc) / (taps * coc^2)) * coc
+    return finalColor / taps;
 }
 
 PSOUTPUT main(const PSInput i) : SV_TARGET {
-    uint viewWidth, viewHeight;
-    sceneTexture.GetDimensions(viewWidth, viewHeight);
-    const float2 invViewDimensions = float2(1.0f / viewWidth, 1.0f / viewHeight);
+    SetTapJitter(i.pos.xy, 0);
+    const int level = BlurLevel();
+
+    // x, y: CoC range reachable from the tile, z: largest CoC in the tile, w: largest near CoC reachable from it
+    const float4 tile = cocTileTexture.Load(int3(int2(i.pos.xy * BlurScale()) / TILE_SIZE, 0));
+    const bool hexagon = IsHexagon();
+
+    PSOUTPUT output;
+    [unroll]
+    for (int k = 0; k < MAX_EDGES - 1; ++k) {
+        output.blur[k] = 0.0f;
+        output.nearBlur[k] = 0.0f;
+    }
+
+    if (tile.w > 0.0f && hexagon) {
+        // The near field spreads over its surroundings, so it is gathered over the largest near CoC that can reach
+        // the tile rather than over the pixel's own CoC.
+        const int nearSamples = SampleCount(tile.w);
+        const float nearStep = tile.w * BlurLength() / nearSamples;
+        const float2 nearDir = nearStep * EdgeStep(level, 0);
+        const float2 nearDir2 = -nearStep * EdgeStep(level, 1);
+        output.nearBlur[0] = BlurNearField(i.tex, nearDir, nearStep, nearSamples);
+        output.nearBlur[1] = 0.5f * (BlurNearField(i.tex, nearDir2, nearStep, nearSamples) + output.nearBlur[0]);
+    } else if (tile.w > 0.0f) {
+        [unroll]
+        for (int k = 0; k < MAX_EDGES - 1; ++k) {
+            if (k < EdgeCount() - 1) {
+                const float edgeCoc = tile.w * EdgeLength(k);
+                const int nearSamples = SampleCount(edgeCoc);
+                const float nearStep = edgeCoc * BlurLength() / nearSamples;
+                const float2 nearDir = nearStep * EdgeStep(level, k);
+                output.nearBlur[k] = BlurNearField(i.tex, nearDir, nearStep, nearSamples);
+            }
+        }
+    }
+
+    if (tile.z == 0.0f) {
+        // In focus, a zero CoC scales all blurs to zero.
+        return output;
+    }
 
     // Get the local CoC to determine the radius of the blur.
     // tu mozna zdefiniowac poziom bluru w zaleznosci od odleglosci z
-    const float coc = coc_factor * sceneTexture.Sample(blurSampler, i.tex).a;
+    const float coc = coc_factor * cocTexture.Sample(blurSampler, i.tex).r;
 
-    // CoC-weighted vertical blur.
-    const float2 blurDir = coc * invViewDimensions * float2(cos(angle + PI / 2), sin(angle + PI / 2));
-    float4 color = BlurTexture(sceneTexture, i.tex, blurDir) * coc;
+    if (!hexagon) {
+        [unroll]
+        for (int k = 0; k < MAX_EDGES - 1; ++k) {
+            if (k < EdgeCount() - 1) {
+                // Edge k is EdgeLength(k) circumradii of coc * BlurLength() pixels long.
+                const float edgeCoc = coc * EdgeLength(k);
+                const int samples = SampleCount(edgeCoc);
+                const float stepLength = edgeCoc * BlurLength() / samples;
+                const float2 blurDir = stepLength * EdgeStep(level, k);
+                float4 color;
+                if (tile.x == tile.y) {
+                    color = BlurTextureUniform(i.tex, blurDir, samples) * coc;
+                } else {
+                    color = BlurTexture(i.tex, blurDir, samples) * coc;
+                }
+                output.blur[k] = EncodeBlur(color.rgb, coc);
+            }
+        }
+        return output;
+    }
+
+    // Larger CoCs spread more taps over their longer blurs.
+    const int samples = SampleCount(coc);
+    const float stepLength = coc * BlurLength() / samples;
 
-    // CoC-weighted diagonal blur.
-    const float2 blurDir2 = coc * invViewDimensions * float2(cos(angle + -PI / 6), sin(angle + -PI / 6));
-    float4 color2 = BlurTexture(sceneTexture, i.tex, blurDir2) * coc;
+    // CoC-weighted vertical blur, along the first edge of the hexagon.
+    const float2 blurDir = stepLength * EdgeStep(level, 0);
+    // CoC-weighted diagonal blur, against the second edge.
+    const float2 blurDir2 = -stepLength * EdgeStep(level, 1);
+
+    float4 color, color2;
+    if (tile.x == tile.y) {
+        color = BlurTextureUniform(i.tex, blurDir, samples) * coc;
+        color2 = BlurTextureUniform(i.tex, blurDir2, samples) * coc;
+    } else {
+        color = BlurTexture(i.tex, blurDir, samples) * coc;
+        color2 = BlurTexture(i.tex, blurDir2, samples) * coc;
+    }
 
     // Output to MRT - multi render target
-    PSOUTPUT output;
-    output.vertical = float4(color.rgb, coc);
-    output.diagonal = float4(0.5 * (color2.rgb + output.vertical.xyz), coc);
+    output.blur[0] = EncodeBlur(color.rgb, coc);
+    output.blur[1] = EncodeBlur(0.5 * (color2.rgb + color.rgb), coc);
     return output;
 }
@@ -0,0 +1,3 @@
+// bokeh1PS with 12 taps per blur, see FIXED_SAMPLES in temporal.hlsli.
+#define FIXED_SAMPLES 12
+#include "bokeh1PS.hlsl"
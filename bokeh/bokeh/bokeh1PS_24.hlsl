@@ -0,0 +1,3 @@
+// bokeh1PS with 24 taps per blur, see FIXED_SAMPLES in temporal.hlsli.
+#define FIXED_SAMPLES 24
+#include "bokeh1PS.hlsl"
@@ -0,0 +1,3 @@
+// bokeh1PS with 8 taps per blur, see FIXED_SAMPLES in temporal.hlsli.
+#define FIXED_SAMPLES 8
+#include "bokeh1PS.hlsl"
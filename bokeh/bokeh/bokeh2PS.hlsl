@@ -1,13 +1,31 @@
-static const float PI = 3.14159265322f;
 //static const int NUM_SAMPLES = 16; // static keyword is required
+// Must match COC_TILE_SIZE in BokehDemo.cpp.
+static const int TILE_SIZE = 16;
 
-float angle;
 float coc_factor;
 float NUM_SAMPLES;
+float bokeh_downscale;
+float sample_density;
+float max_samples;
 sampler blurSampler;
 Texture2D sceneTexture;
-Texture2D verticalBlurTexture;
-Texture2D diagonalBlurTexture;
+// First pass blurs along each edge of the aperture but the last, the vertical and diagonal ones of the hexagon
+// being the first two.
+Texture2D blurTexture0;
+Texture2D blurTexture1;
+Texture2D blurTexture2;
+Texture2D blurTexture3;
+Texture2D nearBlurTexture0;
+Texture2D nearBlurTexture1;
+Texture2D nearBlurTexture2;
+Texture2D nearBlurTexture3;
+Texture2D cocTileTexture;
+// CoC of the blurTexture<k> formats without alpha
+Texture2D cocTexture;
+
+#include "aperture.hlsli"
+#include "temporal.hlsli"
+#include "blurFormat.hlsli"
 
 
 struct PSInput {
@@ -15,17 +33,60 @@ struct PSInput {
     float2 tex : TEXCOORD0;
 };
 
-float4 BlurTexture(Texture2D tex, float2 uv, const float2 direction) {
+// Full resolution pixels per pixel of the textures being blurred. The blur takes proportionally fewer, longer steps
+// at reduced resolution, so it keeps its size on screen.
+float BlurScale() {
+    return exp2(round(bokeh_downscale));
+}
+
+// bokeh_downscale level of the textures being blurred, which picks the aperture_steps of their size.
+int BlurLevel() {
+    return (int)round(bokeh_downscale);
+}
+
+// Length of the blurs in steps of one CoC.
+float BlurLength() {
+#ifdef FIXED_SAMPLES
+    return FIXED_SAMPLES;
+#else
+    return ceil(NUM_SAMPLES / BlurScale());
+#endif
+}
+
+// Taps of a blur over coc * BlurLength() pixels: sample_density per pixel, at least one and at most max_samples.
+// A zero sample_density keeps BlurLength() taps for every CoC.
+int SampleCount(const float coc) {
+#ifdef FIXED_SAMPLES
+    return FIXED_SAMPLES;
+#else
+    if (sample_density <= 0.0f) {
+        return (int)BlurLength();
+    }
+    return (int)clamp(ceil(coc * BlurLength() * sample_density), 1.0f, max(round(max_samples), 1.0f));
+#endif
+}
+
+// Blurred colour of the first pass at uv and its CoC, whatever the format of tex.
+float4 SampleBlur(Texture2D tex, const float2 uv) {
+    return DecodeBlur(tex.SampleLevel(blurSampler, uv, 0), cocTexture, uv);
+}
+
+// Takes samples taps, direction apart; this frame's subset of them. The taps are counted per pixel, so they use SampleLevel, which needs no
+// gradients inside the loop.
+float4 BlurTexture(Texture2D tex, float2 uv, const float2 direction, const int samples) {
     float4 finalColor = 0.0f;
     float blurAmount = 0.0f;
 
+    // The result is rescaled with the CoC half a CoC along the blur, however long the steps are.
+    const float coc = SampleBlur(tex, uv + direction * (0.5f * samples / BlurLength())).a;
+
     // Remove Rhombi Overlap
     uv += direction * 0.5f;
 
-    const float coc = tex.Sample(blurSampler, uv).a;
-
-    for (int i = 0; i < NUM_SAMPLES; ++i) {
-        float4 color = tex.Sample(blurSampler, uv + direction * i);
+    const int taps = TapCount(samples, 1);
+    TAP_LOOP
+    for (int n = 0; n < taps; ++n) {
+        float4 color = SampleBlur(tex, uv + direction * TapOffset(n, samples, 1));
         color *= color.a;
         blurAmount += color.a;
         finalColor += color;
@@ -34,30 +95,178 @@ float4 BlurTexture(Texture2D tex, float2 uv, const float2 direction) {
     return (finalColor / blurAmount) / coc;
 }
 
-float4 main(const PSInput i) : SV_TARGET {
-    uint viewWidth, viewHeight;
-    verticalBlurTexture.GetDimensions(viewWidth, viewHeight);
-    const float2 invViewDimensions = float2(1.0f / viewWidth, 1.0f / viewHeight);
+// BlurTexture for tiles where every tap has the same CoC, so the per-sample weighting can be skipped.
+float4 BlurTextureUniform(Texture2D tex, float2 uv, const float2 direction, const int samples) {
+    float4 finalColor = 0.0f;
+
+    const float coc = SampleBlur(tex, uv + direction * (0.5f * samples / BlurLength())).a;
+
+    // Remove Rhombi Overlap
+    uv += direction * 0.5f;
+
+    const int taps = TapCount(samples, 1);
+    TAP_LOOP
+    for (int n = 0; n < taps; ++n) {
+        finalColor += SampleBlur(tex, uv + direction * TapOffset(n, samples, 1));
+    }
+
+    // The CoC weights cancel: (sum(rgb * coc) / (taps * coc^2)) / coc
+    return finalColor / (taps * coc * coc);
+}
+
+// Plain average of samples premultiplied taps, direction apart: the second pass of the near field.
+float4 BlurPremultiplied(Texture2D tex, float2 uv, const float2 direction, const int samples) {
+    float4 finalColor = 0.0f;
+
+    // Remove Rhombi Overlap
+    uv += direction * 0.5f;
 
+    const int taps = TapCount(samples, 1);
+    TAP_LOOP
+    for (int n = 0; n < taps; ++n) {
+        finalColor += tex.SampleLevel(blurSampler, uv + direction * TapOffset(n, samples, 1), 0);
+    }
+
+    return finalColor / taps;
+}
+
+// Second pass of the CoC-weighted blur; range is the CoC range reachable from the tile.
+float3 FarField(const float2 uv, const float2 range) {
     // Get the center to determine the radius of the blur
-    float4 centerColor = verticalBlurTexture.Sample(blurSampler, i.tex);
-    float4 centerColor2 = diagonalBlurTexture.Sample(blurSampler, i.tex);
+    float4 centerColor = SampleBlur(blurTexture0, uv);
+    float4 centerColor2 = SampleBlur(blurTexture1, uv);
     const float coc = centerColor.a;
     const float coc2 = centerColor2.a;
+    if (coc == 0.0f) {
+        return sceneTexture.Sample(blurSampler, uv).rgb;
+    }
 
-    // Compute the blur direction. Here, diagonal.
-    const float2 blurDirection = coc * invViewDimensions * float2(cos(angle - PI / 6), sin(angle - PI / 6));
-    const float2 blurDirection2 = coc2 * invViewDimensions * float2(cos(angle - 5 * PI / 6), sin(angle - 5 * PI / 6));
+    // Larger CoCs spread more taps over their longer blurs.
+    const int samples = SampleCount(coc);
+    const int samples2 = SampleCount(coc2);
+    const float stepLength = coc * BlurLength() / samples;
+    const float stepLength2 = coc2 * BlurLength() / samples2;
+
+    // Compute the blur direction. Here, diagonal: against the second edge of the hexagon and along the third.
+    const float2 blurDirection = -stepLength * EdgeStep(BlurLevel(), 1);
+    const float2 blurDirection2 = stepLength2 * EdgeStep(BlurLevel(), 2);
 
     // Blur using the weights to bias it
-    float4 color = BlurTexture(verticalBlurTexture, i.tex, blurDirection) * coc;
-    float4 color2 = BlurTexture(diagonalBlurTexture, i.tex, blurDirection2) * coc2;
+    float4 color, color2;
+    if (range.x == range.y) {
+        color = BlurTextureUniform(blurTexture0, uv, blurDirection, samples) * coc;
+        color2 = BlurTextureUniform(blurTexture1, uv, blurDirection2, samples2) * coc2;
+    } else {
+        color = BlurTexture(blurTexture0, uv, blurDirection, samples) * coc;
+        color2 = BlurTexture(blurTexture1, uv, blurDirection2, samples2) * coc2;
+    }
 
-    float3 output = (color.rgb + color2.rgb) * 0.5f;
+    return (color.rgb + color2.rgb) * 0.5f;
+}
+
+// Second pass of the near field gathered over nearCoc, premultiplied colour and coverage.
+float4 NearField(const float2 uv, const float nearCoc) {
+    const int samples = SampleCount(nearCoc);
+    const float stepLength = nearCoc * BlurLength() / samples;
+    const float2 blurDirection = -stepLength * EdgeStep(BlurLevel(), 1);
+    const float2 blurDirection2 = stepLength * EdgeStep(BlurLevel(), 2);
+    return 0.5f * (BlurPremultiplied(nearBlurTexture0, uv, blurDirection, samples)
+                   + BlurPremultiplied(nearBlurTexture1, uv, blurDirection2, samples));
+}
 
+// Second pass of the rhombi whose first edge is first: the first pass blur tex along that edge, blurred along the
+// other edge of each rhombus from its corner and weighted by its area.
+float4 BlurRhombi(Texture2D tex, const int first, const float2 uv, const float coc, const bool uniform,
+                  const float2 invViewDimensions) {
+    float4 sum = 0.0f;
+    for (int j = first + 1; j < EdgeCount(); ++j) {
+        const float edgeCoc = coc * EdgeLength(j);
+        const int samples = SampleCount(edgeCoc);
+        const float stepLength = edgeCoc * BlurLength() / samples;
+        const float3 rhombus = Rhombus(first, j);
+        const float2 corner = uv + rhombus.xy * coc * BlurLength() * invViewDimensions;
+        const float2 blurDirection = stepLength * EdgeStep(BlurLevel(), j);
+        float4 color;
+        if (uniform) {
+            color = BlurTextureUniform(tex, corner, blurDirection, samples);
+        } else {
+            color = BlurTexture(tex, corner, blurDirection, samples);
+        }
+        sum += rhombus.z * color * coc;
+    }
+    return sum;
+}
+
+// FarField of apertures other than the hexagon, summing all rhombi.
+float3 PolygonFarField(const float2 uv, const float2 range, const float2 invViewDimensions) {
+    const float coc = SampleBlur(blurTexture0, uv).a;
     if (coc == 0.0f) {
+        return sceneTexture.Sample(blurSampler, uv).rgb;
+    }
+
+    const bool uniform = range.x == range.y;
+    float4 color = BlurRhombi(blurTexture0, 0, uv, coc, uniform, invViewDimensions);
+    color += BlurRhombi(blurTexture1, 1, uv, coc, uniform, invViewDimensions);
+    color += BlurRhombi(blurTexture2, 2, uv, coc, uniform, invViewDimensions);
+    color += BlurRhombi(blurTexture3, 3, uv, coc, uniform, invViewDimensions);
+    return color.rgb;
+}
+
+// Near field counterpart of BlurRhombi, premultiplied colour and coverage.
+float4 BlurNearRhombi(Texture2D tex, const int first, const float2 uv, const float nearCoc,
+                      const float2 invViewDimensions) {
+    float4 sum = 0.0f;
+    for (int j = first + 1; j < EdgeCount(); ++j) {
+        const float edgeCoc = nearCoc * EdgeLength(j);
+        const int samples = SampleCount(edgeCoc);
+        const float stepLength = edgeCoc * BlurLength() / samples;
+        const float3 rhombus = Rhombus(first, j);
+        const float2 corner = uv + rhombus.xy * nearCoc * BlurLength() * invViewDimensions;
+        const float2 blurDirection = stepLength * EdgeStep(BlurLevel(), j);
+        sum += rhombus.z * BlurPremultiplied(tex, corner, blurDirection, samples);
+    }
+    return sum;
+}
+
+// NearField of apertures other than the hexagon.
+float4 PolygonNearField(const float2 uv, const float nearCoc, const float2 invViewDimensions) {
+    return BlurNearRhombi(nearBlurTexture0, 0, uv, nearCoc, invViewDimensions)
+           + BlurNearRhombi(nearBlurTexture1, 1, uv, nearCoc, invViewDimensions)
+           + BlurNearRhombi(nearBlurTexture2, 2, uv, nearCoc, invViewDimensions)
+           + BlurNearRhombi(nearBlurTexture3, 3, uv, nearCoc, invViewDimensions);
+}
+
+float4 main(const PSInput i) : SV_TARGET {
+    SetTapJitter(i.pos.xy, 1);
+    uint viewWidth, viewHeight;
+    blurTexture0.GetDimensions(viewWidth, viewHeight);
+    const float2 invViewDimensions = float2(1.0f / viewWidth, 1.0f / viewHeight);
+
+    // x, y: CoC range reachable from the tile, z: largest CoC in the tile, w: largest near CoC reachable from it
+    const float4 tile = cocTileTexture.Load(int3(int2(i.pos.xy * BlurScale()) / TILE_SIZE, 0));
+    const bool hexagon = IsHexagon();
+    float3 output;
+    if (tile.z == 0.0f) {
         output = sceneTexture.Sample(blurSampler, i.tex).rgb;
+    } else if (hexagon) {
+        output = FarField(i.tex, tile.xy);
+    } else {
+        output = PolygonFarField(i.tex, tile.xy, invViewDimensions);
     }
-    
-    return float4(output, 1.0f);
+
+    // The near field goes over everything behind it, premultiplied by its coverage. The coverage stays in alpha
+    // for the upsample, which must not replace it with the sharp scene.
+    float coverage = 0.0f;
+    if (tile.w > 0.0f) {
+        float4 near;
+        if (hexagon) {
+            near = NearField(i.tex, tile.w);
+        } else {
+            near = PolygonNearField(i.tex, tile.w, invViewDimensions);
+        }
+        output = near.rgb + (1.0f - near.a) * output;
+        coverage = near.a;
+    }
+
+    return float4(output, coverage);
 }
@@ -0,0 +1,3 @@
+// bokeh2PS with 16 taps per blur, see FIXED_SAMPLES in temporal.hlsli.
+#define FIXED_SAMPLES 16
+#include "bokeh2PS.hlsl"
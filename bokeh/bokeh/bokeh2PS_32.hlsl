@@ -0,0 +1,3 @@
+// bokeh2PS with 32 taps per blur, see FIXED_SAMPLES in temporal.hlsli.
+#define FIXED_SAMPLES 32
+#include "bokeh2PS.hlsl"
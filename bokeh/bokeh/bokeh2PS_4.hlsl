@@ -0,0 +1,3 @@
+// bokeh2PS with 4 taps per blur, see FIXED_SAMPLES in temporal.hlsli.
+#define FIXED_SAMPLES 4
+#include "bokeh2PS.hlsl"
@@ -0,0 +1,3 @@
+// bokeh2PS with 8 taps per blur, see FIXED_SAMPLES in temporal.hlsli.
+#define FIXED_SAMPLES 8
+#include "bokeh2PS.hlsl"
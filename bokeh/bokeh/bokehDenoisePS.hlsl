@@ -0,0 +1,85 @@
+#include "cocLut.hlsli"
+
+// How fast the weight of a neighbour falls off with its CoC and relative depth difference from the pixel; a
+// difference of 1 / SHARPNESS drops it. The same as in bokehTemporalPS.
+static const float COC_SHARPNESS = 8.0f;
+static const float DEPTH_SHARPNESS = 16.0f;
+
+// Weights of the 5 taps of either pass.
+static const float WEIGHTS[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+
+float coc_factor;
+float NUM_SAMPLES;
+float bokeh_downscale;
+float sample_density;
+float max_samples;
+float stochastic_taps;
+Texture2D denoiseTexture;
+Texture2D screenDepth;
+Texture2D cocTexture;
+
+
+struct PSInput {
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+// As in bokeh2PS.
+float BlurScale() {
+    return exp2(round(bokeh_downscale));
+}
+
+float BlurLength() {
+    return ceil(NUM_SAMPLES / BlurScale());
+}
+
+int SampleCount(const float coc) {
+    if (sample_density <= 0.0f) {
+        return (int)BlurLength();
+    }
+    return (int)clamp(ceil(coc * BlurLength() * sample_density), 1.0f, max(round(max_samples), 1.0f));
+}
+
+// CoC, the larger of the far and the near one, and linear depth of the scene under the pixel of the bokeh.
+float2 Guide(const int2 pixel) {
+    const int3 scenePixel = int3(pixel * BlurScale(), 0);
+    const float2 coc = coc_factor * cocTexture.Load(scenePixel).rg;
+    return float2(max(coc.x, coc.y), LinearDepth(screenDepth.Load(scenePixel).r));
+}
+
+// Edge-aware denoise of the stochastic taps of temporal.hlsli, one axis per pass: horizontal, or vertical with
+// DENOISE_VERTICAL. Five taps half a stratum of the blur under the pixel apart, each weighted by how close its CoC and
+// depth are to the pixel's, so the noise is smoothed within the blur but not across depth edges. Pixels whose blur
+// took all its taps are left alone. See BokehDenoiser in bokehCpu.
+float4 main(const PSInput i) : SV_TARGET {
+    const int2 pixel = int2(i.pos.xy);
+    const float4 center = denoiseTexture.Load(int3(pixel, 0));
+    const float2 guide = Guide(pixel);
+    const int taps = max((int)round(stochastic_taps), 1);
+    if (SampleCount(guide.x) <= taps) {
+        return center;
+    }
+
+    uint width, height;
+    denoiseTexture.GetDimensions(width, height);
+#ifdef DENOISE_VERTICAL
+    const int2 axis = int2(0, 1);
+#else
+    const int2 axis = int2(1, 0);
+#endif
+    // four spacings span two strata of guide.x * BlurLength() pixels
+    const float spacing = 0.5f * guide.x * BlurLength() / taps;
+    float4 sum = 0.0f;
+    float weights = 0.0f;
+    [unroll]
+    for (int n = 0; n < 5; ++n) {
+        const int2 tap = clamp(pixel + axis * (int)round((n - 2) * spacing), 0, int2(width, height) - 1);
+        const float2 tapGuide = Guide(tap);
+        const float weight = WEIGHTS[n] * saturate(1.0f - COC_SHARPNESS * abs(tapGuide.x - guide.x))
+                             * saturate(1.0f - DEPTH_SHARPNESS * abs(tapGuide.y - guide.y) / guide.y);
+        sum += weight * denoiseTexture.Load(int3(tap, 0));
+        weights += weight;
+    }
+    // the centre always matches itself, so weights > 0
+    return sum / weights;
+}
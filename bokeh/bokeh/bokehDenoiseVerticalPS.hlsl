@@ -0,0 +1,3 @@
+// Vertical pass of bokehDenoisePS.
+#define DENOISE_VERTICAL
+#include "bokehDenoisePS.hlsl"
@@ -0,0 +1,44 @@
+float bokeh_downscale;
+Texture2D sceneTexture;
+Texture2D cocTexture;
+Texture2D screenDepth;
+
+
+struct PSInput {
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+struct PSOUTPUT {
+    float4 scene : COLOR0;
+    float4 guide : COLOR1;
+};
+
+// Box-filters every scale x scale block of the full resolution scene and its CoC. The guide holds the block's CoC,
+// near field CoC and depth; the reduced blur reads both CoCs from there like from cocTexture, and the bilateral
+// upsample compares the CoC and depth.
+PSOUTPUT main(const PSInput i) : SV_TARGET {
+    uint viewWidth, viewHeight;
+    sceneTexture.GetDimensions(viewWidth, viewHeight);
+
+    const int scale = (int)exp2(round(bokeh_downscale));
+    const int2 origin = int2(i.pos.xy) * scale;
+    const int2 last = int2(viewWidth, viewHeight) - 1;
+
+    float3 color = 0.0f;
+    float2 coc = 0.0f;
+    float depth = 0.0f;
+    for (int y = 0; y < scale; ++y) {
+        for (int x = 0; x < scale; ++x) {
+            const int3 p = int3(min(origin + int2(x, y), last), 0);
+            color += sceneTexture.Load(p).rgb;
+            coc += cocTexture.Load(p).rg;
+            depth += screenDepth.Load(p).r;
+        }
+    }
+
+    PSOUTPUT output;
+    output.scene = float4(color / (scale * scale), 1.0f);
+    output.guide = float4(coc / (scale * scale), depth / (scale * scale), 0.0f);
+    return output;
+}
@@ -0,0 +1,49 @@
+float coc_factor;
+float NUM_SAMPLES;
+float bokeh_downscale;
+float highlight_scatter;
+float highlight_threshold;
+float highlight_min_radius;
+Texture2D sceneTexture;
+Texture2D cocTexture;
+
+
+struct PSInput {
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+struct PSOUTPUT {
+    float4 gather : COLOR0;
+    float4 highlight : COLOR1;
+};
+
+// Full resolution pixels per pixel of the textures being blurred.
+float BlurScale() {
+    return exp2(round(bokeh_downscale));
+}
+
+// Length of the blurs in steps of one CoC.
+float BlurLength() {
+    return ceil(NUM_SAMPLES / BlurScale());
+}
+
+// Splits the scene for the blur passes and the sprites of bokehSpriteGS, like HighlightScatter::Extract in bokehCpu.
+// Pixels brighter than highlight_threshold whose blur reaches highlight_min_radius full resolution pixels are
+// clamped to the threshold for the gather; the rest of their colour is drawn as an aperture sprite of their CoC,
+// which stays in alpha.
+PSOUTPUT main(const PSInput i) {
+    const float3 color = sceneTexture.Load(int3(i.pos.xy, 0)).rgb;
+    const float coc = coc_factor * cocTexture.Load(int3(i.pos.xy, 0)).r;
+    const float luminance = dot(color, float3(0.2126f, 0.7152f, 0.0722f));
+
+    PSOUTPUT output;
+    output.gather = float4(color, 1.0f);
+    output.highlight = 0.0f;
+    if (highlight_scatter > 0.5f && luminance > highlight_threshold && coc > 0.0f
+        && coc * BlurLength() * BlurScale() >= highlight_min_radius) {
+        output.gather.rgb = color * (max(highlight_threshold, 0.0f) / luminance);
+        output.highlight = float4(color - output.gather.rgb, coc);
+    }
+    return output;
+}
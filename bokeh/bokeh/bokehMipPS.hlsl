@@ -0,0 +1,37 @@
+// Side of the square whose box blur stands in for a hexagon of circumradius 1; about 1.6 keeps the area the same.
+static const float MIP_FOOTPRINT = 1.6f;
+
+float coc_factor;
+float NUM_SAMPLES;
+float bokeh_downscale;
+sampler blurSampler;
+// mip chain of the scene, generated at the start of the pass
+Texture2D sceneTexture;
+Texture2D cocTexture;
+
+
+struct PSInput {
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+// Full resolution pixels per pixel of the textures being blurred.
+float BlurScale() {
+    return exp2(round(bokeh_downscale));
+}
+
+// Length of the blurs in steps of one CoC.
+float BlurLength() {
+    return ceil(NUM_SAMPLES / BlurScale());
+}
+
+// Cheap fallback for both blur passes: a texel of mip level n averages 2^n x 2^n pixels, so the level whose texels
+// are as wide as the blur stands in for the aperture. The trilinear sampler blends the two levels around it, which
+// keeps the blur continuous in the CoC. The shape is square-ish and the near field does not spread over what lies
+// behind it.
+float4 main(const PSInput i) : SV_TARGET {
+    const float coc = coc_factor * cocTexture.Sample(blurSampler, i.tex).r;
+    const float width = MIP_FOOTPRINT * coc * BlurLength();
+    const float lod = log2(max(width, 1.0f));
+    return float4(sceneTexture.SampleLevel(blurSampler, i.tex, lod).rgb, 0.0f);
+}
@@ -0,0 +1,10 @@
+// Vertex of a highlight sprite, from bokehSpriteGS to bokehSpritePS.
+struct SpriteVertex {
+    float4 pos : SV_POSITION;
+    // position within the sprite in circumradii, y pointing down like texture coordinates
+    float2 local : TEXCOORD0;
+    // circumradius in window pixels
+    nointerpolation float radius : TEXCOORD1;
+    // colour of every covered pixel
+    nointerpolation float3 color : COLOR0;
+};
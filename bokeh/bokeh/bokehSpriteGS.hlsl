@@ -0,0 +1,54 @@
+float NUM_SAMPLES;
+float bokeh_downscale;
+Texture2D highlightTexture;
+
+#include "aperture.hlsli"
+#include "bokehSprite.hlsli"
+
+
+struct GSInput {
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+// Full resolution pixels per pixel of the textures being blurred.
+float BlurScale() {
+    return exp2(round(bokeh_downscale));
+}
+
+// Length of the blurs in steps of one CoC.
+float BlurLength() {
+    return ceil(NUM_SAMPLES / BlurScale());
+}
+
+// Turns the highlights of bokehHighlightsPS into quads around their aperture polygon. Every other texel emits
+// nothing, so only the few highlights are rasterized; the stream output does the compaction HighlightScatter does
+// with a prefix scan.
+[maxvertexcount(4)]
+void main(point GSInput input[1], inout TriangleStream<SpriteVertex> stream) {
+    uint width, height;
+    highlightTexture.GetDimensions(width, height);
+    const float4 highlight = highlightTexture.Load(int3(input[0].tex * float2(width, height), 0));
+    if (highlight.a == 0.0f) {
+        return;
+    }
+
+    // Circumradius in texels of the highlight texture, the same as the blur length of the gather. The colour of the
+    // texel is spread evenly over the polygon, whose area does not change when it is drawn at full resolution.
+    const float radius = highlight.a * BlurLength();
+    // Sides() triangles from the centre to a side, each half a side times the apothem
+    const float area = 0.5f * Sides() * SideLength() * Apothem() * radius * radius;
+
+    SpriteVertex output;
+    output.radius = radius * BlurScale();
+    output.color = highlight.rgb / max(area, 1.0f);
+    // one texel of margin for the antialiased sides
+    const float extent = (radius + 1.0f) / radius;
+    const float2 toClip = 2.0f * radius / float2(width, height) * float2(1.0f, -1.0f);
+    [unroll]
+    for (int k = 0; k < 4; ++k) {
+        output.local = extent * float2(k % 2 * 2 - 1, k / 2 * 2 - 1);
+        output.pos = input[0].pos + float4(output.local * toClip, 0.0f, 0.0f);
+        stream.Append(output);
+    }
+}
@@ -0,0 +1,16 @@
+#include "aperture.hlsli"
+#include "bokehSprite.hlsli"
+
+
+// Coverage of the aperture polygon, added to the frame. The polygon is the intersection of the half planes within one
+// apothem of the centre along the normal of every side, as in Aperture::Contains.
+float4 main(const SpriteVertex i) : SV_TARGET {
+    const float apothem = Apothem();
+    float outside = -1.0f;
+    for (int k = 0; k < Sides(); ++k) {
+        outside = max(outside, dot(Normal(k), i.local) - apothem);
+    }
+    // distance past the nearest side in pixels
+    const float coverage = saturate(0.5f - outside * i.radius);
+    return float4(i.color * coverage, 0.0f);
+}
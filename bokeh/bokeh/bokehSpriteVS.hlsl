@@ -0,0 +1,12 @@
+struct VSOutput {
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+// One point per texel of highlightTexture, expanded into a sprite by bokehSpriteGS.
+VSOutput main(float2 tex : TEXCOORD0) {
+    VSOutput o;
+    o.pos = float4(tex.x * 2.0f - 1.0f, 1.0f - tex.y * 2.0f, 0.0f, 1.0f);
+    o.tex = tex;
+    return o;
+}
@@ -0,0 +1,62 @@
+#include "cocLut.hlsli"
+
+// How fast the history weight falls off with the CoC and the relative depth difference between this frame and the
+// history texel it reprojects to; a difference of 1 / SHARPNESS rejects the history.
+static const float COC_SHARPNESS = 8.0f;
+static const float DEPTH_SHARPNESS = 16.0f;
+
+float coc_factor;
+float bokeh_downscale;
+float temporal_frames;
+float temporal_blend;
+matrix viewProjInvMtx;
+matrix prevViewProjMtx;
+sampler blurSampler;
+Texture2D currentBokehTexture;
+Texture2D historyTexture;
+Texture2D historyGuideTexture;
+Texture2D screenDepth;
+Texture2D cocTexture;
+
+
+struct PSInput {
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+struct PSOUTPUT {
+    float4 color : COLOR0;
+    float4 history : COLOR1;
+    float4 guide : COLOR2;
+};
+
+// Accumulates the bokeh of the tap subsets of temporal.hlsli over frames. The history is reprojected with the view
+// and projection of the previous frame and dropped where it saw another depth or CoC, i.e. where the point was
+// hidden or the lens changed. Writes the result, the next history and the depth and CoC it was taken at.
+PSOUTPUT main(const PSInput i) : SV_TARGET {
+    const float4 current = currentBokehTexture.Load(int3(i.pos.xy, 0));
+    const int3 pixel = int3(i.pos.xy * exp2(round(bokeh_downscale)), 0);
+    const float z = screenDepth.Load(pixel).r;
+    const float depth = LinearDepth(z);
+    const float coc = coc_factor * cocTexture.Load(pixel).r;
+
+    // where the point seen through the pixel was on screen in the previous frame
+    const float4 world = mul(viewProjInvMtx, float4(i.tex.x * 2.0f - 1.0f, 1.0f - i.tex.y * 2.0f, z, 1.0f));
+    const float4 previous = mul(prevViewProjMtx, float4(world.xyz / world.w, 1.0f));
+    const float2 uv = float2(0.5f + 0.5f * previous.x / previous.w, 0.5f - 0.5f * previous.y / previous.w);
+
+    PSOUTPUT output;
+    output.color = current;
+    if (temporal_frames > 1.5f && all(saturate(uv) == uv)) {
+        uint width, height;
+        historyGuideTexture.GetDimensions(width, height);
+        const float2 guide = historyGuideTexture.Load(int3(uv * float2(width, height), 0)).rg;
+        const float depthMatch = saturate(1.0f - DEPTH_SHARPNESS * abs(guide.x - depth) / depth);
+        const float cocMatch = saturate(1.0f - COC_SHARPNESS * abs(guide.y - coc));
+        const float4 history = historyTexture.SampleLevel(blurSampler, uv, 0);
+        output.color = lerp(current, history, (1.0f - temporal_blend) * depthMatch * cocMatch);
+    }
+    output.history = output.color;
+    output.guide = float4(depth, coc, 0.0f, 0.0f);
+    return output;
+}
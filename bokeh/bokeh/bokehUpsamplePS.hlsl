@@ -0,0 +1,66 @@
+// How fast the upsample weights fall off with CoC and depth differences between a pixel and the reduced texels.
+static const float COC_SHARPNESS = 16.0f;
+static const float DEPTH_SHARPNESS = 256.0f;
+// Must match COC_TILE_SIZE in BokehDemo.cpp.
+static const int TILE_SIZE = 16;
+
+float coc_factor;
+float NUM_SAMPLES;
+float bokeh_downscale;
+Texture2D sceneTexture;
+Texture2D cocTexture;
+Texture2D screenDepth;
+Texture2D lowResBokehTexture;
+Texture2D lowResGuideTexture;
+Texture2D cocTileTexture;
+
+
+struct PSInput {
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+// Recombines the reduced resolution bokeh with the sharp scene. The four reduced texels around the pixel are
+// weighted bilinearly and by how close their CoC and depth are to the pixel's, so blur does not leak across edges.
+float4 main(const PSInput i) : SV_TARGET {
+    const float3 scene = sceneTexture.Load(int3(i.pos.xy, 0)).rgb;
+    const float coc = cocTexture.Load(int3(i.pos.xy, 0)).r;
+    // no near field can spread over the pixel either
+    if (coc == 0.0f && cocTileTexture.Load(int3(int2(i.pos.xy) / TILE_SIZE, 0)).w == 0.0f) {
+        return float4(scene, 1.0f);
+    }
+    const float depth = screenDepth.Load(int3(i.pos.xy, 0)).r;
+
+    uint lowWidth, lowHeight;
+    lowResBokehTexture.GetDimensions(lowWidth, lowHeight);
+    const float2 texel = i.tex * float2(lowWidth, lowHeight) - 0.5f;
+    const int2 base = int2(floor(texel));
+    const float2 f = texel - base;
+    const int2 last = int2(lowWidth, lowHeight) - 1;
+
+    float3 color = 0.0f;
+    float weightSum = 0.0f;
+    float3 bilinear = 0.0f;
+    float coverage = 0.0f;
+    for (int y = 0; y < 2; ++y) {
+        for (int x = 0; x < 2; ++x) {
+            const int3 p = int3(clamp(base + int2(x, y), 0, last), 0);
+            const float w = (x ? f.x : 1.0f - f.x) * (y ? f.y : 1.0f - f.y);
+            // CoC and depth of the reduced texel
+            const float2 guide = lowResGuideTexture.Load(p).xz;
+            const float similarity = exp(-abs(guide.x - coc) * COC_SHARPNESS - abs(guide.y - depth) * DEPTH_SHARPNESS);
+            const float4 texelColor = lowResBokehTexture.Load(p);
+            color += texelColor.rgb * w * similarity;
+            weightSum += w * similarity;
+            bilinear += texelColor.rgb * w;
+            coverage += texelColor.a * w;
+        }
+    }
+    // No reduced texel resembles the pixel, e.g. on thin features lost by the downsample.
+    color = weightSum > 1e-4f ? color / weightSum : bilinear;
+
+    // A blur shorter than one reduced pixel only loses detail at reduced resolution, so fade to the sharp scene,
+    // except under the near field.
+    const float blend = max(saturate(coc_factor * coc * NUM_SAMPLES / exp2(round(bokeh_downscale))), coverage);
+    return float4(lerp(scene, color, blend), 1.0f);
+}
@@ -0,0 +1,19 @@
+// Thin-lens CoC, evaluated for the whole frame by cocPS. The table is baked by CocLut (bokehCpu/thinLens.h) over linear
+// depth from nearZ to farZ whenever the lens or the view changes.
+float nearZ;
+float farZ;
+sampler cocLutSampler;
+Texture2D cocLutTexture;
+
+// Distance along the view axis of a fragment with depth buffer value z.
+float LinearDepth(const float z) {
+    return nearZ * farZ / (farZ - z * (farZ - nearZ));
+}
+
+float DepthToCoc(const float z) {
+    uint size, height;
+    cocLutTexture.GetDimensions(size, height);
+    // entries sit at texel centres, the first at nearZ and the last at farZ
+    const float t = saturate((LinearDepth(z) - nearZ) / (farZ - nearZ));
+    return cocLutTexture.SampleLevel(cocLutSampler, float2((t * (size - 1) + 0.5f) / size, 0.5f), 0).r;
+}
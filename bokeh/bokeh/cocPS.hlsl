@@ -0,0 +1,21 @@
+#include "cocLut.hlsli"
+
+float focus_distance;
+float near_field;
+Texture2D screenDepth;
+
+
+struct PSInput {
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+// CoC of every pixel from the depth buffer, so the material shaders only output colour. Pixels no geometry covered
+// keep the cleared depth of 1 and get the CoC of the far plane, like the environment.
+// x: CoC, y: the same CoC in front of the focus plane, where it spreads as the near field, and 0 behind it.
+float4 main(const PSInput i) : SV_TARGET {
+    const float depth = screenDepth.Load(int3(i.pos.xy, 0)).r;
+    const float coc = DepthToCoc(depth);
+    const bool near = near_field > 0.5f && LinearDepth(depth) < focus_distance;
+    return float4(coc, near ? coc : 0.0f, 0.0f, 0.0f);
+}
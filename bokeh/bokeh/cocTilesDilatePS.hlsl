@@ -0,0 +1,46 @@
+// Must match COC_TILE_SIZE in BokehDemo.cpp.
+static const int TILE_SIZE = 16;
+
+float coc_factor;
+float NUM_SAMPLES;
+float bokeh_downscale;
+Texture2D cocRangeTexture;
+
+
+struct PSInput {
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+// Classifies a tile for the bokeh passes: x, y = CoC range of all tiles the blurs of this tile can reach,
+// z = largest CoC inside the tile itself, w = largest near field CoC among the same tiles. z == 0 means the tile is
+// in focus, x == y that all taps share one CoC, w > 0 that a blurred foreground may spread over it.
+float4 main(const PSInput i) : SV_TARGET {
+    uint tilesX, tilesY;
+    cocRangeTexture.GetDimensions(tilesX, tilesY);
+
+    // The scene CoC is at most 1, so however many taps a blur takes they stay within coc_factor * n pixels of the
+    // blurred texture and the bilinear footprint of the last one reaches one pixel further. Those pixels span scale
+    // full resolution pixels.
+    const float scale = exp2(round(bokeh_downscale));
+    const float reach = scale * (coc_factor * ceil(NUM_SAMPLES / scale) + 1.0f);
+    const int radius = (int)ceil(reach / TILE_SIZE);
+
+    const int2 tile = int2(i.pos.xy);
+    const int2 first = max(tile - radius, 0);
+    const int2 last = min(tile + radius, int2(tilesX, tilesY) - 1);
+
+    float minCoc = 3.402823466e+38f;
+    float maxCoc = 0.0f;
+    float maxNearCoc = 0.0f;
+    for (int y = first.y; y <= last.y; ++y) {
+        for (int x = first.x; x <= last.x; ++x) {
+            const float3 range = cocRangeTexture.Load(int3(x, y, 0)).xyz;
+            minCoc = min(minCoc, range.x);
+            maxCoc = max(maxCoc, range.y);
+            maxNearCoc = max(maxNearCoc, range.z);
+        }
+    }
+
+    return float4(minCoc, maxCoc, cocRangeTexture.Load(int3(tile, 0)).y, maxNearCoc);
+}
@@ -0,0 +1,35 @@
+// Must match COC_TILE_SIZE in BokehDemo.cpp.
+static const int TILE_SIZE = 16;
+
+float coc_factor;
+Texture2D cocTexture;
+
+
+struct PSInput {
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+// One output texel per TILE_SIZE x TILE_SIZE tile of the scene: x = smallest CoC, y = largest CoC,
+// z = largest near field CoC.
+float4 main(const PSInput i) : SV_TARGET {
+    uint viewWidth, viewHeight;
+    cocTexture.GetDimensions(viewWidth, viewHeight);
+
+    const int2 origin = int2(i.pos.xy) * TILE_SIZE;
+    const int2 end = min(origin + TILE_SIZE, int2(viewWidth, viewHeight));
+
+    float minCoc = 3.402823466e+38f;
+    float maxCoc = 0.0f;
+    float maxNearCoc = 0.0f;
+    for (int y = origin.y; y < end.y; ++y) {
+        for (int x = origin.x; x < end.x; ++x) {
+            const float2 coc = coc_factor * cocTexture.Load(int3(x, y, 0)).rg;
+            minCoc = min(minCoc, coc.x);
+            maxCoc = max(maxCoc, coc.x);
+            maxNearCoc = max(maxNearCoc, coc.y);
+        }
+    }
+
+    return float4(minCoc, maxCoc, maxNearCoc, 0.0f);
+}
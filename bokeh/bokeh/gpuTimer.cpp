@@ -0,0 +1,75 @@
+#include "gpuTimer.h"
+#include "exceptions.h"
+
+using namespace std;
+using namespace mini;
+using namespace gk2;
+using namespace directx;
+
+class GpuTimer::MarkEffect final: public EffectComponent {
+public:
+    MarkEffect(GpuTimer& timer, const bool start) : m_timer(&timer), m_start(start) {}
+
+    void Begin(const dx_ptr<ID3D11DeviceContext>& context) const override {
+        m_timer->_mark(context, m_start);
+    }
+
+private:
+    GpuTimer* m_timer;
+    bool m_start;
+};
+
+GpuTimer::GpuTimer(const DxDevice& device) {
+    const auto create = [&](const D3D11_QUERY type) {
+        const D3D11_QUERY_DESC desc{type, 0};
+        ID3D11Query* query = nullptr;
+        const auto hr = device->CreateQuery(&desc, &query);
+        if (FAILED(hr))
+            throw utils::winapi_error{hr};
+        return dx_ptr<ID3D11Query>{query};
+    };
+    for (auto& queries : m_queries) {
+        queries.disjoint = create(D3D11_QUERY_TIMESTAMP_DISJOINT);
+        queries.start = create(D3D11_QUERY_TIMESTAMP);
+        queries.stop = create(D3D11_QUERY_TIMESTAMP);
+    }
+}
+
+unique_ptr<EffectComponent> GpuTimer::StartEffect() {
+    return make_unique<MarkEffect>(*this, true);
+}
+
+unique_ptr<EffectComponent> GpuTimer::StopEffect() {
+    return make_unique<MarkEffect>(*this, false);
+}
+
+void GpuTimer::_mark(const dx_ptr<ID3D11DeviceContext>& context, const bool start) {
+    auto& queries = m_queries[m_slot];
+    if (start) {
+        context->Begin(queries.disjoint.get());
+        context->End(queries.start.get());
+        queries.started = true;
+    } else if (queries.started) {
+        context->End(queries.stop.get());
+        context->End(queries.disjoint.get());
+        queries.stopped = true;
+    }
+}
+
+optional<float> GpuTimer::NextFrame(const dx_ptr<ID3D11DeviceContext>& context) {
+    m_slot = (m_slot + 1) % Latency;
+    auto& queries = m_queries[m_slot];
+    const auto finished = queries.started && queries.stopped;
+    queries.started = queries.stopped = false;
+    if (!finished)
+        return nullopt;
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+    UINT64 start, stop;
+    // S_FALSE while the GPU is still on it; the frame is dropped rather than waited for
+    if (context->GetData(queries.disjoint.get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+        context->GetData(queries.start.get(), &start, sizeof(start), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+        context->GetData(queries.stop.get(), &stop, sizeof(stop), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+        disjoint.Disjoint)
+        return nullopt;
+    return static_cast<float>(static_cast<double>(stop - start) * 1000.0 / static_cast<double>(disjoint.Frequency));
+}
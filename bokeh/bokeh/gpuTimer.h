@@ -0,0 +1,50 @@
+#pragma once
+#include "dxDevice.h"
+#include "effect.h"
+#include <array>
+#include <memory>
+#include <optional>
+
+namespace mini::gk2 {
+    //GPU time between two points of the frame from D3D11 timestamp queries. Every frame issues its own set of
+    //queries, which is read Latency frames later without waiting for the GPU, so timing never stalls the pipeline.
+    class GpuTimer {
+    public:
+        static constexpr size_t Latency = 3;
+
+        explicit GpuTimer(const DxDevice& device);
+
+        GpuTimer(const GpuTimer&) = delete;
+
+        GpuTimer& operator=(const GpuTimer&) = delete;
+
+        //Effects marking the start and the end of the measured passes, for the first pass timed and the pass after
+        //the last. Both have to run in every frame; the timer has to outlive them.
+        [[nodiscard]] std::unique_ptr<EffectComponent> StartEffect();
+
+        [[nodiscard]] std::unique_ptr<EffectComponent> StopEffect();
+
+        //Moves on to the queries of the next frame, which were issued Latency frames ago, and returns the
+        //milliseconds they measured. Empty while the GPU has not finished them or the clock was disjoint.
+        std::optional<float> NextFrame(const directx::dx_ptr<ID3D11DeviceContext>& context);
+
+        //Queries of the current frame, to label its measurement.
+        [[nodiscard]] size_t slot() const noexcept { return m_slot; }
+
+    private:
+        class MarkEffect;
+
+        struct Queries {
+            directx::dx_ptr<ID3D11Query> disjoint;
+            directx::dx_ptr<ID3D11Query> start;
+            directx::dx_ptr<ID3D11Query> stop;
+            bool started = false;
+            bool stopped = false;
+        };
+
+        void _mark(const directx::dx_ptr<ID3D11DeviceContext>& context, bool start);
+
+        std::array<Queries, Latency> m_queries;
+        size_t m_slot = 0;
+    };
+}
@@ -3,6 +3,7 @@
 #include <D3DCompiler.h>
 #include "spriteRenderer.h"
 #include "inputLayoutManager.h"
+#include <algorithm>
 
 using namespace std;
 using namespace DirectX;
@@ -18,6 +19,9 @@ void RenderPass::_initShaders(const DxDevice& device, const CBVariableManager& v
     const auto psCode = DxDevice::LoadByteCode(psShader);
     auto ps = device.CreatePixelShader(psCode);
     AddEffect(make_unique<BasicEffect>(move(vs), move(ps)));
+    // no geometry shader or blending unless the pass adds them, whatever the previous pass left bound
+    AddEffect(make_unique<GeometryShaderComponent>());
+    AddEffect(make_unique<BlendStateEffect>());
     D3D11_SHADER_DESC desc;
     const auto vsRefl = _reflectShader(vsCode, desc);
     _addShaderConstantBuffers<VSConstantBuffers>(device, vsRefl, desc);
@@ -36,6 +40,7 @@ void RenderPass::_initShaders(const DxDevice& device, const CBVariableManager& v
     D3D11_SHADER_DESC desc;
     const auto gsRefl = _reflectShader(gsCode, desc);
     _addShaderConstantBuffers<GSConstantBuffers>(device, gsRefl, desc);
+    _addShaderTextures<GSShaderResources>(variables, gsRefl, desc);
 }
 
 RenderPass::RenderPass(const DxDevice& device, const CBVariableManager& variables, InputLayoutManager* layouts,
@@ -45,7 +50,7 @@ RenderPass::RenderPass(const DxDevice& device, const CBVariableManager& variable
 
 RenderPass::RenderPass(const DxDevice& device, const CBVariableManager& variables, InputLayoutManager* layouts,
                        const wstring& vsShader, const wstring& gsShader, const wstring& psShader) : m_layouts(layouts) {
-    _initShaders(device, variables, vsShader, psShader);
+    _initShaders(device, variables, vsShader, gsShader, psShader);
 }
 
 void RenderPass::_addRenderTarget(const RenderTargetsEffect& renderTarget, const bool clearRenderTarget) {
@@ -78,7 +83,22 @@ void RenderPass::AddEffect(std::unique_ptr<EffectComponent>&& effect) {
     m_effect.m_components.push_back(move(effect));
 }
 
+void RenderPass::SetTexture(const string& shaderName, const dx_ptr<ID3D11ShaderResourceView>& texture) {
+    auto found = false;
+    for (const auto& [textures, names] : m_textures) {
+        const auto it = find(names.begin(), names.end(), shaderName);
+        if (it == names.end())
+            continue;
+        textures->SetResource(static_cast<UINT>(it - names.begin()), texture);
+        found = true;
+    }
+    if (!found)
+        throw utils::custom_error{L"No shader of the pass has such texture"};
+}
+
 void RenderPass::Execute(const dx_ptr<ID3D11DeviceContext>& context, CBVariableManager& manager) {
+    if (m_condition && !m_condition())
+        return;
     m_effect.Begin(context);
     for (const auto model : m_models) {
         const auto itEnd = model->end();
@@ -4,6 +4,7 @@
 #include "cbVariableManager.h"
 #include "dxDevice.h"
 #include "exceptions.h"
+#include <functional>
 #include <type_traits>
 
 typedef struct _D3D11_SHADER_DESC D3D11_SHADER_DESC;
@@ -111,6 +112,13 @@ namespace mini {
                 AddEffect(std::make_unique<T>(std::forward<TArgs>(args)...));
             }
 
+            //Rebinds the texture declared as shaderName in any shader of the pass, e.g. to run the same shaders on other
+            //inputs.
+            void SetTexture(const std::string& shaderName, const dx_ptr<ID3D11ShaderResourceView>& texture);
+
+            //The pass is skipped in frames for which condition returns false.
+            void SetCondition(std::function<bool()> condition) { m_condition = std::move(condition); }
+
             void Execute(const dx_ptr<ID3D11DeviceContext>& context, CBVariableManager& manager);
 
         private:
@@ -170,6 +178,7 @@ namespace mini {
                     for (size_t i = 0; i < textureNames.size(); ++i)
                         if (!textureNames[i].empty())
                             uptr->SetResource(static_cast<UINT>(i), variables.GetTexture(textureNames[i]));
+                    m_textures.emplace_back(uptr.get(), textureNames);
                     m_effect.m_components.push_back(std::move(uptr));
                 }
             }
@@ -178,6 +187,9 @@ namespace mini {
             InputLayoutManager* m_layouts;
             std::vector<const Model*> m_models;
             std::vector<ICBVariablesEffect*> m_cbuffers;
+            //Textures of every shader stage with the names the shader declares them with.
+            std::vector<std::pair<ShaderResourceSet*, std::vector<std::string>>> m_textures;
+            std::function<bool()> m_condition;
             size_t m_vsSignatureID;
         };
     }
@@ -18,7 +18,8 @@ float4 phong(const float3 worldPos, float3 norm, float3 view) {
         color += lightColor[k] * kd * surfaceColor * saturate(dot(norm, lightVec)); //diffuse
         color += lightColor[k] * ks * pow(saturate(dot(norm, halfVec)), m);         //specular
     }
-    return saturate(float4(color, 1.0f));
+    // unclamped, so the specular highlights stay HDR
+    return float4(max(color, 0.0f), 1.0f);
 }
 
 struct PSInput {
@@ -28,14 +29,7 @@ struct PSInput {
     float3 view : VIEWVEC0;
 };
 
-float zToCoc(const float z) {
-    if (z < 0.5) {
-        return 0.0;
-    }
-    return pow(z, 4);
-}
-
 float4 main(PSInput i) : SV_TARGET {
     const float3 color = phong(i.worldPos, i.norm, i.view).rgb;
-    return float4(color, zToCoc(i.pos.z));
+    return float4(color, 1.0f);
 }
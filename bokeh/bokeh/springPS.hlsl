@@ -48,13 +48,6 @@ float fresnel(const float3 N, const float3 L, const float F0) {
     return F0 + (1 - F0) * pow(1 - dot(N, L), 5);
 }
 
-float zToCoc(const float z) {
-    if (z < 0.5) {
-        return 0.0;
-    }
-    return pow(z, 4);
-}
-
 float4 main(const PSInput i) : SV_TARGET {
     const float3 N1 = normalize(i.norm);
     // const float3 dPdx = ddx(i.worldPos);
@@ -104,7 +97,7 @@ float4 main(const PSInput i) : SV_TARGET {
         color += Li * brdfColor;
     }
 
+    // linear HDR, tonemapped once after the depth of field by tonemapPS
     const float3 finalColor = color + ambient;
-
-    return float4(pow(finalColor / (finalColor + 1), 1 / 2.2), zToCoc(i.pos.z));
+    return float4(finalColor, 1.0f);
 }
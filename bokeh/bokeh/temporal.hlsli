@@ -0,0 +1,84 @@
+// Tap subsets of the blur passes, accumulated over frames by bokehTemporalPS. Over temporal_frames frames a blur takes
+// each of its taps once: every frame takes every TapStride()-th tap, starting from TapPhase().
+float temporal_frames;
+float temporal_frame;
+// With stochastic_taps between 1 and the taps of a blur, the blur takes that many taps instead, one at a jittered point
+// of each of as many equal strata of it, and bokehDenoisePS smooths out the noise. The jitter of a pixel is
+// interleaved gradient noise moved on by the golden ratio every stochastic_frame, so the temporal pass averages it
+// too. See StochasticBlurTexture in bokehCpu.
+float stochastic_taps;
+float stochastic_frame;
+// Must match MaxStochasticRescale in bokehCpu/blurKernel.h.
+static const float MAX_STOCHASTIC_RESCALE = 1.25f;
+
+// Jitter of the stochastic taps of the pixel, see SetTapJitter.
+static float tapJitter = 0.0f;
+
+// The bokeh1PS_<n> and bokeh2PS_<n> permutations define FIXED_SAMPLES: every blur takes n taps, all of them every
+// frame, so the tap loops have constant bounds and are unrolled. The demo picks one when sample_density is 0,
+// temporal_frames is 1 and the blur length is n.
+#ifdef FIXED_SAMPLES
+#define TAP_LOOP [unroll]
+#else
+#define TAP_LOOP
+#endif
+
+// Step between the taps of one frame. Never more than the taps of the blur, so every frame takes at least one.
+int TapStride(const int samples) {
+#ifdef FIXED_SAMPLES
+    return 1;
+#else
+    return clamp((int)round(temporal_frames), 1, max(samples, 1));
+#endif
+}
+
+// First tap of the frame in blur pass 0 or 1. The second pass goes through its phases temporal_frames times slower
+// than the first, so every pair of phases of the two passes comes up.
+int TapPhase(const int samples, const int pass) {
+#ifdef FIXED_SAMPLES
+    return 0;
+#else
+    const int frames = max((int)round(temporal_frames), 1);
+    const int frame = (int)temporal_frame;
+    int phase = frame % frames;
+    if (pass > 0) {
+        phase = (frame + frame / frames) % frames;
+    }
+    return phase % TapStride(samples);
+#endif
+}
+
+// Sets the jitter of the stochastic taps of the pixel at pos in blur pass 0 or 1, as TapJitter in bokehCpu. Every
+// pass calls it first.
+void SetTapJitter(const float2 pos, const int pass) {
+    const float2 p = pos + float2(17.0f, 29.0f) * pass;
+    const float noise = 52.9829189f * frac(dot(p, float2(0.06711056f, 0.00583715f)));
+    tapJitter = frac(noise + 0.61803399f * stochastic_frame);
+}
+
+// Whether the blur of samples taps takes the stochastic ones instead.
+bool StochasticTaps(const int samples) {
+#ifdef FIXED_SAMPLES
+    return false;
+#else
+    return stochastic_taps >= 0.5f && round(stochastic_taps) < samples;
+#endif
+}
+
+// Taps of the frame out of samples.
+int TapCount(const int samples, const int pass) {
+    if (StochasticTaps(samples)) {
+        return (int)round(stochastic_taps);
+    }
+    const int stride = TapStride(samples);
+    return (samples - TapPhase(samples, pass) + stride - 1) / stride;
+}
+
+// Offset along the blur, in steps after its first half step, of tap n of the frame out of samples: every
+// TapStride()-th from TapPhase(), or one in each stratum of the stochastic taps.
+float TapOffset(const int n, const int samples, const int pass) {
+    if (StochasticTaps(samples)) {
+        return (n + tapJitter) * samples / round(stochastic_taps) - 0.5f;
+    }
+    return TapPhase(samples, pass) + n * TapStride(samples);
+}
@@ -0,0 +1,15 @@
+// The finished frame in linear HDR: the blurred scene and the highlight sprites.
+Texture2D hdrTexture;
+
+
+struct PSInput {
+    float4 pos : SV_POSITION;
+    float2 tex : TEXCOORD0;
+};
+
+// Reinhard and gamma, once per pixel of the window. Materials and the depth of field all work on linear colour, so
+// highlights keep their energy through the blurs instead of being compressed before them.
+float4 main(const PSInput i) : SV_TARGET {
+    const float3 color = max(hdrTexture.Load(int3(i.pos.xy, 0)).rgb, 0.0f);
+    return float4(pow(color / (color + 1.0f), 1.0f / 2.2f), 1.0f);
+}
@@ -0,0 +1,226 @@
+#include "benchmark.h"
+#include "framePipeline.h"
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    void printUsage() {
+        cerr << "usage: bokehCli [options] <colour> <depth> <output> <first> <last>\n"
+                "       bokehCli --bench <results.json> [--golden <dir> [--record-golden]] [--repeats <n>] [--quick]\n"
+                "                [--baseline <results.json> [--tolerance <fraction>]] [--threads <n>]\n"
+                "  <colour>, <depth> and <output> name the files of every frame, with %d or %0Nd standing for the\n"
+                "  frame number, e.g. shot/beauty.%04d.pfm. Colour is .pfm (linear) or .ppm (gamma 2.2), depth\n"
+                "  .pfm (distance) or .pgm (16 bits from --near to --far), output .pfm or .ppm.\n"
+                "options:\n"
+                "  --focal-length <mm>     85\n"
+                "  --f-stop <N>            2\n"
+                "  --focus-distance <m>    5\n"
+                "  --sensor-width <mm>     36\n"
+                "  --near <m>, --far <m>   0.1, 100; range of the CoC table and of .pgm depth\n"
+                "  --samples <n>           16, taps of the longest blur\n"
+                "  --sides <n>             6, sides of the aperture polygon, 5 to 10; other than 6 only without\n"
+                "                          --prefix-sum and --stochastic\n"
+                "  --near-field            blur the foreground over what lies behind it\n"
+                "  --highlights            draw highlights as aperture sprites\n"
+                "  --prefix-sum            box blurs whose cost does not depend on the CoC\n"
+                "  --fft                   final quality: CoC layers convolved with the aperture through FFTs\n"
+                "  --layers <n>            8, CoC layers on each side of the focus with --fft\n"
+                "  --slices <n>            cut the depth into n slices, blur each with one CoC and composite them\n"
+                "  --stochastic <n>        preview: n jittered taps per blur, then an edge-aware denoise\n"
+                "  --aperture <file>       greyscale .pfm or .pgm picture of the aperture for --fft\n"
+                "  --threads <n>           0, blur threads; 0 - all hardware threads\n"
+                "  --queue <n>             4, frames in flight between read, blur and write\n"
+                "benchmark:\n"
+                "  --bench <file>          run every implementation on built-in scenes, compare it with the\n"
+                "                          brute-force reference and write the PSNRs, errors and Mpix/s as JSON;\n"
+                "                          fails when a result is outside its bounds\n"
+                "  --golden <dir>          also compare with the outputs stored there; fails when one is missing\n"
+                "  --record-golden         write the outputs to the --golden directory instead\n"
+                "  --repeats <n>           3, timed runs of every case\n"
+                "  --baseline <file>       results of an earlier --bench on this machine; fails when a case runs\n"
+                "                          more than --tolerance slower in Mpix/s than there\n"
+                "  --tolerance <fraction>  0.2, slowdown against --baseline that still passes\n"
+                "  --quick                 the cases of the golden set: 160x90 and 123x69, 8, 16 and 32 samples,\n"
+                "                          angles 0 and 0.5, varied one at a time\n";
+    }
+
+    //Replaces the first %d or %0Nd of pattern with frame.
+    string framePath(const string& pattern, const long frame) {
+        const auto start = pattern.find('%');
+        if (start == string::npos)
+            throw invalid_argument("no frame number in " + pattern);
+        auto end = start + 1;
+        size_t width = 0;
+        if (end < pattern.size() && pattern[end] == '0')
+            ++end;
+        while (end < pattern.size() && isdigit(static_cast<unsigned char>(pattern[end])))
+            width = width * 10 + (pattern[end++] - '0');
+        if (end >= pattern.size() || pattern[end] != 'd')
+            throw invalid_argument("expected %d or %0Nd in " + pattern);
+        auto number = to_string(frame);
+        if (number.size() < width)
+            number.insert(0, width - number.size(), '0');
+        return pattern.substr(0, start) + number + pattern.substr(end + 1);
+    }
+
+    int runBenchmark(const string& path, BenchSettings settings, const bool quick, const unsigned threads) {
+        if (quick) {
+            settings.cases = QuickBenchSettings().cases;
+        }
+        ofstream out(path);
+        if (!out)
+            throw runtime_error("cannot write " + path);
+        const auto golden = !settings.goldenDirectory.empty() && !settings.recordGolden;
+        Benchmark benchmark(std::move(settings), threads);
+        benchmark.Run([golden](const BenchResult& result) {
+            char baselineText[40] = "";
+            if (!isnan(result.baselineMegapixelsPerSecond))
+                snprintf(baselineText, sizeof(baselineText), "  baseline %8.2f Mpix/s",
+                         result.baselineMegapixelsPerSecond);
+            if (!isnan(result.budgetMilliseconds)) {
+                printf("%-10s %4zux%-4zu %-28s %8.3f ms %8.2f Mpix/s  %s %g ms budget%s  %s\n",
+                       BenchSceneName(result.scene), result.size.width, result.size.height, result.variant.c_str(),
+                       result.milliseconds, result.megapixelsPerSecond,
+                       result.milliseconds <= result.budgetMilliseconds ? "within" : "over", result.budgetMilliseconds,
+                       baselineText, result.passed ? "ok" : "FAILED");
+                fflush(stdout);
+                return;
+            }
+            char goldenText[32] = "";
+            if (golden && isnan(result.goldenPsnr))
+                snprintf(goldenText, sizeof(goldenText), "  no golden");
+            else if (golden)
+                snprintf(goldenText, sizeof(goldenText), "  golden %6.2f dB", result.goldenPsnr);
+            printf("%-10s %4zux%-4zu %2g taps %.2f rad  %-16s %8.2f ms %8.2f Mpix/s  %6.2f dB %9.2g%s%s  %s\n",
+                   BenchSceneName(result.scene), result.size.width, result.size.height, result.numSamples,
+                   result.angle, result.variant.c_str(), result.milliseconds, result.megapixelsPerSecond, result.psnr,
+                   result.maxError, goldenText, baselineText, result.passed ? "ok" : "FAILED");
+            fflush(stdout);
+        });
+        benchmark.WriteJson(out);
+        return benchmark.passed() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+}
+
+int main(const int argc, char* argv[]) {
+    try {
+        PipelineSettings settings;
+        BenchSettings bench;
+        string benchPath;
+        auto quick = false;
+        vector<string> positional;
+        for (auto i = 1; i < argc; ++i) {
+            const string arg = argv[i];
+            const auto value = [&] {
+                if (i + 1 >= argc)
+                    throw invalid_argument(arg + " needs a value");
+                return stof(argv[++i]);
+            };
+            if (arg == "--focal-length")
+                settings.lens.focalLength = value();
+            else if (arg == "--f-stop")
+                settings.lens.fStop = value();
+            else if (arg == "--focus-distance")
+                settings.lens.focusDistance = value();
+            else if (arg == "--sensor-width")
+                settings.lens.sensorWidth = value();
+            else if (arg == "--near")
+                settings.nearPlane = value();
+            else if (arg == "--far")
+                settings.farPlane = value();
+            else if (arg == "--samples")
+                settings.params.numSamples = value();
+            else if (arg == "--sides")
+                settings.params.sides = static_cast<int>(value());
+            else if (arg == "--near-field")
+                settings.params.separateNearField = true;
+            else if (arg == "--highlights")
+                settings.params.scatterHighlights = true;
+            else if (arg == "--prefix-sum")
+                settings.params.mode = BlurMode::PrefixSum;
+            else if (arg == "--fft")
+                settings.params.mode = BlurMode::Convolution;
+            else if (arg == "--layers")
+                settings.params.convolutionLayers = static_cast<int>(value());
+            else if (arg == "--slices") {
+                settings.params.mode = BlurMode::DepthSlices;
+                settings.params.depthSlices = static_cast<int>(value());
+            } else if (arg == "--stochastic") {
+                settings.params.mode = BlurMode::Stochastic;
+                settings.params.stochasticTaps = static_cast<int>(value());
+            } else if (arg == "--aperture") {
+                if (i + 1 >= argc)
+                    throw invalid_argument(arg + " needs a file");
+                settings.apertureMask = argv[++i];
+            } else if (arg == "--threads")
+                settings.blurThreads = static_cast<unsigned>(value());
+            else if (arg == "--queue")
+                settings.queueDepth = static_cast<size_t>(value());
+            else if (arg == "--bench" || arg == "--golden") {
+                if (i + 1 >= argc)
+                    throw invalid_argument(arg + " needs a path");
+                (arg == "--bench" ? benchPath : bench.goldenDirectory) = argv[++i];
+            } else if (arg == "--repeats")
+                bench.repeats = static_cast<int>(value());
+            else if (arg == "--record-golden")
+                bench.recordGolden = true;
+            else if (arg == "--baseline") {
+                if (i + 1 >= argc)
+                    throw invalid_argument(arg + " needs a file");
+                ifstream in(argv[++i]);
+                if (!in)
+                    throw runtime_error(string("cannot read ") + argv[i]);
+                bench.baseline = ReadBenchJson(in);
+            } else if (arg == "--tolerance")
+                bench.throughputTolerance = value();
+            else if (arg == "--quick")
+                quick = true;
+            else if (arg == "--help" || arg == "-h") {
+                printUsage();
+                return EXIT_SUCCESS;
+            } else if (arg.starts_with("--"))
+                throw invalid_argument("unknown option " + arg);
+            else
+                positional.push_back(arg);
+        }
+        if (!benchPath.empty())
+            return runBenchmark(benchPath, std::move(bench), quick, settings.blurThreads);
+        if (positional.size() != 5) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+
+        const auto first = stol(positional[3]);
+        const auto last = stol(positional[4]);
+        vector<FrameJob> jobs;
+        for (auto frame = first; frame <= last; ++frame)
+            jobs.push_back({framePath(positional[0], frame), framePath(positional[1], frame),
+                            framePath(positional[2], frame)});
+
+        FramePipeline pipeline(settings);
+        const auto stats = pipeline.Run(jobs, [&](const size_t index) {
+            if ((index + 1) % 100 == 0 || index + 1 == jobs.size())
+                cerr << "\r" << index + 1 << "/" << jobs.size() << " frames" << flush;
+        });
+        cerr << "\n";
+        printf("%zu frames in %.2f s, %.2f frames/s\n", stats.frames, stats.seconds, stats.framesPerSecond());
+        printf("busy: read %.2f s, blur %.2f s, write %.2f s\n", stats.readSeconds, stats.blurSeconds,
+               stats.writeSeconds);
+        return EXIT_SUCCESS;
+    } catch (const exception& e) {
+        cerr << "bokehCli: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,123 @@
+#include "aperture.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    constexpr float PI = 3.14159265322f;
+
+    Vec2 direction(const float angle) noexcept {
+        return {cos(angle), sin(angle)};
+    }
+}
+
+void Aperture::Build(const int sides, const float angle) {
+    if (sides < MinSides || sides > MaxSides)
+        throw invalid_argument("Aperture: " + to_string(sides) + " sides, expected " + to_string(MinSides) + " to " +
+                               to_string(MaxSides));
+    const auto n = static_cast<float>(sides);
+    const auto odd = sides % 2 != 0;
+    const auto m = sides / 2 + (odd ? 1 : 0);
+    m_hexagon = {direction(angle + PI / 2), direction(angle - PI / 6), direction(angle - 5 * PI / 6)};
+    m_sideLength = 2.0f * sin(PI / n);
+    m_apothem = cos(PI / n);
+    // side k runs along angle + PI / 2 + 2 PI k / n, its normal points a quarter turn clockwise of that
+    m_normals.resize(sides);
+    for (auto k = 0; k < sides; ++k)
+        m_normals[k] = direction(angle + 2.0f * PI * static_cast<float>(k) / n);
+    m_edges.resize(m);
+    m_edgeLengths.assign(m, m_sideLength);
+    for (int k = 0; k < m; ++k) {
+        // the hexagon's edges point up and along the two diagonals of the default passes
+        m_edges[k] = direction(angle + PI / 2 + 2.0f * PI * static_cast<float>(k) / n);
+    }
+    const auto spanned = [n](const int k, const int j) { return sin(2.0f * PI * static_cast<float>(j - k) / n); };
+    if (odd) {
+        // the area of the sum is a t^2 + b t + c sides squared with the outer edges t sides long
+        auto a = 0.0f, b = 0.0f, c = 0.0f;
+        for (auto k = 0; k < m; ++k)
+            for (auto j = k + 1; j < m; ++j) {
+                const auto outer = (k == 0 ? 1 : 0) + (j == m - 1 ? 1 : 0);
+                (outer == 2 ? a : outer == 1 ? b : c) += spanned(k, j);
+            }
+        const auto area = 0.5f * n * sin(2.0f * PI / n) / (m_sideLength * m_sideLength);
+        const auto t = (sqrt(b * b - 4.0f * a * (c - area)) - b) / (2.0f * a);
+        m_edgeLengths.front() *= t;
+        m_edgeLengths.back() *= t;
+    }
+    Vec2 sum{0.0f, 0.0f};
+    for (int k = 0; k < m; ++k)
+        sum = sum + m_edges[k] * m_edgeLengths[k];
+
+    // Rhombus (k, j) of the zonogon with corner 0 lies at the sum of the edges between k and j; the polygon is
+    // centred on the pixel.
+    m_rhombi.clear();
+    auto totalArea = 0.0f;
+    for (int k = 0; k < m; ++k) {
+        Vec2 base{0.0f, 0.0f};
+        for (auto j = k + 1; j < m; ++j) {
+            const auto area = m_edgeLengths[k] * m_edgeLengths[j] * spanned(k, j);
+            m_rhombi.push_back({k, j, base + sum * -0.5f, area});
+            totalArea += area;
+            base = base + m_edges[j] * m_edgeLengths[j];
+        }
+    }
+    for (auto& rhombus : m_rhombi)
+        rhombus.weight /= totalArea;
+}
+
+bool Aperture::Contains(const Vec2 point) const noexcept {
+    // the opposite sides of an even polygon bound the strips across its edges
+    if (sides() % 2 == 0)
+        return all_of(m_edges.begin(), m_edges.end(), [&](const Vec2 edge) {
+            return fabs(edge.x * point.y - edge.y * point.x) <= m_apothem;
+        });
+    return all_of(m_normals.begin(), m_normals.end(), [&](const Vec2 normal) {
+        return normal.x * point.x + normal.y * point.y <= m_apothem;
+    });
+}
+
+void ApertureTable::Build(const Aperture& aperture) noexcept {
+    const auto& apertureEdges = aperture.edges();
+    const auto& lengths = aperture.edgeLengths();
+    const auto& apertureNormals = aperture.normals();
+    // past the edges and sides of the aperture the shaders never look
+    for (auto k = 0; k < MaxEdges; ++k) {
+        const auto inside = k < static_cast<int>(apertureEdges.size());
+        const auto edge = inside ? apertureEdges[k] : Vec2{0.0f, 0.0f};
+        edges[k][0] = edge.x;
+        edges[k][1] = edge.y;
+        edges[k][2] = inside ? lengths[k] : 0.0f;
+        edges[k][3] = 0.0f;
+    }
+    for (auto k = 0; k < Aperture::MaxSides; ++k) {
+        const auto normal = k < aperture.sides() ? apertureNormals[k] : Vec2{0.0f, 0.0f};
+        normals[k][0] = normal.x;
+        normals[k][1] = normal.y;
+        normals[k][2] = aperture.sideLength();
+        normals[k][3] = aperture.apothem();
+    }
+    for (auto& rhombus : rhombi)
+        rhombus[0] = rhombus[1] = rhombus[2] = rhombus[3] = 0.0f;
+    for (const auto& rhombus : aperture.rhombi()) {
+        auto& entry = rhombi[MaxEdges * rhombus.first + rhombus.second];
+        entry[0] = rhombus.offset.x;
+        entry[1] = rhombus.offset.y;
+        entry[2] = rhombus.weight;
+    }
+}
+
+void ApertureTable::BuildSteps(const size_t width, const size_t height, float (&steps)[MaxEdges][4]) const noexcept {
+    const auto inverseWidth = width > 0 ? 1.0f / static_cast<float>(width) : 0.0f;
+    const auto inverseHeight = height > 0 ? 1.0f / static_cast<float>(height) : 0.0f;
+    for (auto k = 0; k < MaxEdges; ++k) {
+        steps[k][0] = edges[k][0] * inverseWidth;
+        steps[k][1] = edges[k][1] * inverseHeight;
+        steps[k][2] = steps[k][3] = 0.0f;
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "image.h"
+#include <vector>
+
+namespace mini::bokeh {
+    //Blur of a rhombus spanned by two edges of an Aperture: a blur along edge first, then along edge second, starting
+    //offset away from the pixel.
+    struct Rhombus {
+        int first;
+        int second;
+        Vec2 offset;
+        //Share of the polygon's area; the weights of an aperture add up to 1.
+        float weight;
+    };
+
+    //Blur directions of the hexagon passes, in pixels: vertical and diagonal for the first pass, diagonal and
+    //diagonal2 for the second (bokeh1PS, bokeh2PS). For six sides they are edges 0, 1 and 2, the middle one reversed.
+    struct HexagonDirections {
+        Vec2 vertical;
+        Vec2 diagonal;
+        Vec2 diagonal2;
+    };
+
+    //Regular polygonal aperture decomposed into sheared boxes. A regular polygon with 2m sides is the Minkowski sum
+    //of m of its edges, and it is tiled by the m(m - 1)/2 rhombi spanned by pairs of them. Every rhombus is two line
+    //blurs, so any such polygon keeps the two passes of the hexagon; only the number of blurs per pass grows.
+    //Parallelograms only tile centrally symmetric polygons, and no weighting of them adds up to another shape, so a
+    //polygon with 2m + 1 sides is swept approximately: by the Minkowski sum of its first m + 1 edges, the outer two
+    //shortened until it has the polygon's area. That puts 6%, 3% and 2% of the area of 5, 7 and 9 sides outside
+    //the polygon; Contains and the sprites follow the polygon itself. Sizes are for a circumradius of 1 and scale
+    //with the blur length.
+    class Aperture {
+    public:
+        static constexpr int MinSides = 5;
+        //Ten sides stay within 5% of a circle, which doubles as the near-circular aperture.
+        static constexpr int MaxSides = 10;
+        //Edges blurred in the first pass of the largest polygon; nine sides have as many as ten.
+        static constexpr int MaxFirstPassEdges = MaxSides / 2 - 1;
+
+        //Builds the polygon of sides sides, rotated by angle like the angle shader variable. Six give the hexagon
+        //of the default passes, spanned by the same three directions. Throws std::invalid_argument unless sides is
+        //within [MinSides, MaxSides].
+        void Build(int sides, float angle);
+
+        [[nodiscard]] int sides() const noexcept { return static_cast<int>(m_normals.size()); }
+
+        //Unit directions of the edges the blurs sweep. The first pass blurs along all but the last.
+        [[nodiscard]] const std::vector<Vec2>& edges() const noexcept { return m_edges; }
+
+        //Length of every edge the blurs sweep relative to the circumradius: sideLength, but for the outer two of an
+        //odd polygon.
+        [[nodiscard]] const std::vector<float>& edgeLengths() const noexcept { return m_edgeLengths; }
+
+        //Length of a side of the polygon relative to the circumradius.
+        [[nodiscard]] float sideLength() const noexcept { return m_sideLength; }
+
+        //Distance of the sides from the centre relative to the circumradius.
+        [[nodiscard]] float apothem() const noexcept { return m_apothem; }
+
+        //Outward unit normals of the sides.
+        [[nodiscard]] const std::vector<Vec2>& normals() const noexcept { return m_normals; }
+
+        //Of the angle of the last Build, whatever the sides.
+        [[nodiscard]] const HexagonDirections& hexagon() const noexcept { return m_hexagon; }
+
+        [[nodiscard]] const std::vector<Rhombus>& rhombi() const noexcept { return m_rhombi; }
+
+        //Whether point, in circumradii from the centre, lies inside the polygon: within one apothem of the centre
+        //along every normal.
+        [[nodiscard]] bool Contains(Vec2 point) const noexcept;
+
+    private:
+        std::vector<Vec2> m_edges;
+        std::vector<float> m_edgeLengths;
+        std::vector<Vec2> m_normals;
+        float m_sideLength = 1.0f;
+        float m_apothem = 1.0f;
+        std::vector<Rhombus> m_rhombi;
+        HexagonDirections m_hexagon{};
+    };
+
+    //An Aperture as the constant block of the blur and sprite shaders (aperture_edges, aperture_rhombi,
+    //aperture_normals and aperture_steps in aperture.hlsli). The shaders look up directions, offsets and weights
+    //instead of evaluating sines and cosines for every pixel; the demo rebuilds the table when angle or
+    //aperture_sides change.
+    struct ApertureTable {
+        static constexpr int MaxEdges = Aperture::MaxSides / 2;
+
+        //xy - unit direction of edge k, z - its length relative to the circumradius.
+        float edges[MaxEdges][4]{};
+        //xy - outward normal of side k, z - side length, w - apothem, both relative to the circumradius.
+        float normals[Aperture::MaxSides][4]{};
+        //Rhombus (k, j) at MaxEdges * k + j: xy - offset of its first corner in circumradii, z - its weight.
+        float rhombi[MaxEdges * MaxEdges][4]{};
+
+        void Build(const Aperture& aperture) noexcept;
+
+        //xy of steps[k] - one pixel along edge k in texture coordinates of a width x height viewport.
+        void BuildSteps(size_t width, size_t height, float (&steps)[MaxEdges][4]) const noexcept;
+    };
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "threadPool.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mini::bokeh {
+    //Box of a depth plane, in pixels.
+    struct FocusRegion {
+        size_t left = 0;
+        size_t top = 0;
+        size_t width = 0;
+        size_t height = 0;
+
+        //Square of side size around the point (x, y), moved inside a width x height plane and cut to it.
+        [[nodiscard]] static FocusRegion Around(float x, float y, size_t size, size_t width, size_t height) noexcept;
+    };
+
+    //Histogram of a region of a depth plane over inverse distance, whose bins are equal steps in CoC for a thin lens.
+    //Each thread of the pool counts a band of rows into a histogram of its own, padded to whole cache lines so no two
+    //threads write to one line, and the bands are summed afterwards. Small regions are counted on the calling thread
+    //without waking the pool.
+    class DepthHistogram {
+    public:
+        static constexpr size_t DefaultBins = 64;
+
+        //depth holds distances along the view axis, rows stride floats apart. Distances outside nearPlane and
+        //farPlane count in the nearest and farthest bin.
+        void Build(const float* depth, size_t stride, const FocusRegion& region, float nearPlane, float farPlane,
+                   ThreadPool& pool, size_t bins = DefaultBins);
+
+        [[nodiscard]] const std::vector<std::uint32_t>& counts() const noexcept { return m_counts; }
+
+        //Distance of the most populated bin, refined by the mean of it and its two neighbours over inverse distance;
+        //the nearer bin wins a tie. 0 for an empty region.
+        [[nodiscard]] float PeakDistance() const noexcept;
+
+    private:
+        static constexpr size_t BinsPerLine = 16;
+
+        struct alignas(64) BinLine {
+            std::uint32_t counts[BinsPerLine];
+        };
+
+        float m_nearInverse = 0.0f;
+        float m_farInverse = 0.0f;
+        std::vector<std::uint32_t> m_counts;
+        //One histogram per band, each on cache lines of its own.
+        std::vector<BinLine> m_bands;
+        //Bins of the row each thread is counting, a row of the region per thread, kept between builds.
+        std::vector<std::int32_t> m_indices;
+    };
+
+    struct AutofocusSettings {
+        size_t bins = DepthHistogram::DefaultBins;
+        //Seconds the focus takes to cover half of the way to a new distance, measured in inverse distance so a pull
+        //from far to near looks as steady as one back. 0 - jumps straight to the measured distance.
+        float halfLife = 0.15f;
+    };
+
+    //Focus distance that follows the peak of the depth histogram of a region, smoothed over time.
+    class Autofocus {
+    public:
+        explicit Autofocus(const AutofocusSettings& settings = {}) : m_settings(settings) {}
+
+        //Measures region of a depth plane as DepthHistogram::Build and moves the focus towards its peak for
+        //seconds since the last update. The first update and the first after Reset take the peak as it is, an
+        //empty region keeps the focus. Returns focusDistance().
+        float Update(const float* depth, size_t stride, const FocusRegion& region, float nearPlane, float farPlane,
+                     float seconds, ThreadPool& pool);
+
+        //Forgets the focus, so the next update snaps to its measurement.
+        void Reset() noexcept { m_focusDistance = 0.0f; }
+
+        //0 until the first measurement.
+        [[nodiscard]] float focusDistance() const noexcept { return m_focusDistance; }
+
+        [[nodiscard]] const DepthHistogram& histogram() const noexcept { return m_histogram; }
+
+    private:
+        AutofocusSettings m_settings;
+        DepthHistogram m_histogram;
+        float m_focusDistance = 0.0f;
+    };
+}
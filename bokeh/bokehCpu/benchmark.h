@@ -0,0 +1,191 @@
+#pragma once
+#include "autofocus.h"
+#include "bokehEngine.h"
+#include "frameIO.h"
+#include <array>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mini::bokeh {
+    //Procedural stand-ins for the scenes of the README pictures, so the benchmark needs no files.
+    enum class BenchScene {
+        //A textured floor from in focus at the bottom to far behind the focus at the top, as samples/simple.png.
+        Simple,
+        //Small lights many times brighter than white over a dark background behind the focus, as
+        //samples/white-spot.png.
+        WhiteSpot,
+        //A textured bar in front of the focus over a background in focus, as samples/near.png; run with the near
+        //field separated.
+        Near
+    };
+
+    [[nodiscard]] const char* BenchSceneName(BenchScene scene) noexcept;
+
+    //Fills image with the colour and CoC of scene and depth with its distances, row by row.
+    void MakeBenchScene(BenchScene scene, size_t width, size_t height, Image& image, std::vector<float>& depth);
+
+    //What a variant has to keep against the reference on one scene.
+    struct BenchBound {
+        //Least PSNR, in dB.
+        double minPsnr = 100.0;
+        //Largest error of a colour channel, clamped to [0, 1] as shown.
+        float maxError = 1e-3f;
+    };
+
+    //One implementation the benchmark runs, as the changes it makes to the parameters of a case.
+    struct BenchVariant {
+        //Also names its golden images, so it does not say which instruction set ran.
+        std::string name;
+        BlurMode mode = BlurMode::Gather;
+        Isa isa = Isa::Scalar;
+        bool classifyTiles = true;
+        bool scatterHighlights = false;
+        BlurFormat intermediateFormat = BlurFormat::Float32;
+        //Bounds on Simple, WhiteSpot and Near, in that order. The gathers only differ from the reference in rounding;
+        //the modes that approximate it are held to their worst of the default and quick cases, 1 dB and a quarter of
+        //the error short of it, so a change that loses more than that on any case shows.
+        std::array<BenchBound, 3> bounds{};
+
+        [[nodiscard]] const BenchBound& bound(const BenchScene scene) const noexcept {
+            return bounds[static_cast<size_t>(scene)];
+        }
+    };
+
+    //Every implementation of the engine, each compared with RenderReference: the per-texel gather with and
+    //without tiles, the one with the best instruction set this CPU runs, the packed intermediates, the highlight
+    //sprites and the other blur modes.
+    [[nodiscard]] std::vector<BenchVariant> DefaultBenchVariants();
+
+    struct BenchSize {
+        size_t width;
+        size_t height;
+    };
+
+    //Size, samples and angle of one case.
+    struct BenchCase {
+        BenchSize size;
+        float numSamples;
+        float angle;
+    };
+
+    //Outcome of one variant on one case.
+    struct BenchResult {
+        BenchScene scene;
+        BenchSize size;
+        float numSamples;
+        float angle;
+        std::string variant;
+        double milliseconds;
+        double megapixelsPerSecond;
+        //Of the same case in BenchSettings::baseline, NaN without one.
+        double baselineMegapixelsPerSecond;
+        //Time the case should stay below, NaN for none.
+        double budgetMilliseconds;
+        //BokehEngine::passBytes of the run.
+        size_t passBytes;
+        //Of the colour clamped to [0, 1], as shown, against the reference; infinite for identical images.
+        double psnr;
+        //Largest error of a colour channel against the reference, both clamped to [0, 1] as shown, so lights far
+        //above white do not make every bound of WhiteSpot meaningless.
+        float maxError;
+        //Against the golden image; NaN without one.
+        double goldenPsnr;
+        float goldenMaxError;
+        bool passed;
+    };
+
+    struct BenchSettings {
+        std::vector<BenchScene> scenes{BenchScene::Simple, BenchScene::WhiteSpot, BenchScene::Near};
+        std::vector<BenchSize> sizes{{320, 180}, {960, 540}};
+        std::vector<float> numSamples{8.0f, 16.0f, 32.0f};
+        std::vector<float> angles{0.0f, 0.5f};
+        //Cases to run instead of every combination of sizes, numSamples and angles; empty - all of them.
+        std::vector<BenchCase> cases;
+        std::vector<BenchVariant> variants = DefaultBenchVariants();
+        //Timed runs of every case after one untimed warm-up; the fastest counts.
+        int repeats = 3;
+        //Outputs of earlier runs to compare against, as .ppm files named after the case: 8 bits of the colour as
+        //shown, which keeps a set small enough to commit. A missing one fails the case; empty - no golden images.
+        //Variants held to the reference within rounding on a scene have none there, the reference's covers them.
+        std::string goldenDirectory;
+        //Writes the golden images of every case instead of comparing with them, to record a new set.
+        bool recordGolden = false;
+        //Depth plane the autofocus histogram is timed on, as a whole and in the square region of the demo, one
+        //eighth of its height; {0, 0} - not timed.
+        BenchSize autofocusSize{1920, 1080};
+        //Milliseconds the histogram has to stay below to run every frame. It is reported against the timings, not
+        //enforced, as they depend on the machine; the baseline catches them getting slower.
+        double autofocusBudget = 0.1;
+        //Least PSNR against the golden image, in dB, and the largest error of a channel clamped to [0, 1]. Storing
+        //rounds to half a step of the gamma encoded byte; builds for other compilers or instruction sets may round
+        //a value to the next step, one at most.
+        double minGoldenPsnr = 50.0;
+        float maxGoldenError = 0.01f;
+        //Results of an earlier run, e.g. from ReadBenchJson; a case whose Mpix/s fall more than throughputTolerance
+        //short of those of the same case there fails. Empty - throughput is recorded only.
+        std::vector<BenchResult> baseline;
+        double throughputTolerance = 0.2;
+    };
+
+    //The cases of bokehCli --bench --quick and of its golden set: 160x90 at 16 taps and angle 0, and that case with
+    //a width that is no multiple of the vector lanes or tile size, 8 and 32 taps, or angle 0.5 instead.
+    [[nodiscard]] BenchSettings QuickBenchSettings();
+
+    //Results written by Benchmark::WriteJson: scene, size, samples, angle, variant, time and throughput of each, the
+    //rest NaN. Throws std::runtime_error if in holds no results.
+    [[nodiscard]] std::vector<BenchResult> ReadBenchJson(std::istream& in);
+
+    //PSNR of the colour of a against b, both clamped to [0, 1].
+    [[nodiscard]] double DisplayPsnr(const Image& a, const Image& b);
+
+    //Largest difference of a colour channel of a and b, both clamped to [0, 1].
+    [[nodiscard]] float DisplayMaxError(const Image& a, const Image& b);
+
+    //Runs RenderReference and then every variant on every scene, size, sample count and angle with one engine,
+    //checks the outputs against the reference and the golden images and times them. Times the autofocus histogram
+    //on the pool of the engine too, as "autofocus-frame" and "autofocus-region" results of the Simple scene. Meant
+    //for catching quality and speed regressions on a headless machine before a change ships: the results go to JSON,
+    //the caller fails when any did not pass.
+    class Benchmark {
+    public:
+        explicit Benchmark(BenchSettings settings, unsigned threadCount = 0)
+            : m_settings(std::move(settings)), m_engine(threadCount),
+              m_threadCount(m_engine.pool().threadCount()) {}
+
+        //onResult, if set, gets every result as it is measured.
+        const std::vector<BenchResult>& Run(const std::function<void(const BenchResult&)>& onResult = nullptr);
+
+        [[nodiscard]] const std::vector<BenchResult>& results() const noexcept { return m_results; }
+
+        [[nodiscard]] bool passed() const noexcept;
+
+        //The machine and every result as one JSON object. Infinite PSNRs of identical images are written as "inf",
+        //missing golden comparisons as null.
+        void WriteJson(std::ostream& out) const;
+
+    private:
+        //Best of the repeats in milliseconds, leaving the output in output.
+        double _time(const Image& scene, const std::vector<float>& depth, Image& output, const BokehParams& params);
+
+        //Checks entry against the golden image of its case, or records output as that image.
+        void _checkGolden(BenchResult& entry, const Image& output);
+
+        //Checks the throughput of entry against the baseline.
+        void _checkBaseline(BenchResult& entry) const;
+
+        //Times DepthHistogram::Build on the whole depth plane of size and on the region of the demo.
+        void _timeAutofocus(const std::function<void(const BenchResult&)>& onResult);
+
+        BenchSettings m_settings;
+        BokehEngine m_engine;
+        unsigned m_threadCount;
+        std::vector<BenchResult> m_results;
+        FrameCodec m_codec;
+        Image m_golden;
+        DepthHistogram m_histogram;
+    };
+}
@@ -0,0 +1,248 @@
+#include "blurFormat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    //Smallest 1 - x the B5G6R5 decode divides by, as in blurFormat.hlsli; caps the colour at 63.
+    constexpr float MIN_PACKED_COMPLEMENT = 1.0f / 64.0f;
+
+    //Float with a 5-bit exponent biased by 15 and mantissaBits bits of mantissa, no sign, as the channels of
+    //R11G11B10_FLOAT. Rounds to nearest and saturates at the largest finite value; negatives and NaN become 0.
+    uint32_t packUnsignedFloat(const float v, const int mantissaBits) {
+        const auto one = 1u << mantissaBits;
+        const auto largest = (30u << mantissaBits) | (one - 1);
+        if (!(v > 0.0f))
+            return 0;
+        int exponent;
+        const auto fraction = frexp(v, &exponent);
+        auto biased = exponent - 1 + 15;
+        if (biased <= 0) {
+            // denormal: mantissa / 2^mantissaBits * 2^-14, rounding up into the smallest normal if need be
+            return static_cast<uint32_t>(lround(ldexp(v, mantissaBits + 14)));
+        }
+        auto mantissa = static_cast<uint32_t>(lround((2.0f * fraction - 1.0f) * static_cast<float>(one)));
+        if (mantissa == one) {
+            mantissa = 0;
+            ++biased;
+        }
+        if (biased > 30)
+            return largest;
+        return (static_cast<uint32_t>(biased) << mantissaBits) | mantissa;
+    }
+
+    float unpackUnsignedFloat(const uint32_t bits, const int mantissaBits) {
+        const auto exponent = static_cast<int>(bits >> mantissaBits);
+        const auto mantissa = static_cast<float>(bits & ((1u << mantissaBits) - 1));
+        if (exponent == 0)
+            return ldexp(mantissa, -14 - mantissaBits);
+        return ldexp(1.0f + ldexp(mantissa, -mantissaBits), exponent - 15);
+    }
+
+    uint16_t packHalf(const float v) {
+        const auto magnitude = static_cast<uint16_t>(packUnsignedFloat(fabs(v), 10));
+        return v < 0.0f ? static_cast<uint16_t>(magnitude | 0x8000u) : magnitude;
+    }
+
+    float unpackHalf(const uint16_t bits) {
+        const auto magnitude = unpackUnsignedFloat(bits & 0x7fffu, 10);
+        return bits & 0x8000u ? -magnitude : magnitude;
+    }
+
+    uint32_t packUnorm(const float v, const int bits) {
+        const auto largest = static_cast<float>((1u << bits) - 1);
+        return static_cast<uint32_t>(lround(clamp(v, 0.0f, 1.0f) * largest));
+    }
+
+    float unpackUnorm(const uint32_t v, const int bits) {
+        return static_cast<float>(v) / static_cast<float>((1u << bits) - 1);
+    }
+
+    float packRange(const float c) {
+        return max(c, 0.0f) / (1.0f + max(c, 0.0f));
+    }
+
+    float unpackRange(const float x) {
+        return x / max(1.0f - x, MIN_PACKED_COMPLEMENT);
+    }
+
+    size_t colorBytes(const BlurFormat format) {
+        switch (format) {
+            case BlurFormat::Float32:
+                return 4 * sizeof(float);
+            case BlurFormat::Rgba8:
+            case BlurFormat::R11G11B10F:
+                return sizeof(uint32_t);
+            case BlurFormat::Rgba16F:
+                return 4 * sizeof(uint16_t);
+            case BlurFormat::B5G6R5:
+                return sizeof(uint16_t);
+        }
+        return 0;
+    }
+
+    template <typename T>
+    void store(uint8_t* bytes, const T value) {
+        memcpy(bytes, &value, sizeof(T));
+    }
+
+    template <typename T>
+    T load(const uint8_t* bytes) {
+        T value;
+        memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+}
+
+const char* bokeh::BlurFormatName(const BlurFormat format) noexcept {
+    switch (format) {
+        case BlurFormat::Float32:
+            return "RGBA32F";
+        case BlurFormat::Rgba8:
+            return "RGBA8";
+        case BlurFormat::Rgba16F:
+            return "RGBA16F";
+        case BlurFormat::R11G11B10F:
+            return "R11G11B10F";
+        case BlurFormat::B5G6R5:
+            return "B5G6R5";
+    }
+    return "unknown";
+}
+
+ImageError bokeh::CompareImages(const Image& a, const Image& b) {
+    if (a.width() != b.width() || a.height() != b.height())
+        throw invalid_argument("CompareImages: the images differ in size");
+    ImageError error;
+    double colorSum = 0.0;
+    double cocSum = 0.0;
+    for (size_t y = 0; y < a.height(); ++y) {
+        const auto* rowA = a.row(y);
+        const auto* rowB = b.row(y);
+        for (size_t x = 0; x < a.width(); ++x) {
+            for (const auto d : {rowA[x].r - rowB[x].r, rowA[x].g - rowB[x].g, rowA[x].b - rowB[x].b}) {
+                error.maxColor = max(error.maxColor, fabs(d));
+                colorSum += static_cast<double>(d) * d;
+            }
+            const auto d = rowA[x].a - rowB[x].a;
+            error.maxCoc = max(error.maxCoc, fabs(d));
+            cocSum += static_cast<double>(d) * d;
+        }
+    }
+    const auto count = static_cast<double>(a.width() * a.height());
+    if (count > 0) {
+        error.rmsColor = static_cast<float>(sqrt(colorSum / (3 * count)));
+        error.rmsCoc = static_cast<float>(sqrt(cocSum / count));
+    }
+    return error;
+}
+
+void PackedImage::Encode(const Image& image, const BlurFormat format, const CocPlane cocPlane, const float cocScale,
+                         ThreadPool& pool) {
+    m_format = format;
+    m_cocScale = cocScale > 0.0f ? cocScale : 1.0f;
+    m_width = image.width();
+    m_height = image.height();
+    m_colorBytes = colorBytes(format);
+    m_cocBytes = HasCocPlane(format) ? (cocPlane == CocPlane::R8 ? 1 : 2) : 0;
+    m_color.resize(m_width * m_height * m_colorBytes);
+    m_coc.resize(m_width * m_height * m_cocBytes);
+
+    pool.ParallelFor(m_height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            const auto* row = image.row(y);
+            auto* color = m_color.data() + y * m_width * m_colorBytes;
+            auto* coc = m_coc.data() + y * m_width * m_cocBytes;
+            for (size_t x = 0; x < m_width; ++x, color += m_colorBytes, coc += m_cocBytes) {
+                const auto& t = row[x];
+                switch (format) {
+                    case BlurFormat::Float32:
+                        store(color, t);
+                        break;
+                    case BlurFormat::Rgba8:
+                        store(color, packUnorm(t.r, 8) | packUnorm(t.g, 8) << 8 | packUnorm(t.b, 8) << 16 |
+                                     packUnorm(t.a, 8) << 24);
+                        break;
+                    case BlurFormat::Rgba16F:
+                        for (auto c = 0; c < 4; ++c)
+                            store(color + 2 * c, packHalf((&t.r)[c]));
+                        break;
+                    case BlurFormat::R11G11B10F:
+                        store(color, packUnsignedFloat(t.r, 6) | packUnsignedFloat(t.g, 6) << 11 |
+                                     packUnsignedFloat(t.b, 5) << 22);
+                        break;
+                    case BlurFormat::B5G6R5:
+                        store(color, static_cast<uint16_t>(packUnorm(packRange(t.b), 5) |
+                                                           packUnorm(packRange(t.g), 6) << 5 |
+                                                           packUnorm(packRange(t.r), 5) << 11));
+                        break;
+                }
+                if (m_cocBytes == 1)
+                    *coc = static_cast<uint8_t>(packUnorm(t.a / m_cocScale, 8));
+                else if (m_cocBytes == 2)
+                    store(coc, static_cast<uint16_t>(packUnorm(t.a / m_cocScale, 16)));
+            }
+        }
+    });
+}
+
+void PackedImage::Decode(Image& image, ThreadPool& pool) const {
+    if (image.width() != m_width || image.height() != m_height)
+        image.Resize(m_width, m_height);
+
+    pool.ParallelFor(m_height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            auto* row = image.row(y);
+            const auto* color = m_color.data() + y * m_width * m_colorBytes;
+            const auto* coc = m_coc.data() + y * m_width * m_cocBytes;
+            for (size_t x = 0; x < m_width; ++x, color += m_colorBytes, coc += m_cocBytes) {
+                auto& t = row[x];
+                switch (m_format) {
+                    case BlurFormat::Float32:
+                        t = load<Texel>(color);
+                        break;
+                    case BlurFormat::Rgba8: {
+                        const auto bits = load<uint32_t>(color);
+                        t = {unpackUnorm(bits & 0xffu, 8), unpackUnorm(bits >> 8 & 0xffu, 8),
+                             unpackUnorm(bits >> 16 & 0xffu, 8), unpackUnorm(bits >> 24, 8)};
+                        break;
+                    }
+                    case BlurFormat::Rgba16F:
+                        for (auto c = 0; c < 4; ++c)
+                            (&t.r)[c] = unpackHalf(load<uint16_t>(color + 2 * c));
+                        break;
+                    case BlurFormat::R11G11B10F: {
+                        const auto bits = load<uint32_t>(color);
+                        t.r = unpackUnsignedFloat(bits & 0x7ffu, 6);
+                        t.g = unpackUnsignedFloat(bits >> 11 & 0x7ffu, 6);
+                        t.b = unpackUnsignedFloat(bits >> 22, 5);
+                        break;
+                    }
+                    case BlurFormat::B5G6R5: {
+                        const auto bits = load<uint16_t>(color);
+                        t.b = unpackRange(unpackUnorm(bits & 0x1fu, 5));
+                        t.g = unpackRange(unpackUnorm(bits >> 5 & 0x3fu, 6));
+                        t.r = unpackRange(unpackUnorm(bits >> 11 & 0x1fu, 5));
+                        break;
+                    }
+                }
+                if (m_cocBytes == 1)
+                    t.a = m_cocScale * unpackUnorm(*coc, 8);
+                else if (m_cocBytes == 2)
+                    t.a = m_cocScale * unpackUnorm(load<uint16_t>(coc), 16);
+            }
+        }
+    });
+}
+
+double PackedImage::bytesPerPixel() const noexcept {
+    const auto pixels = m_width * m_height;
+    if (pixels == 0)
+        return 0.0;
+    return static_cast<double>(m_color.size() + m_coc.size()) / static_cast<double>(pixels);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "image.h"
+#include "threadPool.h"
+#include <cstdint>
+#include <vector>
+
+namespace mini::bokeh {
+    //Storage of the images between the two blur passes, the blurTexture<k> targets of the demo (BLUR_FORMAT in
+    //BokehDemo.cpp, blurFormat.hlsli). Formats without alpha keep the CoC in a separate plane.
+    enum class BlurFormat : std::uint8_t {
+        //Plain floats, no loss; what the engine always used.
+        Float32,
+        //The original demo targets: colour clamped to 1 and the CoC in 8 bits, which bands.
+        Rgba8,
+        Rgba16F,
+        //Unsigned floats with 6, 6 and 5 bits of mantissa, and the CoC plane.
+        R11G11B10F,
+        //16 bits of colour mapped to [0, 1) by c / (1 + c) so it keeps its range, and the CoC plane.
+        B5G6R5
+    };
+
+    //Precision of the CoC plane of formats without alpha. The demo reuses cocTexture, which has 16 bits.
+    enum class CocPlane : std::uint8_t {
+        R8,
+        R16
+    };
+
+    [[nodiscard]] const char* BlurFormatName(BlurFormat format) noexcept;
+
+    [[nodiscard]] constexpr bool HasCocPlane(const BlurFormat format) noexcept {
+        return format == BlurFormat::R11G11B10F || format == BlurFormat::B5G6R5;
+    }
+
+    //Largest and root mean square differences between two images of the same size, over rgb and over the CoC.
+    struct ImageError {
+        float maxColor = 0.0f;
+        float rmsColor = 0.0f;
+        float maxCoc = 0.0f;
+        float rmsCoc = 0.0f;
+    };
+
+    //Throws std::invalid_argument if the sizes differ.
+    [[nodiscard]] ImageError CompareImages(const Image& a, const Image& b);
+
+    //An image packed into the bytes of a BlurFormat, to round trip the intermediates of the engine through the same
+    //precision as the GPU targets and to measure what that costs.
+    class PackedImage {
+    public:
+        //The CoC plane holds the CoC divided by cocScale, the way cocTexture holds the CoC before coc_factor, so
+        //CoCs up to cocScale fit its [0, 1] range.
+        void Encode(const Image& image, BlurFormat format, CocPlane cocPlane, float cocScale, ThreadPool& pool);
+
+        //Unpacks into image, resized to the encoded size.
+        void Decode(Image& image, ThreadPool& pool) const;
+
+        //Bytes of colour and CoC storage per pixel, counted from the encoded buffers.
+        [[nodiscard]] double bytesPerPixel() const noexcept;
+
+    private:
+        BlurFormat m_format = BlurFormat::Float32;
+        size_t m_width = 0;
+        size_t m_height = 0;
+        size_t m_colorBytes = 0;
+        size_t m_cocBytes = 0;
+        float m_cocScale = 1.0f;
+        std::vector<std::uint8_t> m_color;
+        std::vector<std::uint8_t> m_coc;
+    };
+}
@@ -0,0 +1,227 @@
+#pragma once
+#include "image.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+
+namespace mini::bokeh {
+    //Taps of a blur over coc * blurLength pixels, the CPU counterpart of SampleCount in bokeh1PS.hlsl/bokeh2PS.hlsl:
+    //density taps per pixel, at least one and at most maxSamples. density <= 0 keeps the fixed blurLength taps.
+    inline int SampleCount(const float coc, const int blurLength, const float density, const int maxSamples) noexcept {
+        if (density <= 0.0f)
+            return blurLength;
+        const auto taps = std::ceil(coc * static_cast<float>(blurLength) * density);
+        return static_cast<int>(std::clamp(taps, 1.0f, static_cast<float>(std::max(maxSamples, 1))));
+    }
+
+    //Offset along the blur, in steps, of the CoC BlurTexture rescales its result with: half a CoC, where a blur of
+    //blurLength taps starts.
+    inline float RescaleOffset(const int numSamples, const int blurLength) noexcept {
+        return blurLength > 0 ? 0.5f * static_cast<float>(numSamples) / static_cast<float>(blurLength) : 0.5f;
+    }
+
+    //CPU counterpart of BlurTexture from bokeh1PS.hlsl/bokeh2PS.hlsl. Walks numSamples bilinear taps from uv along
+    //direction (in pixels), weighting every tap by its squared CoC. The taps cover blurLength CoCs, see SampleCount.
+    //Returns the weighted mean colour in rgb and, in a, the CoC the shaders use to rescale the result.
+    //FixedSamples > 0 replaces numSamples with a constant, so the loop can be unrolled; see FixedBlurKernels.
+    template <int FixedSamples = 0>
+    Texel BlurTexture(const Image& tex, Vec2 uv, const Vec2 direction, int numSamples, const int blurLength) noexcept {
+        if constexpr (FixedSamples > 0)
+            numSamples = FixedSamples;
+        Texel finalColor{};
+        auto blurAmount = 0.0f;
+
+        const auto coc = tex.Sample(uv + direction * RescaleOffset(numSamples, blurLength)).a;
+
+        // Remove Rhombi Overlap
+        uv = uv + direction * 0.5f;
+
+        for (int i = 0; i < numSamples; ++i) {
+            auto color = tex.Sample(uv + direction * static_cast<float>(i));
+            color *= color.a;
+            blurAmount += color.a;
+            finalColor += color;
+        }
+
+        if (blurAmount <= 0.0f)
+            return {0.0f, 0.0f, 0.0f, coc};
+        finalColor *= 1.0f / blurAmount;
+        finalColor.a = coc;
+        return finalColor;
+    }
+
+    //BlurTexture for taps that all share the CoC found at the start point, e.g. inside TileClass::Uniform tiles.
+    //The squared-CoC weights are then equal and cancel, leaving a plain average divided by that CoC.
+    template <int FixedSamples = 0>
+    Texel BlurTextureUniform(const Image& tex, Vec2 uv, const Vec2 direction, int numSamples,
+                             const int blurLength) noexcept {
+        if constexpr (FixedSamples > 0)
+            numSamples = FixedSamples;
+        Texel finalColor{};
+
+        const auto coc = tex.Sample(uv + direction * RescaleOffset(numSamples, blurLength)).a;
+
+        if (coc <= 0.0f || numSamples <= 0)
+            return {0.0f, 0.0f, 0.0f, coc};
+
+        // Remove Rhombi Overlap
+        uv = uv + direction * 0.5f;
+
+        for (int i = 0; i < numSamples; ++i)
+            finalColor += tex.Sample(uv + direction * static_cast<float>(i));
+
+        finalColor *= 1.0f / (static_cast<float>(numSamples) * coc);
+        finalColor.a = coc;
+        return finalColor;
+    }
+
+    //Near field gather from bokeh1PS.hlsl: numSamples taps from uv along direction (in pixels), each counting only
+    //if its own near CoC (alpha of tex, already scaled by cocFactor) spreads a blur of blurLength CoCs back over uv.
+    //Returns colour premultiplied by the fraction of taps that do, and that fraction in a.
+    inline Texel BlurNearField(const Image& tex, Vec2 uv, const Vec2 direction, const int numSamples,
+                               const int blurLength) noexcept {
+        Texel finalColor{};
+        if (numSamples <= 0)
+            return finalColor;
+        const auto stepLength = std::sqrt(direction.x * direction.x + direction.y * direction.y);
+
+        // Remove Rhombi Overlap
+        uv = uv + direction * 0.5f;
+
+        for (int i = 0; i < numSamples; ++i) {
+            const auto color = tex.Sample(uv + direction * static_cast<float>(i));
+            const auto distance = stepLength * (static_cast<float>(i) + 0.5f);
+            if (color.a > 0.0f && color.a * static_cast<float>(blurLength) >= distance)
+                finalColor += {color.r, color.g, color.b, 1.0f};
+        }
+        return finalColor * (1.0f / static_cast<float>(numSamples));
+    }
+
+    //Plain average of numSamples premultiplied taps from uv along direction, the second pass of the near field.
+    inline Texel BlurPremultiplied(const Image& tex, Vec2 uv, const Vec2 direction, const int numSamples) noexcept {
+        Texel finalColor{};
+        if (numSamples <= 0)
+            return finalColor;
+
+        // Remove Rhombi Overlap
+        uv = uv + direction * 0.5f;
+
+        for (int i = 0; i < numSamples; ++i)
+            finalColor += tex.Sample(uv + direction * static_cast<float>(i));
+        return finalColor * (1.0f / static_cast<float>(numSamples));
+    }
+
+    //Jitter in [0, 1) of the stochastic taps of the pixel centred at (x, y) in blur pass 0 or 1, as TapJitter in
+    //temporal.hlsli. Interleaved gradient noise stands in for a blue noise texture: its error is high-frequency,
+    //which the denoiser removes cheaply. Every frame adds the golden ratio, so over frames each pixel visits the whole
+    //interval evenly.
+    inline float TapJitter(const float x, const float y, const unsigned frame, const int pass) noexcept {
+        const auto px = x + 17.0f * static_cast<float>(pass);
+        const auto py = y + 29.0f * static_cast<float>(pass);
+        const auto gradient = 0.06711056f * px + 0.00583715f * py;
+        const auto noise = 52.9829189f * (gradient - std::floor(gradient));
+        const auto jitter = noise + 0.61803399f * static_cast<float>(frame % 1024);
+        return jitter - std::floor(jitter);
+    }
+
+    //Offset along the blur, in steps after the half step of BlurTexture, of stochastic tap n of taps: one point of
+    //each of taps equal strata of the numSamples steps, placed by jitter.
+    inline float StratumOffset(const int n, const int numSamples, const int taps, const float jitter) noexcept {
+        return (static_cast<float>(n) + jitter) * static_cast<float>(numSamples) / static_cast<float>(taps) - 0.5f;
+    }
+
+    //Largest rescaling CoC of the first pass of StochasticBlurTexture relative to the mean CoC of its taps, weighted
+    //like their colours. The full gather rescales by up to 1.1 of it on the benchmark scenes; a few taps that all
+    //land on much smaller CoCs than the one at the rescale offset pushed the colour to 12 times the brightest tap.
+    constexpr float MaxStochasticRescale = 1.25f;
+
+    //BlurTexture from taps of its numSamples steps, one in each stratum, see StratumOffset. The weights are the same,
+    //so the result estimates the full blur with noise the denoiser removes; numSamples <= taps takes every step.
+    //FirstPass limits the CoC returned in a, which the first pass rescales the colour with, see MaxStochasticRescale.
+    template <bool FirstPass = false>
+    Texel StochasticBlurTexture(const Image& tex, Vec2 uv, const Vec2 direction, const int numSamples,
+                                const int blurLength, const int taps, const float jitter) noexcept {
+        if (numSamples <= taps)
+            return BlurTexture(tex, uv, direction, numSamples, blurLength);
+        Texel finalColor{};
+        auto blurAmount = 0.0f;
+        auto cocSum = 0.0f;
+
+        const auto coc = tex.Sample(uv + direction * RescaleOffset(numSamples, blurLength)).a;
+
+        // Remove Rhombi Overlap
+        uv = uv + direction * 0.5f;
+
+        for (int n = 0; n < taps; ++n) {
+            auto color = tex.Sample(uv + direction * StratumOffset(n, numSamples, taps, jitter));
+            cocSum += color.a;
+            color *= color.a;
+            blurAmount += color.a;
+            finalColor += color;
+        }
+
+        if (blurAmount <= 0.0f)
+            return {0.0f, 0.0f, 0.0f, coc};
+        finalColor *= 1.0f / blurAmount;
+        // the CoCs are negative in front of the focus unless the near field is split off
+        const auto limit = MaxStochasticRescale * blurAmount / std::fabs(cocSum);
+        finalColor.a = FirstPass ? std::copysign(std::min(std::fabs(coc), limit), coc) : coc;
+        return finalColor;
+    }
+
+    //BlurTextureUniform with the taps of StochasticBlurTexture.
+    inline Texel StochasticBlurTextureUniform(const Image& tex, Vec2 uv, const Vec2 direction, const int numSamples,
+                                              const int blurLength, const int taps, const float jitter) noexcept {
+        if (numSamples <= taps)
+            return BlurTextureUniform(tex, uv, direction, numSamples, blurLength);
+        Texel finalColor{};
+
+        const auto coc = tex.Sample(uv + direction * RescaleOffset(numSamples, blurLength)).a;
+
+        if (coc <= 0.0f || taps <= 0)
+            return {0.0f, 0.0f, 0.0f, coc};
+
+        // Remove Rhombi Overlap
+        uv = uv + direction * 0.5f;
+
+        for (int n = 0; n < taps; ++n)
+            finalColor += tex.Sample(uv + direction * StratumOffset(n, numSamples, taps, jitter));
+
+        finalColor *= 1.0f / (static_cast<float>(taps) * coc);
+        finalColor.a = coc;
+        return finalColor;
+    }
+
+    //Tap counts with an instantiation of BlurTexture and BlurTextureUniform, the same as the bokeh1PS_<n> and
+    //bokeh2PS_<n> shader permutations.
+    constexpr std::array<int, 6> FixedSampleCounts = {4, 8, 12, 16, 24, 32};
+
+    //BlurTexture and BlurTextureUniform for one tap count; the numSamples argument is ignored by the fixed ones.
+    struct BlurKernels {
+        using Function = Texel (*)(const Image& tex, Vec2 uv, Vec2 direction, int numSamples, int blurLength) noexcept;
+
+        Function blur;
+        Function uniform;
+    };
+
+    namespace detail {
+        template <size_t... I>
+        constexpr std::array<BlurKernels, sizeof...(I)> makeFixedBlurKernels(std::index_sequence<I...>) noexcept {
+            return {BlurKernels{&BlurTexture<FixedSampleCounts[I]>, &BlurTextureUniform<FixedSampleCounts[I]>}...};
+        }
+    }
+
+    //Dispatch table with the instantiations of FixedSampleCounts, in the same order.
+    inline constexpr auto FixedBlurKernels =
+        detail::makeFixedBlurKernels(std::make_index_sequence<FixedSampleCounts.size()>());
+
+    //Kernels for blurs of numSamples taps each: the unrolled ones if numSamples is one of FixedSampleCounts, the
+    //generic ones otherwise.
+    [[nodiscard]] inline BlurKernels GetBlurKernels(const int numSamples) noexcept {
+        const auto it = std::find(FixedSampleCounts.begin(), FixedSampleCounts.end(), numSamples);
+        if (it == FixedSampleCounts.end())
+            return {&BlurTexture<>, &BlurTextureUniform<>};
+        return FixedBlurKernels[static_cast<size_t>(it - FixedSampleCounts.begin())];
+    }
+}
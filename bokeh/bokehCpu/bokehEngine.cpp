@@ -0,0 +1,937 @@
+#include "bokehEngine.h"
+#include "blurKernel.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    //Side of the square whose box blur stands in for a hexagon of circumradius 1, as MIP_FOOTPRINT in bokehMipPS.
+    constexpr float MIP_FOOTPRINT = 1.6f;
+
+    //Bytes of the planar intermediates of every thread kept between the passes: the ring of rows of _runPlanar is
+    //sized to stay in the L2 caches.
+    constexpr size_t RING_BYTES_PER_THREAD = 1 << 20;
+
+    //Mean squared CoC along a segment below which _runPrefixSum gathers the taps instead of dividing its sums.
+    constexpr float MIN_PREFIX_WEIGHT = 1e-4f;
+
+    //Fewest rows per thread in a stripe of _runPlanar, below which the barriers cost more than the traffic saved.
+    constexpr size_t MIN_STRIPE_ROWS = 16;
+
+    size_t imageBytes(const Image& image) noexcept {
+        return image.width() * image.height() * sizeof(Texel);
+    }
+
+    int sampleCount(const BokehParams& params) {
+        // the shaders loop while i < NUM_SAMPLES on a float
+        return params.numSamples > 0.0f ? static_cast<int>(ceil(params.numSamples)) : 0;
+    }
+
+    struct BlurSteps {
+        int taps;
+        float length;
+    };
+
+    //Taps and step length of a blur over coc * samples pixels.
+    BlurSteps blurSteps(const BokehParams& params, const int samples, const float coc) {
+        const auto maxSamples = static_cast<int>(lround(params.maxSamples));
+        const auto taps = SampleCount(coc, samples, params.sampleDensity, maxSamples);
+        // the fixed count keeps steps of exactly one CoC
+        return {taps, taps == samples ? coc : coc * static_cast<float>(samples) / static_cast<float>(taps)};
+    }
+
+    //blurSteps of the count CoCs of a row. Without SSE4.1 every ceil is a library call, so the count is rounded up
+    //by truncating and comparing instead, after the clamp, which leaves integer bounds alone; the loop has no
+    //branches left and vectorizes.
+    void rowBlurSteps(const BokehParams& params, const int samples, const float* coc, const size_t count, int* taps,
+                      float* length) {
+        if (params.sampleDensity <= 0.0f) {
+            fill(taps, taps + count, samples);
+            copy(coc, coc + count, length);
+            return;
+        }
+        const auto blurLength = static_cast<float>(samples);
+        const auto density = params.sampleDensity;
+        const auto maxTaps = static_cast<float>(max(static_cast<int>(lround(params.maxSamples)), 1));
+        for (size_t x = 0; x < count; ++x) {
+            const auto bounded = clamp(coc[x] * blurLength * density, 1.0f, maxTaps);
+            auto n = static_cast<int>(bounded);
+            n += static_cast<float>(n) < bounded ? 1 : 0;
+            taps[x] = n;
+            length[x] = n == samples ? coc[x] : coc[x] * blurLength / static_cast<float>(n);
+        }
+    }
+
+    //Spreads the taps of StochasticBlurTexture over the blurs of rowBlurSteps of row y in blur pass 0 or 1: blurs
+    //of more than params.stochasticTaps take that many, as many steps apart as make up one stratum, starting at
+    //the jitter of the pixel, see StratumOffset. first receives the offset of the first tap for LineBlurKernel.
+    void rowStochasticTaps(const BokehParams& params, const int pass, const size_t y, const size_t count, int* taps,
+                           float* length, float* first) {
+        const auto stochasticTaps = max(params.stochasticTaps, 1);
+        const auto py = static_cast<float>(y) + 0.5f;
+        for (size_t x = 0; x < count; ++x) {
+            if (taps[x] <= stochasticTaps) {
+                first[x] = 0.5f;
+                continue;
+            }
+            length[x] *= static_cast<float>(taps[x]) / static_cast<float>(stochasticTaps);
+            taps[x] = stochasticTaps;
+            first[x] = TapJitter(static_cast<float>(x) + 0.5f, py, params.frame, pass);
+        }
+    }
+
+    //Blur kernels for blurs of samples taps. Every blur takes exactly samples taps when sampleDensity is 0, so the
+    //instantiations for fixed counts can stand in for the generic loops.
+    BlurKernels blurKernels(const BokehParams& params, const int samples) noexcept {
+        return GetBlurKernels(params.sampleDensity <= 0.0f ? samples : 0);
+    }
+
+    //Class of the tile holding pixel (x, y) and, in spanEnd, the end of that tile within the row. Without tiles
+    //the whole row is one Mixed span.
+    TileClass tileSpan(const CocTiles* tiles, const size_t x, const size_t y, const size_t width, size_t& spanEnd) {
+        if (!tiles) {
+            spanEnd = width;
+            return TileClass::Mixed;
+        }
+        spanEnd = min(width, (x / CocTiles::TileSize + 1) * CocTiles::TileSize);
+        return tiles->atPixel(x, y);
+    }
+
+    //End of the run of pixels from x in row y whose tiles agree with the tile of x on being in focus.
+    size_t focusRunEnd(const CocTiles* tiles, const size_t x, const size_t y, const size_t width) {
+        size_t end;
+        const auto inFocus = tileSpan(tiles, x, y, width, end) == TileClass::InFocus;
+        while (end < width && (tiles->atPixel(end, y) == TileClass::InFocus) == inFocus)
+            end = min(width, end + CocTiles::TileSize);
+        return end;
+    }
+}
+
+void BokehEngine::Run(const Image& scene, Image& output, const BokehParams& params) {
+    Run(scene, {}, output, params);
+}
+
+void BokehEngine::Run(const Image& scene, const vector<float>& depth, Image& output, const BokehParams& params) {
+    m_passBytes = 0;
+    if (params.mode == BlurMode::DepthSlices) {
+        _runDepthSlices(scene, depth, output, params);
+        return;
+    }
+    if (params.mode == BlurMode::Convolution) {
+        _runConvolution(scene, output, params);
+        return;
+    }
+    m_aperture.Build(params.sides, params.angle);
+    // the running sums, the stochastic taps and the mip chain are only written for the hexagon's passes
+    if (params.sides != 6 && params.mode != BlurMode::Gather)
+        throw invalid_argument("BokehEngine: " + to_string(params.sides) +
+                               " sides need BlurMode::Gather, Convolution or DepthSlices, the other modes only blur "
+                               "the hexagon");
+    const auto* source = &scene;
+    if (params.separateNearField) {
+        _splitNearField(scene, params);
+        source = &m_farScene;
+    }
+    if (params.scatterHighlights) {
+        m_highlights.Extract(*source, m_gatherScene, params.highlightThreshold, params.highlightMinRadius,
+                             params.cocFactor, sampleCount(params), m_pool);
+        source = &m_gatherScene;
+    }
+    _run(*source, output, params);
+    // the noise is in the gather alone, the sprites and the near field go over the denoised result
+    if (params.mode == BlurMode::Stochastic) {
+        const DenoiseSettings settings{params.cocFactor, sampleCount(params), params.sampleDensity,
+                                       static_cast<int>(lround(params.maxSamples)), max(params.stochasticTaps, 1)};
+        m_denoiser.Run(output, *source, depth, settings, m_pool);
+    }
+    // the near field covers the sprites behind it
+    if (params.scatterHighlights)
+        m_highlights.Splat(output, m_aperture, m_pool);
+    if (params.separateNearField)
+        _compositeNearField(output, params);
+}
+
+void BokehEngine::_run(const Image& scene, Image& output, const BokehParams& params) {
+    const auto width = scene.width();
+    const auto height = scene.height();
+    if (output.width() != width || output.height() != height)
+        output.Resize(width, height);
+    if (params.mode == BlurMode::MipPyramid) {
+        _runMipPyramid(scene, output, params);
+        return;
+    }
+    m_useTiles = params.classifyTiles;
+    if (m_useTiles)
+        m_tiles.Build(scene, params.cocFactor, sampleCount(params), m_pool);
+    if (m_aperture.sides() != 6) {
+        _runPolygon(scene, output, params);
+        return;
+    }
+    if ((params.mode == BlurMode::Gather || params.mode == BlurMode::Stochastic) && m_isa != Isa::Scalar &&
+        params.intermediateFormat == BlurFormat::Float32) {
+        _runPlanar(scene, output, params);
+        return;
+    }
+    if (m_verticalBlur.width() != width || m_verticalBlur.height() != height) {
+        m_verticalBlur.Resize(width, height);
+        m_diagonalBlur.Resize(width, height);
+    }
+    m_passBytes += imageBytes(m_verticalBlur) + imageBytes(m_diagonalBlur);
+    if (params.mode == BlurMode::PrefixSum)
+        _runPrefixSum(scene, output, params);
+    else if (params.mode == BlurMode::Stochastic)
+        _runStochastic(scene, output, params);
+    else
+        _runGather(scene, output, params);
+}
+
+void BokehEngine::_runGather(const Image& scene, Image& output, const BokehParams& params) {
+    const auto samples = sampleCount(params);
+    const auto kernels = blurKernels(params, samples);
+    m_pool.ParallelFor(scene.height(), [&](const size_t begin, const size_t end) {
+        _firstPass(scene, params, [&](size_t, const Vec2 uv, const Vec2 step, const int taps, const bool uniform) {
+            return uniform ? kernels.uniform(scene, uv, step, taps, samples)
+                           : kernels.blur(scene, uv, step, taps, samples);
+        }, begin, end);
+    });
+    _storeIntermediate(m_verticalBlur, params);
+    _storeIntermediate(m_diagonalBlur, params);
+    m_pool.ParallelFor(scene.height(), [&](const size_t begin, const size_t end) {
+        _secondPass(scene, output, params, [&](const size_t i, const Vec2 uv, const Vec2 step, const int taps,
+                                               const bool uniform) {
+            const auto& tex = i == 0 ? m_verticalBlur : m_diagonalBlur;
+            return uniform ? kernels.uniform(tex, uv, step, taps, samples)
+                           : kernels.blur(tex, uv, step, taps, samples);
+        }, begin, end);
+    });
+}
+
+void BokehEngine::_runMipPyramid(const Image& scene, Image& output, const BokehParams& params) {
+    m_mips.Build(scene, m_pool);
+    const auto scale = MIP_FOOTPRINT * params.cocFactor * static_cast<float>(sampleCount(params));
+    m_pool.ParallelFor(scene.height(), [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            const auto* in = scene.row(y);
+            auto* out = output.row(y);
+            for (size_t x = 0; x < scene.width(); ++x) {
+                const auto width = scale * fabs(in[x].a);
+                // level 0 fetched at the texel centre is the texel itself
+                const auto t = width <= 1.0f ? in[x] : m_mips.Sample({static_cast<float>(x) + 0.5f,
+                                                                      static_cast<float>(y) + 0.5f}, log2(width));
+                out[x] = {t.r, t.g, t.b, 1.0f};
+            }
+        }
+    });
+}
+
+void BokehEngine::_runConvolution(const Image& scene, Image& output, const BokehParams& params) {
+    ConvolutionSettings settings;
+    settings.sides = params.sides;
+    settings.angle = params.angle;
+    settings.radius = params.cocFactor * static_cast<float>(sampleCount(params));
+    settings.layers = params.convolutionLayers;
+    settings.nearField = params.separateNearField;
+    m_convolution.Run(scene, output, settings, m_pool);
+}
+
+void BokehEngine::_runDepthSlices(const Image& scene, const vector<float>& depth, Image& output,
+                                  const BokehParams& params) {
+    SliceSettings settings;
+    settings.sides = params.sides;
+    settings.angle = params.angle;
+    settings.radius = params.cocFactor * static_cast<float>(sampleCount(params));
+    settings.slices = params.depthSlices;
+    settings.nearField = params.separateNearField;
+    m_slices.Run(scene, depth, output, settings, m_pool);
+}
+
+void BokehEngine::_storeIntermediate(Image& image, const BokehParams& params) {
+    if (params.intermediateFormat == BlurFormat::Float32)
+        return;
+    m_packed.Encode(image, params.intermediateFormat, params.cocPlane, params.cocFactor, m_pool);
+    m_packed.Decode(image, m_pool);
+}
+
+const Image& BokehEngine::_firstIntermediate() const noexcept {
+    return m_aperture.sides() != 6 ? m_edgeBlurs.front() : m_verticalBlur;
+}
+
+FormatReport BokehEngine::MeasureFormat(const Image& scene, Image& output, const BokehParams& params) {
+    // both runs take the per-texel path, which the formats need, so only the format differs
+    const auto isa = m_isa;
+    m_isa = Isa::Scalar;
+    auto reference = params;
+    reference.intermediateFormat = BlurFormat::Float32;
+    Image referenceOutput;
+    Run(scene, referenceOutput, reference);
+    const auto referenceIntermediate = _firstIntermediate();
+    Run(scene, output, params);
+    m_isa = isa;
+
+    FormatReport report{params.intermediateFormat, params.cocPlane, 16.0, {}, {}};
+    if (params.intermediateFormat != BlurFormat::Float32) {
+        // the last image stored is of the same size and format as the first
+        report.bytesPerPixel = m_packed.bytesPerPixel();
+        report.intermediate = CompareImages(_firstIntermediate(), referenceIntermediate);
+    }
+    report.output = CompareImages(output, referenceOutput);
+    return report;
+}
+
+void BokehEngine::_runPrefixSum(const Image& scene, Image& output, const BokehParams& params) {
+    // the taps of BlurTexture cover the segment from uv to uv + step * taps
+    const auto samples = sampleCount(params);
+    const auto kernels = blurKernels(params, samples);
+    const auto blur = [&](const Image& tex, const LineIntegral& lines, const Vec2 uv, const Vec2 step,
+                          const int taps) {
+        const auto length = sqrt(step.x * step.x + step.y * step.y) * static_cast<float>(taps);
+        auto sums = lines.Integrate(uv, length);
+        // next to nothing to divide by: the rounding of the sums would outweigh the colour, the taps are exact
+        if (sums.a <= MIN_PREFIX_WEIGHT * max(length, 1.0f))
+            return kernels.blur(tex, uv, step, taps, samples);
+        const auto coc = tex.Sample(uv + step * RescaleOffset(taps, samples)).a;
+        sums *= 1.0f / sums.a;
+        sums.a = coc;
+        return sums;
+    };
+
+    m_lines[0].Build(scene, m_aperture.hexagon().vertical, m_pool);
+    m_lines[1].Build(scene, m_aperture.hexagon().diagonal, m_pool);
+    m_pool.ParallelFor(scene.height(), [&](const size_t begin, const size_t end) {
+        // the running sums cost the same with or without weights, so uniform tiles take the normal path
+        _firstPass(scene, params, [&](const size_t i, const Vec2 uv, const Vec2 step, const int taps, bool) {
+            return blur(scene, m_lines[i], uv, step, taps);
+        }, begin, end);
+    });
+
+    _storeIntermediate(m_verticalBlur, params);
+    _storeIntermediate(m_diagonalBlur, params);
+    m_lines[0].Build(m_verticalBlur, m_aperture.hexagon().diagonal, m_pool);
+    m_lines[1].Build(m_diagonalBlur, m_aperture.hexagon().diagonal2, m_pool);
+    m_pool.ParallelFor(scene.height(), [&](const size_t begin, const size_t end) {
+        _secondPass(scene, output, params, [&](const size_t i, const Vec2 uv, const Vec2 step, const int taps, bool) {
+            return blur(i == 0 ? m_verticalBlur : m_diagonalBlur, m_lines[i], uv, step, taps);
+        }, begin, end);
+    });
+}
+
+void BokehEngine::_runStochastic(const Image& scene, Image& output, const BokehParams& params) {
+    const auto samples = sampleCount(params);
+    const auto taps = max(params.stochasticTaps, 1);
+    // uv is the centre of the pixel the blur belongs to, the first pass jitters differently from the second
+    const auto blur = [&](const Image& tex, const int pass, const Vec2 uv, const Vec2 step, const int numSamples,
+                          const bool uniform) {
+        const auto jitter = TapJitter(uv.x, uv.y, params.frame, pass);
+        if (uniform)
+            return StochasticBlurTextureUniform(tex, uv, step, numSamples, samples, taps, jitter);
+        return pass == 0 ? StochasticBlurTexture<true>(tex, uv, step, numSamples, samples, taps, jitter)
+                         : StochasticBlurTexture(tex, uv, step, numSamples, samples, taps, jitter);
+    };
+    m_pool.ParallelFor(scene.height(), [&](const size_t begin, const size_t end) {
+        _firstPass(scene, params, [&](size_t, const Vec2 uv, const Vec2 step, const int numSamples,
+                                      const bool uniform) {
+            return blur(scene, 0, uv, step, numSamples, uniform);
+        }, begin, end);
+    });
+    _storeIntermediate(m_verticalBlur, params);
+    _storeIntermediate(m_diagonalBlur, params);
+    m_pool.ParallelFor(scene.height(), [&](const size_t begin, const size_t end) {
+        _secondPass(scene, output, params, [&](const size_t i, const Vec2 uv, const Vec2 step, const int numSamples,
+                                               const bool uniform) {
+            return blur(i == 0 ? m_verticalBlur : m_diagonalBlur, 1, uv, step, numSamples, uniform);
+        }, begin, end);
+    });
+}
+
+void BokehEngine::_splitNearField(const Image& scene, const BokehParams& params) {
+    const auto width = scene.width();
+    const auto height = scene.height();
+    if (m_farScene.width() != width || m_farScene.height() != height) {
+        m_farScene.Resize(width, height);
+        m_nearScene.Resize(width, height);
+        m_nearVertical.Resize(width, height);
+        m_nearDiagonal.Resize(width, height);
+    }
+    m_nearCoc.resize(width * height);
+    m_pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            const auto* sceneRow = scene.row(y);
+            auto* farRow = m_farScene.row(y);
+            auto* nearRow = m_nearScene.row(y);
+            for (size_t x = 0; x < width; ++x) {
+                const auto& t = sceneRow[x];
+                const auto nearCoc = t.a < 0.0f ? -params.cocFactor * t.a : 0.0f;
+                farRow[x] = {t.r, t.g, t.b, fabs(t.a)};
+                nearRow[x] = {t.r, t.g, t.b, nearCoc};
+                m_nearCoc[y * width + x] = nearCoc;
+            }
+        }
+    });
+
+    // a pixel can be covered by any near field pixel whose blur reaches it, bilinear footprint included
+    const auto maxCoc = m_nearCoc.empty() ? 0.0f : *max_element(m_nearCoc.begin(), m_nearCoc.end());
+    const auto radius = static_cast<size_t>(ceil(maxCoc * static_cast<float>(sampleCount(params)) + 1.0f));
+    if (maxCoc > 0.0f)
+        m_maxFilter.Apply(m_nearCoc, width, height, radius, m_pool);
+}
+
+void BokehEngine::_compositeNearField(Image& output, const BokehParams& params) {
+    if (m_aperture.sides() == 6 && m_isa != Isa::Scalar) {
+        _compositeNearFieldPlanar(output, params);
+        return;
+    }
+    const auto samples = sampleCount(params);
+    const auto width = m_nearScene.width();
+    const auto height = m_nearScene.height();
+    const auto vertical = m_aperture.hexagon().vertical;
+    const auto diagonal = m_aperture.hexagon().diagonal;
+    const auto diagonal2 = m_aperture.hexagon().diagonal2;
+    const auto hexagon = m_aperture.sides() == 6;
+    const auto& edges = m_aperture.edges();
+    const auto& lengths = m_aperture.edgeLengths();
+    m_nearEdgeBlurs.resize(hexagon ? 0 : edges.size() - 1);
+    for (auto& image : m_nearEdgeBlurs)
+        if (image.width() != width || image.height() != height)
+            image.Resize(width, height);
+    m_passBytes += imageBytes(m_nearVertical) + imageBytes(m_nearDiagonal);
+    for (const auto& image : m_nearEdgeBlurs)
+        m_passBytes += imageBytes(image);
+
+    m_pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            auto* verticalRow = m_nearVertical.row(y);
+            auto* diagonalRow = m_nearDiagonal.row(y);
+            for (size_t x = 0; x < width; ++x) {
+                const auto coc = m_nearCoc[y * width + x];
+                if (coc <= 0.0f) {
+                    verticalRow[x] = diagonalRow[x] = Texel{};
+                    for (auto& image : m_nearEdgeBlurs)
+                        image.at(x, y) = Texel{};
+                    continue;
+                }
+                const Vec2 uv{static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f};
+                if (!hexagon) {
+                    for (size_t k = 0; k < m_nearEdgeBlurs.size(); ++k) {
+                        const auto steps = blurSteps(params, samples, coc * lengths[k]);
+                        m_nearEdgeBlurs[k].at(x, y) = BlurNearField(m_nearScene, uv, edges[k] * steps.length,
+                                                                    steps.taps, samples);
+                    }
+                    continue;
+                }
+                const auto steps = blurSteps(params, samples, coc);
+                verticalRow[x] = BlurNearField(m_nearScene, uv, vertical * steps.length, steps.taps, samples);
+                const auto color2 = BlurNearField(m_nearScene, uv, diagonal * steps.length, steps.taps, samples);
+                diagonalRow[x] = (color2 + verticalRow[x]) * 0.5f;
+            }
+        }
+    });
+    m_pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            auto* outputRow = output.row(y);
+            for (size_t x = 0; x < width; ++x) {
+                const auto coc = m_nearCoc[y * width + x];
+                if (coc <= 0.0f)
+                    continue;
+                const Vec2 uv{static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f};
+                Texel near{};
+                if (hexagon) {
+                    const auto steps = blurSteps(params, samples, coc);
+                    const auto color = BlurPremultiplied(m_nearVertical, uv, diagonal * steps.length, steps.taps);
+                    const auto color2 = BlurPremultiplied(m_nearDiagonal, uv, diagonal2 * steps.length, steps.taps);
+                    near = (color + color2) * 0.5f;
+                } else {
+                    const auto radius = coc * static_cast<float>(samples);
+                    for (const auto& rhombus : m_aperture.rhombi()) {
+                        const auto steps = blurSteps(params, samples, coc * lengths[rhombus.second]);
+                        near += BlurPremultiplied(m_nearEdgeBlurs[rhombus.first], uv + rhombus.offset * radius,
+                                                  edges[rhombus.second] * steps.length, steps.taps) * rhombus.weight;
+                    }
+                }
+                auto& out = outputRow[x];
+                out = {near.r + (1.0f - near.a) * out.r, near.g + (1.0f - near.a) * out.g,
+                       near.b + (1.0f - near.a) * out.b, 1.0f};
+            }
+        }
+    });
+}
+
+void BokehEngine::_compositeNearFieldPlanar(Image& output, const BokehParams& params) {
+    using Plane = PlanarImage::Plane;
+    const auto samples = sampleCount(params);
+    const auto width = m_nearScene.width();
+    const auto height = m_nearScene.height();
+    const auto vertical = m_aperture.hexagon().vertical;
+    const auto diagonal = m_aperture.hexagon().diagonal;
+    const auto diagonal2 = m_aperture.hexagon().diagonal2;
+    if (m_planarNearScene.width() != width || m_planarNearScene.height() != height) {
+        m_planarNearScene.Resize(width, height);
+        m_planarNearVertical.Resize(width, height);
+        m_planarNearDiagonal.Resize(width, height);
+    }
+    // full frames: the runs of covered pixels are not striped like _runPlanar
+    m_passBytes += m_planarNearScene.bytes() + m_planarNearVertical.bytes() + m_planarNearDiagonal.bytes();
+    const auto stride = m_planarNearScene.stride();
+    _resizePlanarScratch(stride);
+    const auto nearField = GetLineBlurKernel(m_isa, LineBlurFunction::NearField);
+    const auto premultiplied = GetLineBlurKernel(m_isa, LineBlurFunction::Premultiplied);
+
+    // both passes blur the pixels the dilated near CoC covers, in runs, and leave the others alone
+    const auto forCoveredRuns = [&](const size_t y, const auto& blurRun) {
+        const auto* coc = m_nearCoc.data() + y * width;
+        for (size_t x = 0; x < width;) {
+            for (; x < width && coc[x] <= 0.0f; ++x) {}
+            const auto begin = x;
+            for (; x < width && coc[x] > 0.0f; ++x) {}
+            if (x > begin)
+                blurRun(begin, x);
+        }
+    };
+
+    m_pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        m_planarNearScene.CopyRows(m_nearScene, begin, end);
+    });
+    m_pool.ParallelFor(height, [&](const size_t rowBegin, const size_t rowEnd, const unsigned thread) {
+        auto& scratch = m_planarScratch[thread];
+        auto* step = scratch.values.data();
+        auto* taps = scratch.taps.data();
+        const LineBlurOutput color2{step + stride, step + 2 * stride, step + 3 * stride, step + 4 * stride};
+        for (auto y = rowBegin; y < rowEnd; ++y) {
+            const LineBlurOutput color{m_planarNearVertical.row(Plane::R, y), m_planarNearVertical.row(Plane::G, y),
+                                       m_planarNearVertical.row(Plane::B, y), m_planarNearVertical.row(Plane::CoC, y)};
+            float* mean[] = {m_planarNearDiagonal.row(Plane::R, y), m_planarNearDiagonal.row(Plane::G, y),
+                             m_planarNearDiagonal.row(Plane::B, y), m_planarNearDiagonal.row(Plane::CoC, y)};
+            // no near field blur reaches past the dilated CoC, the second pass may read zeros there
+            for (auto* p : {color.r, color.g, color.b, color.coc, mean[0], mean[1], mean[2], mean[3]})
+                fill(p, p + width, 0.0f);
+            rowBlurSteps(params, samples, m_nearCoc.data() + y * width, width, taps, step);
+            forCoveredRuns(y, [&](const size_t x, const size_t end) {
+                nearField(m_planarNearScene, y, x, end, vertical, step, taps, nullptr, samples, color);
+                nearField(m_planarNearScene, y, x, end, diagonal, step, taps, nullptr, samples, color2);
+                for (auto i = x; i < end; ++i) {
+                    mean[0][i] = 0.5f * (color2.r[i] + color.r[i]);
+                    mean[1][i] = 0.5f * (color2.g[i] + color.g[i]);
+                    mean[2][i] = 0.5f * (color2.b[i] + color.b[i]);
+                    mean[3][i] = 0.5f * (color2.coc[i] + color.coc[i]);
+                }
+            });
+        }
+        m_planarNearVertical.PadRows(rowBegin, rowEnd);
+        m_planarNearDiagonal.PadRows(rowBegin, rowEnd);
+    });
+    m_pool.ParallelFor(height, [&](const size_t rowBegin, const size_t rowEnd, const unsigned thread) {
+        auto& scratch = m_planarScratch[thread];
+        auto* step = scratch.values.data();
+        auto* taps = scratch.taps.data();
+        auto* v = step + stride;
+        const LineBlurOutput color{v, v + stride, v + 2 * stride, v + 3 * stride};
+        const LineBlurOutput color2{v + 4 * stride, v + 5 * stride, v + 6 * stride, v + 7 * stride};
+        for (auto y = rowBegin; y < rowEnd; ++y) {
+            auto* outputRow = output.row(y);
+            rowBlurSteps(params, samples, m_nearCoc.data() + y * width, width, taps, step);
+            forCoveredRuns(y, [&](const size_t x, const size_t end) {
+                premultiplied(m_planarNearVertical, y, x, end, diagonal, step, taps, nullptr, samples, color);
+                premultiplied(m_planarNearDiagonal, y, x, end, diagonal2, step, taps, nullptr, samples, color2);
+                for (auto i = x; i < end; ++i) {
+                    const auto coverage = 0.5f * (color.coc[i] + color2.coc[i]);
+                    auto& out = outputRow[i];
+                    out = {0.5f * (color.r[i] + color2.r[i]) + (1.0f - coverage) * out.r,
+                           0.5f * (color.g[i] + color2.g[i]) + (1.0f - coverage) * out.g,
+                           0.5f * (color.b[i] + color2.b[i]) + (1.0f - coverage) * out.b, 1.0f};
+                }
+            });
+        }
+    });
+}
+
+template <typename BlurFunction>
+void BokehEngine::_firstPass(const Image& scene, const BokehParams& params, const BlurFunction& blur,
+                             const size_t rowBegin, const size_t rowEnd) {
+    const auto samples = sampleCount(params);
+    const auto vertical = m_aperture.hexagon().vertical;
+    const auto diagonal = m_aperture.hexagon().diagonal;
+    const auto* tiles = m_useTiles ? &m_tiles : nullptr;
+    const auto width = scene.width();
+    for (auto y = rowBegin; y < rowEnd; ++y) {
+        auto* verticalRow = m_verticalBlur.row(y);
+        auto* diagonalRow = m_diagonalBlur.row(y);
+        const auto* sceneRow = scene.row(y);
+        for (size_t x = 0; x < width;) {
+            size_t spanEnd;
+            const auto tileClass = tileSpan(tiles, x, y, width, spanEnd);
+            if (tileClass == TileClass::InFocus) {
+                // a zero CoC scales both blurs to zero
+                fill(verticalRow + x, verticalRow + spanEnd, Texel{});
+                fill(diagonalRow + x, diagonalRow + spanEnd, Texel{});
+                x = spanEnd;
+                continue;
+            }
+            const auto uniform = tileClass == TileClass::Uniform;
+            for (; x < spanEnd; ++x) {
+                const Vec2 uv{static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f};
+                const auto coc = params.cocFactor * sceneRow[x].a;
+                const auto steps = blurSteps(params, samples, coc);
+
+                // CoC-weighted vertical blur.
+                const auto color = blur(0, uv, vertical * steps.length, steps.taps, uniform);
+                const auto k = color.a * coc;
+
+                // CoC-weighted diagonal blur.
+                const auto color2 = blur(1, uv, diagonal * steps.length, steps.taps, uniform);
+                const auto k2 = color2.a * coc;
+
+                verticalRow[x] = {color.r * k, color.g * k, color.b * k, coc};
+                diagonalRow[x] = {
+                    0.5f * (color2.r * k2 + verticalRow[x].r),
+                    0.5f * (color2.g * k2 + verticalRow[x].g),
+                    0.5f * (color2.b * k2 + verticalRow[x].b),
+                    coc
+                };
+            }
+        }
+    }
+}
+
+template <typename BlurFunction>
+void BokehEngine::_secondPass(const Image& scene, Image& output, const BokehParams& params, const BlurFunction& blur,
+                              const size_t rowBegin, const size_t rowEnd) const {
+    const auto samples = sampleCount(params);
+    const auto diagonal = m_aperture.hexagon().diagonal;
+    const auto diagonal2 = m_aperture.hexagon().diagonal2;
+    const auto* tiles = m_useTiles ? &m_tiles : nullptr;
+    const auto width = scene.width();
+    for (auto y = rowBegin; y < rowEnd; ++y) {
+        auto* outputRow = output.row(y);
+        const auto* verticalRow = m_verticalBlur.row(y);
+        const auto* diagonalRow = m_diagonalBlur.row(y);
+        const auto* sceneRow = scene.row(y);
+        for (size_t x = 0; x < width;) {
+            size_t spanEnd;
+            const auto tileClass = tileSpan(tiles, x, y, width, spanEnd);
+            const auto uniform = tileClass == TileClass::Uniform;
+            for (; x < spanEnd; ++x) {
+                const auto coc = verticalRow[x].a;
+                const auto coc2 = diagonalRow[x].a;
+                if (tileClass == TileClass::InFocus || coc == 0.0f) {
+                    outputRow[x] = {sceneRow[x].r, sceneRow[x].g, sceneRow[x].b, 1.0f};
+                    continue;
+                }
+                const Vec2 uv{static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f};
+
+                const auto steps = blurSteps(params, samples, coc);
+                const auto steps2 = blurSteps(params, samples, coc2);
+                const auto color = blur(0, uv, diagonal * steps.length, steps.taps, uniform);
+                const auto color2 = blur(1, uv, diagonal2 * steps2.length, steps2.taps, uniform);
+                // the blur divides by the CoC it started from; a zero there would only produce inf
+                const auto k = color.a > 0.0f ? coc / color.a : 0.0f;
+                const auto k2 = color2.a > 0.0f ? coc2 / color2.a : 0.0f;
+
+                outputRow[x] = {
+                    0.5f * (color.r * k + color2.r * k2),
+                    0.5f * (color.g * k + color2.g * k2),
+                    0.5f * (color.b * k + color2.b * k2),
+                    1.0f
+                };
+            }
+        }
+    }
+}
+
+void BokehEngine::_runPlanar(const Image& scene, Image& output, const BokehParams& params) {
+    const auto width = scene.width();
+    const auto height = scene.height();
+    m_planarRowCoc.resize(height);
+    // the stochastic taps limit the CoC the first pass rescales with, see MaxStochasticRescale
+    const auto stochastic = params.mode == BlurMode::Stochastic;
+    const auto kernel = GetLineBlurKernel(m_isa);
+    const auto firstKernel = stochastic ? GetLineBlurKernel(m_isa, LineBlurFunction::StochasticTexture) : kernel;
+
+    m_pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            const auto* row = scene.row(y);
+            auto rowCoc = 0.0f;
+            for (size_t x = 0; x < width; ++x)
+                rowCoc = max(rowCoc, fabs(row[x].a));
+            m_planarRowCoc[y] = rowCoc;
+        }
+    });
+
+    // both passes reach at most the blur length of the largest CoC and one bilinear tap further, the stochastic taps
+    // included; a stripe of the second pass runs as soon as the first has finished the rows up to that reach below
+    // it, and a stripe of the first as soon as the planar copy of the scene has. Vector lanes that have taken all
+    // their taps repeat the last one, so no fetch leaves that reach while the rings overwrite rows beyond.
+    const auto maxCoc = height > 0 ? *max_element(m_planarRowCoc.begin(), m_planarRowCoc.end()) : 0.0f;
+    const auto blurLength = maxCoc * fabs(params.cocFactor) * static_cast<float>(sampleCount(params));
+    const auto reach = static_cast<size_t>(ceil(blurLength)) + 2;
+    const auto threads = static_cast<size_t>(m_pool.threadCount());
+    const auto stride = PlanarImage::Stride(width);
+    const auto rowBytes = 3 * PlanarImage::PlaneCount * stride * sizeof(float);
+    const auto budgetRows = RING_BYTES_PER_THREAD * threads / max<size_t>(rowBytes, 1);
+    const auto stripe = max(MIN_STRIPE_ROWS * threads, budgetRows > 2 * reach ? budgetRows / 2 - reach : 0);
+    // each stage writes the stripe after the rows the next one reads, so a ring holds two stripes and the reach on
+    // either side: the first pass writes while the second reads, the copy of the scene while the first reads
+    const auto ringRows = bit_ceil(2 * stripe + 2 * reach);
+    for (auto* image : {&m_planarScene, &m_planarVertical, &m_planarDiagonal}) {
+        if (ringRows < height) {
+            if (image->width() != width || image->height() != height || image->storedRows() != ringRows)
+                image->ResizeRing(width, height, ringRows);
+        } else if (image->width() != width || image->height() != height || image->rowMask() != ~size_t{0}) {
+            image->Resize(width, height);
+        }
+    }
+    m_passBytes += m_planarScene.bytes() + m_planarVertical.bytes() + m_planarDiagonal.bytes();
+
+    _resizePlanarScratch(stride);
+
+    // one barrier per stripe: the copy of the stripe after next, the first pass of the next stripe and the second
+    // pass of this one share a loop
+    auto copyEnd = min(height, 2 * stripe + 2 * reach);
+    m_pool.ParallelFor(copyEnd, [&](const size_t begin, const size_t end) {
+        m_planarScene.CopyRows(scene, begin, end);
+    });
+    auto firstEnd = min(height, stripe + reach);
+    m_pool.ParallelFor(firstEnd, [&](const size_t begin, const size_t end, const unsigned thread) {
+        _firstPassPlanar(params, firstKernel, m_planarScratch[thread], begin, end);
+    });
+    for (size_t stripeBegin = 0; stripeBegin < height; stripeBegin += stripe) {
+        const auto stripeEnd = min(height, stripeBegin + stripe);
+        const auto firstBegin = firstEnd;
+        firstEnd = min(height, stripeEnd + stripe + reach);
+        const auto copyBegin = copyEnd;
+        copyEnd = min(height, firstEnd + stripe + reach);
+        const auto copyRows = copyEnd - copyBegin;
+        const auto firstRows = firstEnd - firstBegin;
+        const auto secondRows = stripeEnd - stripeBegin;
+        m_pool.ParallelFor(copyRows + firstRows + secondRows, [&](const size_t begin, const size_t end,
+                                                                  const unsigned thread) {
+            auto& scratch = m_planarScratch[thread];
+            if (begin < copyRows)
+                m_planarScene.CopyRows(scene, copyBegin + begin, copyBegin + min(end, copyRows));
+            const auto firstFrom = max(begin, copyRows) - copyRows;
+            const auto firstTo = min(end, copyRows + firstRows) - min(end, copyRows);
+            if (firstFrom < firstTo)
+                _firstPassPlanar(params, firstKernel, scratch, firstBegin + firstFrom, firstBegin + firstTo);
+            if (end > copyRows + firstRows)
+                _secondPassPlanar(scene, output, params, kernel, scratch,
+                                  stripeBegin + max(begin, copyRows + firstRows) - copyRows - firstRows,
+                                  stripeBegin + end - copyRows - firstRows);
+        });
+    }
+}
+
+void BokehEngine::_runPolygon(const Image& scene, Image& output, const BokehParams& params) {
+    const auto width = scene.width();
+    const auto height = scene.height();
+    const auto samples = sampleCount(params);
+    const auto kernels = blurKernels(params, samples);
+    const auto& edges = m_aperture.edges();
+    const auto& lengths = m_aperture.edgeLengths();
+    const auto* tiles = m_useTiles ? &m_tiles : nullptr;
+    m_edgeBlurs.resize(edges.size() - 1);
+    for (auto& image : m_edgeBlurs) {
+        if (image.width() != width || image.height() != height)
+            image.Resize(width, height);
+        m_passBytes += imageBytes(image);
+    }
+
+    m_pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            const auto* sceneRow = scene.row(y);
+            for (size_t x = 0; x < width;) {
+                size_t spanEnd;
+                const auto tileClass = tileSpan(tiles, x, y, width, spanEnd);
+                const auto uniform = tileClass == TileClass::Uniform;
+                for (; x < spanEnd; ++x) {
+                    if (tileClass == TileClass::InFocus) {
+                        // a zero CoC scales all blurs to zero
+                        for (auto& image : m_edgeBlurs)
+                            image.at(x, y) = Texel{};
+                        continue;
+                    }
+                    const Vec2 uv{static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f};
+                    const auto coc = params.cocFactor * sceneRow[x].a;
+                    for (size_t k = 0; k < m_edgeBlurs.size(); ++k) {
+                        // edge k is lengths[k] circumradii of coc * samples pixels long
+                        const auto steps = blurSteps(params, samples, coc * lengths[k]);
+                        const auto step = edges[k] * steps.length;
+                        const auto color = uniform ? kernels.uniform(scene, uv, step, steps.taps, samples)
+                                                   : kernels.blur(scene, uv, step, steps.taps, samples);
+                        const auto weight = color.a * coc;
+                        m_edgeBlurs[k].at(x, y) = {color.r * weight, color.g * weight, color.b * weight, coc};
+                    }
+                }
+            }
+        }
+    });
+
+    for (auto& image : m_edgeBlurs)
+        _storeIntermediate(image, params);
+
+    m_pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            auto* outputRow = output.row(y);
+            const auto* sceneRow = scene.row(y);
+            for (size_t x = 0; x < width;) {
+                size_t spanEnd;
+                const auto tileClass = tileSpan(tiles, x, y, width, spanEnd);
+                const auto uniform = tileClass == TileClass::Uniform;
+                for (; x < spanEnd; ++x) {
+                    const auto coc = m_edgeBlurs[0].at(x, y).a;
+                    if (tileClass == TileClass::InFocus || coc == 0.0f) {
+                        outputRow[x] = {sceneRow[x].r, sceneRow[x].g, sceneRow[x].b, 1.0f};
+                        continue;
+                    }
+                    const Vec2 uv{static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f};
+                    const auto radius = coc * static_cast<float>(samples);
+                    Texel sum{};
+                    for (const auto& rhombus : m_aperture.rhombi()) {
+                        const auto& tex = m_edgeBlurs[rhombus.first];
+                        const auto steps = blurSteps(params, samples, coc * lengths[rhombus.second]);
+                        const auto start = uv + rhombus.offset * radius;
+                        const auto step = edges[rhombus.second] * steps.length;
+                        const auto color = uniform ? kernels.uniform(tex, start, step, steps.taps, samples)
+                                                   : kernels.blur(tex, start, step, steps.taps, samples);
+                        // the blur divides by the CoC it started from; a zero there would only produce inf
+                        const auto k = color.a > 0.0f ? coc / color.a : 0.0f;
+                        sum += color * (k * rhombus.weight);
+                    }
+                    outputRow[x] = {sum.r, sum.g, sum.b, 1.0f};
+                }
+            }
+        }
+    });
+}
+
+void BokehEngine::_resizePlanarScratch(const size_t stride) {
+    m_planarScratch.resize(static_cast<size_t>(m_pool.threadCount()));
+    for (auto& scratch : m_planarScratch) {
+        scratch.values.resize(stride * 12);
+        scratch.taps.resize(stride * 2);
+    }
+}
+
+void BokehEngine::_firstPassPlanar(const BokehParams& params, const LineBlurKernel kernel, PlanarScratch& scratch,
+                                   const size_t rowBegin, const size_t rowEnd) {
+    using Plane = PlanarImage::Plane;
+    const auto samples = sampleCount(params);
+    const auto vertical = m_aperture.hexagon().vertical;
+    const auto diagonal = m_aperture.hexagon().diagonal;
+    const auto width = m_planarScene.width();
+    const auto stride = m_planarScene.stride();
+    auto* coc = scratch.values.data();
+    auto* step = coc + stride;
+    auto* taps = scratch.taps.data();
+    const LineBlurOutput color{coc + 2 * stride, coc + 3 * stride, coc + 4 * stride, coc + 5 * stride};
+    const LineBlurOutput color2{coc + 6 * stride, coc + 7 * stride, coc + 8 * stride, coc + 9 * stride};
+    const auto stochastic = params.mode == BlurMode::Stochastic;
+    auto* first = stochastic ? coc + 10 * stride : nullptr;
+    const auto* tiles = m_useTiles ? &m_tiles : nullptr;
+    for (auto y = rowBegin; y < rowEnd; ++y) {
+        const auto* sceneCoc = m_planarScene.row(Plane::CoC, y);
+        for (size_t x = 0; x < width; ++x)
+            coc[x] = params.cocFactor * sceneCoc[x];
+        rowBlurSteps(params, samples, coc, width, taps, step);
+        if (stochastic)
+            rowStochasticTaps(params, 0, y, width, taps, step, first);
+
+        auto* vr = m_planarVertical.row(Plane::R, y);
+        auto* vg = m_planarVertical.row(Plane::G, y);
+        auto* vb = m_planarVertical.row(Plane::B, y);
+        auto* vc = m_planarVertical.row(Plane::CoC, y);
+        auto* dr = m_planarDiagonal.row(Plane::R, y);
+        auto* dg = m_planarDiagonal.row(Plane::G, y);
+        auto* db = m_planarDiagonal.row(Plane::B, y);
+        auto* dc = m_planarDiagonal.row(Plane::CoC, y);
+        for (size_t x = 0; x < width;) {
+            const auto end = focusRunEnd(tiles, x, y, width);
+            if (tiles && tiles->atPixel(x, y) == TileClass::InFocus) {
+                // a zero CoC scales both blurs to zero
+                for (auto* p : {vr, vg, vb, vc, dr, dg, db, dc})
+                    fill(p + x, p + end, 0.0f);
+                x = end;
+                continue;
+            }
+            // uniform tiles have no separate kernel, equal weights cost nothing extra in the vectorized loops
+            kernel(m_planarScene, y, x, end, vertical, step, taps, first, samples, color);
+            kernel(m_planarScene, y, x, end, diagonal, step, taps, first, samples, color2);
+            for (; x < end; ++x) {
+                const auto k = color.coc[x] * coc[x];
+                const auto k2 = color2.coc[x] * coc[x];
+                vr[x] = color.r[x] * k;
+                vg[x] = color.g[x] * k;
+                vb[x] = color.b[x] * k;
+                vc[x] = coc[x];
+                dr[x] = 0.5f * (color2.r[x] * k2 + vr[x]);
+                dg[x] = 0.5f * (color2.g[x] * k2 + vg[x]);
+                db[x] = 0.5f * (color2.b[x] * k2 + vb[x]);
+                dc[x] = coc[x];
+            }
+        }
+    }
+    m_planarVertical.PadRows(rowBegin, rowEnd);
+    m_planarDiagonal.PadRows(rowBegin, rowEnd);
+}
+
+void BokehEngine::_secondPassPlanar(const Image& scene, Image& output, const BokehParams& params,
+                                    const LineBlurKernel kernel, PlanarScratch& scratch, const size_t rowBegin,
+                                    const size_t rowEnd) const {
+    using Plane = PlanarImage::Plane;
+    const auto samples = sampleCount(params);
+    const auto diagonal = m_aperture.hexagon().diagonal;
+    const auto diagonal2 = m_aperture.hexagon().diagonal2;
+    const auto width = m_planarScene.width();
+    const auto stride = m_planarScene.stride();
+    auto* step = scratch.values.data();
+    auto* step2 = step + stride;
+    auto* taps = scratch.taps.data();
+    auto* taps2 = taps + stride;
+    const LineBlurOutput color{step + 2 * stride, step + 3 * stride, step + 4 * stride, step + 5 * stride};
+    const LineBlurOutput color2{step + 6 * stride, step + 7 * stride, step + 8 * stride, step + 9 * stride};
+    // both blurs of a pixel share its jitter, as in _runStochastic
+    const auto stochastic = params.mode == BlurMode::Stochastic;
+    auto* first = stochastic ? step + 10 * stride : nullptr;
+    auto* first2 = stochastic ? step + 11 * stride : nullptr;
+    const auto* tiles = m_useTiles ? &m_tiles : nullptr;
+    for (auto y = rowBegin; y < rowEnd; ++y) {
+        const auto* coc = m_planarVertical.row(Plane::CoC, y);
+        const auto* coc2 = m_planarDiagonal.row(Plane::CoC, y);
+        rowBlurSteps(params, samples, coc, width, taps, step);
+        rowBlurSteps(params, samples, coc2, width, taps2, step2);
+        if (stochastic) {
+            rowStochasticTaps(params, 1, y, width, taps, step, first);
+            rowStochasticTaps(params, 1, y, width, taps2, step2, first2);
+        }
+        auto* outputRow = output.row(y);
+        const auto* sceneRow = scene.row(y);
+        for (size_t x = 0; x < width;) {
+            const auto end = focusRunEnd(tiles, x, y, width);
+            if (tiles && tiles->atPixel(x, y) == TileClass::InFocus) {
+                for (; x < end; ++x)
+                    outputRow[x] = {sceneRow[x].r, sceneRow[x].g, sceneRow[x].b, 1.0f};
+                continue;
+            }
+            kernel(m_planarVertical, y, x, end, diagonal, step, taps, first, samples, color);
+            kernel(m_planarDiagonal, y, x, end, diagonal2, step2, taps2, first2, samples, color2);
+            for (; x < end; ++x) {
+                if (coc[x] == 0.0f) {
+                    outputRow[x] = {sceneRow[x].r, sceneRow[x].g, sceneRow[x].b, 1.0f};
+                    continue;
+                }
+                const auto k = color.coc[x] > 0.0f ? coc[x] / color.coc[x] : 0.0f;
+                const auto k2 = color2.coc[x] > 0.0f ? coc2[x] / color2.coc[x] : 0.0f;
+                outputRow[x] = {
+                    0.5f * (color.r[x] * k + color2.r[x] * k2),
+                    0.5f * (color.g[x] * k + color2.g[x] * k2),
+                    0.5f * (color.b[x] * k + color2.b[x] * k2),
+                    1.0f
+                };
+            }
+        }
+    }
+}
@@ -0,0 +1,243 @@
+#pragma once
+#include "aperture.h"
+#include "blurFormat.h"
+#include "cocTiles.h"
+#include "denoise.h"
+#include "depthSlices.h"
+#include "fftConvolution.h"
+#include "highlights.h"
+#include "image.h"
+#include "lineIntegral.h"
+#include "lineKernels.h"
+#include "maxFilter.h"
+#include "mipPyramid.h"
+#include "planarImage.h"
+#include "threadPool.h"
+
+namespace mini::bokeh {
+    enum class BlurMode {
+        //NUM_SAMPLES bilinear taps per pixel and direction, as in the shaders.
+        Gather,
+        //Box blurs evaluated from running sums along the blur directions; cost does not depend on NUM_SAMPLES.
+        //Hexagon only.
+        PrefixSum,
+        //Cheap fallback of bokehMipPS: one trilinear fetch from a mip chain of the scene, at the level whose texels
+        //are as wide as the blur. Square-ish instead of the aperture, so hexagon only, and ignores classifyTiles.
+        MipPyramid,
+        //Final quality for very large apertures: CoC layers convolved with the aperture through FFTs, see
+        //FftConvolution. Handles the near field itself and ignores classifyTiles, scatterHighlights and the
+        //intermediate format.
+        Convolution,
+        //Predictable cost for any CoC layout: depth slices blurred with one CoC each and composited, see
+        //DepthSlices. Slices by the depth given to Run, or by the CoC without it. Like Convolution it handles the near
+        //field itself and ignores classifyTiles, scatterHighlights and the intermediate format.
+        DepthSlices,
+        //Preview quality at a fixed cost: every blur takes stochasticTaps jittered taps of the gather, one in each of
+        //as many strata, and BokehDenoiser smooths out the noise, see stochastic_taps in temporal.hlsli. Hexagon
+        //only, like PrefixSum.
+        Stochastic
+    };
+
+    //angle, cocFactor and numSamples have the same meaning as the angle, coc_factor and NUM_SAMPLES variables of
+    //the bokeh shaders.
+    struct BokehParams {
+        float angle = 0.0f;
+        float cocFactor = 1.0f;
+        float numSamples = 16.0f;
+        //Taps per pixel of blur length, as the sample_density shader variable. At 1 a CoC of 1 keeps numSamples taps
+        //and smaller CoCs take proportionally fewer; 0 takes numSamples taps for every CoC.
+        float sampleDensity = 1.0f;
+        //Upper bound of the taps per blur, as max_samples.
+        float maxSamples = 32.0f;
+        //Sides of the aperture polygon, as aperture_sides: 5 to 10. Six give the hexagon of the two default
+        //passes. The others blur the polygon of Aperture with the per-texel gather, with tiles and the
+        //intermediate format but without the vector kernels of isa; BlurMode::Convolution and DepthSlices draw them
+        //too, and the other modes throw std::invalid_argument.
+        int sides = 6;
+        BlurMode mode = BlurMode::Gather;
+        //Skip the blurs in tiles that are entirely in focus and drop the CoC weighting where it is constant.
+        bool classifyTiles = true;
+        //Treat negative CoCs as the near field, in front of the focus plane. The scene is blurred with the absolute
+        //CoC as usual, and the near field is also gathered into a separate layer that spreads past the edges of
+        //foreground objects. That layer is composited over the result with premultiplied alpha. Each pixel gathers
+        //it over the largest near CoC around it, found with MaxFilter. The shaders use the largest near CoC around
+        //the pixel's tile instead.
+        bool separateNearField = false;
+        //Draw pixels brighter than highlightThreshold, as luminance, as aperture sprites with HighlightScatter
+        //when their blur radius is at least highlightMinRadius pixels. The gather gets them clamped to the threshold,
+        //so it needs fewer taps to keep the rest smooth and sampleDensity can be lowered. As highlight_scatter,
+        //highlight_threshold and highlight_min_radius, which the shaders compare against full resolution pixels of the
+        //linear scene.
+        bool scatterHighlights = false;
+        float highlightThreshold = 4.0f;
+        float highlightMinRadius = 4.0f;
+        //Storage of the images between the two passes, which are rounded to it as the GPU targets would be. Other
+        //formats than Float32 take the per-texel path instead of the vectorized one; the near field layer stays
+        //in floats.
+        BlurFormat intermediateFormat = BlurFormat::Float32;
+        CocPlane cocPlane = CocPlane::R16;
+        //CoC layers on each side of the focus of BlurMode::Convolution; every layer costs five 2D FFTs.
+        int convolutionLayers = 8;
+        //Slices of BlurMode::DepthSlices over the depth range of the frame; every slice costs one box blur per edge
+        //of the polygon.
+        int depthSlices = 12;
+        //Taps of every blur of BlurMode::Stochastic, its one knob of quality against cost; blurs of fewer taps take
+        //them all and are not denoised.
+        int stochasticTaps = 4;
+        //Frame of a sequence, which rotates the jitter of the stochastic taps, as stochastic_frame.
+        unsigned frame = 0;
+    };
+
+    //What storing the intermediates in a format costs, from BokehEngine::MeasureFormat.
+    struct FormatReport {
+        BlurFormat format;
+        CocPlane cocPlane;
+        //Colour and CoC bytes per pixel of one intermediate image.
+        double bytesPerPixel;
+        //Error of the first intermediate and of the final output against Float32 intermediates.
+        ImageError intermediate;
+        ImageError output;
+    };
+
+    //Two-pass hexagonal bokeh blur on the CPU. The first pass blurs the scene vertically and diagonally into two
+    //intermediate images (the MRT targets of bokeh1PS), the second blurs both along the remaining diagonals and
+    //averages them (bokeh2PS). Each pass is split into row bands executed on a thread pool.
+    //In gather mode with Isa::Scalar the engine runs the per-texel reference path, otherwise it works on planar
+    //copies of the images with the vectorized line kernels. Prefix-sum and stochastic modes always use the per-texel
+    //path.
+    class BokehEngine {
+    public:
+        //threadCount == 0 uses all hardware threads.
+        explicit BokehEngine(unsigned threadCount = 0) : m_pool(threadCount), m_isa(DetectIsa()) {}
+
+        //scene holds colour in rgb and CoC in a, negative in the near field with BokehParams::separateNearField.
+        //output is resized to match scene and gets alpha 1.
+        void Run(const Image& scene, Image& output, const BokehParams& params);
+
+        //Run with the distance of every pixel of scene, row by row, which BlurMode::DepthSlices cuts into slices.
+        //The other modes only use the CoC.
+        void Run(const Image& scene, const std::vector<float>& depth, Image& output, const BokehParams& params);
+
+        [[nodiscard]] Isa isa() const noexcept { return m_isa; }
+
+        void SetIsa(const Isa isa) noexcept { m_isa = isa; }
+
+        [[nodiscard]] ThreadPool& pool() noexcept { return m_pool; }
+
+        //Bytes of the images the last Run kept between its two blur passes: the blurs of the first pass, the
+        //planar copy of the scene the line kernels read, and the same for the near field. 0 for MipPyramid,
+        //Convolution and DepthSlices, which do not blur in two passes.
+        [[nodiscard]] size_t passBytes() const noexcept { return m_passBytes; }
+
+        //Aperture picture of BlurMode::Convolution in place of the polygon of BokehParams::sides.
+        void SetApertureMask(ApertureMask mask) { m_convolution.SetMask(std::move(mask)); }
+
+        void ClearApertureMask() { m_convolution.ClearMask(); }
+
+        //Runs scene with Float32 intermediates and with params.intermediateFormat and compares the two. Leaves
+        //the output of the second run in output.
+        FormatReport MeasureFormat(const Image& scene, Image& output, const BokehParams& params);
+
+    private:
+        void _run(const Image& scene, Image& output, const BokehParams& params);
+
+        //Splits scene into m_farScene with the absolute CoC and m_nearScene with the scaled near CoC, and dilates
+        //the near CoC into m_nearCoc.
+        void _splitNearField(const Image& scene, const BokehParams& params);
+
+        //Gathers the near field layer and composites it over output.
+        void _compositeNearField(Image& output, const BokehParams& params);
+
+        //_compositeNearField of the hexagon with the vectorized kernels on planar copies of the layer.
+        void _compositeNearFieldPlanar(Image& output, const BokehParams& params);
+
+        //blur(i, uv, step, taps, uniform) returns the result of a BlurTexture-like blur of the first (i == 0) or
+        //second image; uniform is set inside TileClass::Uniform tiles.
+        template <typename BlurFunction>
+        void _firstPass(const Image& scene, const BokehParams& params, const BlurFunction& blur, size_t rowBegin,
+                        size_t rowEnd);
+
+        template <typename BlurFunction>
+        void _secondPass(const Image& scene, Image& output, const BokehParams& params, const BlurFunction& blur,
+                         size_t rowBegin, size_t rowEnd) const;
+
+        void _runGather(const Image& scene, Image& output, const BokehParams& params);
+
+        void _runPrefixSum(const Image& scene, Image& output, const BokehParams& params);
+
+        //The gather with the stochastic taps; Run denoises the result.
+        void _runStochastic(const Image& scene, Image& output, const BokehParams& params);
+
+        //Rounds an intermediate image to params.intermediateFormat between the passes.
+        void _storeIntermediate(Image& image, const BokehParams& params);
+
+        //The first image between the passes, of the hexagon or of the polygon last run.
+        [[nodiscard]] const Image& _firstIntermediate() const noexcept;
+
+        void _runMipPyramid(const Image& scene, Image& output, const BokehParams& params);
+
+        void _runConvolution(const Image& scene, Image& output, const BokehParams& params);
+
+        void _runDepthSlices(const Image& scene, const std::vector<float>& depth, Image& output,
+                             const BokehParams& params);
+
+        //The hexagon on planar images with the vectorized kernels, in horizontal stripes: the planar copy of the
+        //scene and the intermediates are rings of rows, in which the copy runs ahead of the first pass and the first
+        //pass ahead of the second by the reach of the largest CoC. Takes the gather or its stochastic taps.
+        void _runPlanar(const Image& scene, Image& output, const BokehParams& params);
+
+        //Both passes for the polygons of m_aperture other than the hexagon: the first blurs the scene along every
+        //edge but the last, the second blurs those along the other edge of each rhombus.
+        void _runPolygon(const Image& scene, Image& output, const BokehParams& params);
+
+        //Rows the planar passes work in between the kernels: CoCs, step lengths, tap counts, the offsets of the
+        //stochastic taps and the blurs.
+        struct PlanarScratch {
+            std::vector<float> values;
+            std::vector<int> taps;
+        };
+
+        //Sizes m_planarScratch for rows of stride floats, one per thread.
+        void _resizePlanarScratch(size_t stride);
+
+        void _firstPassPlanar(const BokehParams& params, LineBlurKernel kernel, PlanarScratch& scratch,
+                              size_t rowBegin, size_t rowEnd);
+
+        void _secondPassPlanar(const Image& scene, Image& output, const BokehParams& params, LineBlurKernel kernel,
+                               PlanarScratch& scratch, size_t rowBegin, size_t rowEnd) const;
+
+        ThreadPool m_pool;
+        Isa m_isa;
+        size_t m_passBytes = 0;
+        Image m_verticalBlur;
+        Image m_diagonalBlur;
+        PlanarImage m_planarScene;
+        PlanarImage m_planarVertical;
+        PlanarImage m_planarDiagonal;
+        std::vector<float> m_planarRowCoc;
+        //One per thread of m_pool.
+        std::vector<PlanarScratch> m_planarScratch;
+        LineIntegral m_lines[2];
+        CocTiles m_tiles;
+        bool m_useTiles = false;
+        Image m_farScene;
+        Image m_nearScene;
+        Image m_nearVertical;
+        Image m_nearDiagonal;
+        std::vector<float> m_nearCoc;
+        PlanarImage m_planarNearScene;
+        PlanarImage m_planarNearVertical;
+        PlanarImage m_planarNearDiagonal;
+        MaxFilter m_maxFilter;
+        Aperture m_aperture;
+        std::vector<Image> m_edgeBlurs;
+        std::vector<Image> m_nearEdgeBlurs;
+        HighlightScatter m_highlights;
+        Image m_gatherScene;
+        MipPyramid m_mips;
+        FftConvolution m_convolution;
+        DepthSlices m_slices;
+        PackedImage m_packed;
+        BokehDenoiser m_denoiser;
+    };
+}
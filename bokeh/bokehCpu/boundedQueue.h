@@ -0,0 +1,70 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace mini::bokeh {
+    //Queue between two threads holding at most capacity items. A full queue blocks the producer, so a fast stage
+    //waits for a slow one instead of piling up frames.
+    template <typename T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(const size_t capacity) : m_capacity(capacity > 0 ? capacity : 1) {}
+
+        //Blocks while the queue is full. Returns false and drops item if the queue was closed.
+        bool Push(T item) {
+            std::unique_lock lock(m_mutex);
+            m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+            if (m_closed)
+                return false;
+            m_items.push_back(std::move(item));
+            lock.unlock();
+            m_notEmpty.notify_one();
+            return true;
+        }
+
+        //Blocks until an item arrives. Returns false once the queue is closed and empty.
+        bool Pop(T& item) {
+            std::unique_lock lock(m_mutex);
+            m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+            if (m_items.empty())
+                return false;
+            item = std::move(m_items.front());
+            m_items.pop_front();
+            lock.unlock();
+            m_notFull.notify_one();
+            return true;
+        }
+
+        //No more pushes; the items already queued can still be popped.
+        void Close() {
+            {
+                std::lock_guard lock(m_mutex);
+                m_closed = true;
+            }
+            m_notFull.notify_all();
+            m_notEmpty.notify_all();
+        }
+
+        //Closes the queue and drops its items, to stop both ends after an error.
+        void Cancel() {
+            {
+                std::lock_guard lock(m_mutex);
+                m_closed = true;
+                m_items.clear();
+            }
+            m_notFull.notify_all();
+            m_notEmpty.notify_all();
+        }
+
+    private:
+        const size_t m_capacity;
+        std::mutex m_mutex;
+        std::condition_variable m_notFull;
+        std::condition_variable m_notEmpty;
+        std::deque<T> m_items;
+        bool m_closed = false;
+    };
+}
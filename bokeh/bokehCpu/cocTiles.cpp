@@ -0,0 +1,57 @@
+#include "cocTiles.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+void CocTiles::Build(const Image& scene, const float cocFactor, const int numSamples, ThreadPool& pool) {
+    const auto width = scene.width();
+    const auto height = scene.height();
+    m_columns = (width + TileSize - 1) / TileSize;
+    m_rows = (height + TileSize - 1) / TileSize;
+    const auto count = m_columns * m_rows;
+    m_min.resize(count);
+    m_max.resize(count);
+    m_classes.resize(count);
+    if (count == 0)
+        return;
+
+    pool.ParallelFor(m_rows, [&](const size_t begin, const size_t end) {
+        for (auto ty = begin; ty < end; ++ty)
+            for (size_t tx = 0; tx < m_columns; ++tx) {
+                auto minCoc = INFINITY;
+                auto maxCoc = -INFINITY;
+                const auto yEnd = min(height, (ty + 1) * TileSize);
+                const auto xEnd = min(width, (tx + 1) * TileSize);
+                for (auto y = ty * TileSize; y < yEnd; ++y) {
+                    const auto* row = scene.row(y);
+                    for (auto x = tx * TileSize; x < xEnd; ++x) {
+                        const auto coc = cocFactor * row[x].a;
+                        minCoc = min(minCoc, coc);
+                        maxCoc = max(maxCoc, coc);
+                    }
+                }
+                m_min[ty * m_columns + tx] = minCoc;
+                m_max[ty * m_columns + tx] = maxCoc;
+            }
+    });
+
+    const auto maxCoc = *max_element(m_max.begin(), m_max.end());
+    // the taps of a blur stay within numSamples * maxCoc pixels however many of them it takes, and the bilinear
+    // footprint of the last one reaches one pixel further
+    const auto reach = max(0.0f, maxCoc) * static_cast<float>(max(0, numSamples)) + 1.0f;
+    const auto radius = static_cast<size_t>(ceil(reach / static_cast<float>(TileSize)));
+    m_reachMin = m_min;
+    m_reachMax = m_max;
+    m_filter.ApplyMin(m_reachMin, m_columns, m_rows, radius, pool);
+    m_filter.Apply(m_reachMax, m_columns, m_rows, radius, pool);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (m_max[i] == 0.0f)
+            m_classes[i] = TileClass::InFocus;
+        else
+            m_classes[i] = m_reachMin[i] == m_reachMax[i] ? TileClass::Uniform : TileClass::Mixed;
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "image.h"
+#include "maxFilter.h"
+#include "threadPool.h"
+#include <cstdint>
+
+namespace mini::bokeh {
+    enum class TileClass : std::uint8_t {
+        //Every CoC in the tile is zero; both passes reduce to copying the scene.
+        InFocus,
+        //Every CoC the blurs of the tile can reach is the same, so all taps have equal weights.
+        Uniform,
+        //Needs the full CoC-weighted blur.
+        Mixed
+    };
+
+    //Per-tile classification of the scene CoC, the CPU counterpart of the cocTilesPS/cocTilesDilatePS passes.
+    //Tiles are reduced to their CoC range first; the Uniform test then looks at all tiles within the longest blur
+    //any pixel of the frame can do, a neighbourhood gathered with MaxFilter at a cost independent of its size.
+    class CocTiles {
+    public:
+        static constexpr size_t TileSize = 16;
+
+        //cocFactor and numSamples as in BokehParams, numSamples already rounded up like in the blur loops.
+        void Build(const Image& scene, float cocFactor, int numSamples, ThreadPool& pool);
+
+        [[nodiscard]] size_t columns() const noexcept { return m_columns; }
+
+        [[nodiscard]] size_t rows() const noexcept { return m_rows; }
+
+        [[nodiscard]] TileClass at(const size_t column, const size_t row) const noexcept {
+            return m_classes[row * m_columns + column];
+        }
+
+        //Class of the tile containing pixel (x, y).
+        [[nodiscard]] TileClass atPixel(const size_t x, const size_t y) const noexcept {
+            return at(x / TileSize, y / TileSize);
+        }
+
+    private:
+        size_t m_columns = 0;
+        size_t m_rows = 0;
+        //Smallest and largest CoC of every tile, then of its neighbourhood.
+        std::vector<float> m_min;
+        std::vector<float> m_max;
+        std::vector<float> m_reachMin;
+        std::vector<float> m_reachMax;
+        std::vector<TileClass> m_classes;
+        MaxFilter m_filter;
+    };
+}
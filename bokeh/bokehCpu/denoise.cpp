@@ -0,0 +1,96 @@
+#include "denoise.h"
+#include "blurKernel.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    //How fast the weight of a neighbour falls off with its CoC and relative depth difference from the pixel; a
+    //difference of 1 / SHARPNESS drops it. The same as in bokehTemporalPS.
+    constexpr float COC_SHARPNESS = 8.0f;
+    constexpr float DEPTH_SHARPNESS = 16.0f;
+
+    //Weights of the 5 taps of either pass.
+    constexpr float B3[5] = {1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f};
+
+    size_t clampIndex(const long i, const size_t size) noexcept {
+        if (i < 0)
+            return 0;
+        return static_cast<size_t>(i) < size ? static_cast<size_t>(i) : size - 1;
+    }
+}
+
+void BokehDenoiser::_filter(const Image& in, Image& out, const vector<float>& depth, const bool vertical,
+                            ThreadPool& pool) const {
+    const auto width = in.width();
+    const auto height = in.height();
+    const auto hasDepth = depth.size() == width * height;
+    pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            const auto* inRow = in.row(y);
+            auto* outRow = out.row(y);
+            for (size_t x = 0; x < width; ++x) {
+                const auto i = y * width + x;
+                const auto [inner, outer] = m_offsets[i];
+                if (outer == 0) {
+                    outRow[x] = inRow[x];
+                    continue;
+                }
+                const auto coc = m_coc[i];
+                const auto distance = hasDepth ? depth[i] : 0.0f;
+                const auto depthSharpness = distance > 0.0f ? DEPTH_SHARPNESS / distance : 0.0f;
+                const long offsets[] = {-outer, -inner, 0, inner, outer};
+                // the centre always matches itself, so weights > 0
+                auto sum = inRow[x] * B3[2];
+                auto weights = B3[2];
+                for (int k = 0; k < 5; ++k) {
+                    if (k == 2)
+                        continue;
+                    const auto tx = vertical ? x : clampIndex(static_cast<long>(x) + offsets[k], width);
+                    const auto ty = vertical ? clampIndex(static_cast<long>(y) + offsets[k], height) : y;
+                    const auto tap = ty * width + tx;
+                    auto weight = B3[k] * clamp(1.0f - COC_SHARPNESS * fabs(m_coc[tap] - coc), 0.0f, 1.0f);
+                    if (hasDepth && distance > 0.0f)
+                        weight *= clamp(1.0f - depthSharpness * fabs(depth[tap] - distance), 0.0f, 1.0f);
+                    sum += in.row(ty)[tx] * weight;
+                    weights += weight;
+                }
+                const auto k = 1.0f / weights;
+                outRow[x] = {sum.r * k, sum.g * k, sum.b * k, inRow[x].a};
+            }
+        }
+    });
+}
+
+void BokehDenoiser::Run(Image& image, const Image& guide, const vector<float>& depth, const DenoiseSettings& settings,
+                        ThreadPool& pool) {
+    const auto width = image.width();
+    const auto height = image.height();
+    if (m_rows.width() != width || m_rows.height() != height)
+        m_rows.Resize(width, height);
+    m_coc.resize(width * height);
+    m_offsets.resize(width * height);
+    const auto taps = max(settings.taps, 1);
+    // four spacings span two strata of coc * blurLength / taps pixels
+    const auto spacing = 0.5f * static_cast<float>(settings.blurLength) / static_cast<float>(taps);
+    pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            const auto* guideRow = guide.row(y);
+            for (size_t x = 0; x < width; ++x) {
+                const auto i = y * width + x;
+                const auto coc = settings.cocFactor * fabs(guideRow[x].a);
+                m_coc[i] = coc;
+                const auto samples = SampleCount(coc, settings.blurLength, settings.sampleDensity,
+                                                 settings.maxSamples);
+                // blurs that took every tap have no noise; the offsets are >= 0, so truncating rounds like lround
+                const auto offset = samples > taps ? coc * spacing : 0.0f;
+                m_offsets[i] = {static_cast<long>(offset + 0.5f), static_cast<long>(2.0f * offset + 0.5f)};
+            }
+        }
+    });
+    _filter(image, m_rows, depth, false, pool);
+    _filter(m_rows, image, depth, true, pool);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "image.h"
+#include "threadPool.h"
+#include <vector>
+
+namespace mini::bokeh {
+    //The blur the denoiser follows, as the BokehParams it ran with.
+    struct DenoiseSettings {
+        float cocFactor = 1.0f;
+        //Steps of the blur of a CoC of 1, numSamples rounded up.
+        int blurLength = 16;
+        float sampleDensity = 1.0f;
+        int maxSamples = 32;
+        //Stochastic taps of every blur, as BokehParams::stochasticTaps.
+        int taps = 4;
+    };
+
+    //Cheap edge-aware filter for the noise of the stochastic taps, the CPU counterpart of bokehDenoisePS. Pixels
+    //whose blurs took every tap are left alone. The others average 5 neighbours along the rows and then 5 along the
+    //columns with B3-spline weights, spaced to span two strata of their blur: the noise comes from where a tap
+    //landed within its stratum, and the extra blur stays well inside the bokeh. Neighbours are weighted down by
+    //their difference in CoC and depth from the pixel, as the temporal pass weights its history, so the filter does
+    //not pull colour across the silhouettes of objects at another distance.
+    class BokehDenoiser {
+    public:
+        //Filters the colour of image in place. guide holds the CoC of the blurred scene in alpha; depth, if not
+        //empty, the distance of every pixel, row by row.
+        void Run(Image& image, const Image& guide, const std::vector<float>& depth, const DenoiseSettings& settings,
+                 ThreadPool& pool);
+
+    private:
+        //Offsets of the inner and outer neighbours on either side of a pixel, both 0 for pixels left alone.
+        struct TapOffsets {
+            long inner;
+            long outer;
+        };
+
+        //One pass of 5 taps along rows or columns from in into out.
+        void _filter(const Image& in, Image& out, const std::vector<float>& depth, bool vertical,
+                     ThreadPool& pool) const;
+
+        //Result of the pass along the rows.
+        Image m_rows;
+        //CoC of every pixel of the guide, scaled by DenoiseSettings::cocFactor, and the offsets of its taps; both
+        //passes share them.
+        std::vector<float> m_coc;
+        std::vector<TapOffsets> m_offsets;
+    };
+}
@@ -0,0 +1,188 @@
+#include "depthSlices.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    //Closest distance taken from the depth plane, so empty or broken depth stays finite in inverse depth.
+    constexpr float MIN_DEPTH = 1e-6f;
+}
+
+void DepthSlices::_slicePositions(const Image& scene, const vector<float>& depth, const SliceSettings& settings,
+                                  const int slices, ThreadPool& pool) {
+    const auto width = scene.width();
+    const auto height = scene.height();
+    const auto last = static_cast<float>(slices - 1);
+    m_positions.resize(width * height);
+    if (depth.empty()) {
+        pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+            for (auto y = begin; y < end; ++y) {
+                const auto* row = scene.row(y);
+                auto* positions = m_positions.data() + y * width;
+                for (size_t x = 0; x < width; ++x) {
+                    const auto coc = row[x].a;
+                    const auto t = settings.nearField ? (clamp(coc, -1.0f, 1.0f) + 1.0f) * 0.5f : min(fabs(coc), 1.0f);
+                    positions[x] = t * last;
+                }
+            }
+        });
+        return;
+    }
+
+    const auto [nearest, farthest] = minmax_element(depth.begin(), depth.end());
+    const auto nearInverse = 1.0f / max(*nearest, MIN_DEPTH);
+    const auto farInverse = 1.0f / max(*farthest, MIN_DEPTH);
+    const auto scale = nearInverse > farInverse ? last / (nearInverse - farInverse) : 0.0f;
+    pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto i = begin * width; i < end * width; ++i)
+            m_positions[i] = (nearInverse - 1.0f / max(depth[i], MIN_DEPTH)) * scale;
+    });
+}
+
+void DepthSlices::_blurSlice(const Image& scene, Slot& slot, const float radius) const {
+    const auto& bounds = slot.bounds;
+    const auto width = bounds.right - bounds.left;
+    const auto height = bounds.bottom - bounds.top;
+    if (slot.layer.width() != width || slot.layer.height() != height) {
+        slot.layer.Resize(width, height);
+        slot.blurred.Resize(width, height);
+    }
+    const auto slice = static_cast<float>(slot.slice);
+    for (size_t y = 0; y < height; ++y) {
+        const auto* row = scene.row(bounds.top + y) + bounds.left;
+        const auto* positions = m_positions.data() + (bounds.top + y) * scene.width() + bounds.left;
+        auto* layer = slot.layer.row(y);
+        for (size_t x = 0; x < width; ++x) {
+            const auto w = max(0.0f, 1.0f - fabs(positions[x] - slice));
+            layer[x] = {w * row[x].r, w * row[x].g, w * row[x].b, w};
+        }
+    }
+    slot.result = &slot.layer;
+    if (radius < 0.5f)
+        return;
+
+    // edge k spans edgeLengths()[k] circumradii, and the box blurs along all of them sweep out the polygon
+    auto* source = &slot.layer;
+    auto* target = &slot.blurred;
+    for (size_t k = 0; k < m_aperture.edges().size(); ++k) {
+        const auto edge = m_aperture.edges()[k];
+        const auto length = m_aperture.edgeLengths()[k] * radius;
+        slot.lines.Build(*source, edge, LineTerms::Plain);
+        const auto mean = 1.0f / (length * max(fabs(edge.x), fabs(edge.y)));
+        const auto start = edge * (-0.5f * length);
+        for (size_t y = 0; y < height; ++y) {
+            auto* out = target->row(y);
+            for (size_t x = 0; x < width; ++x) {
+                const Vec2 centre{static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f};
+                out[x] = slot.lines.Integrate(centre + start, length) * mean;
+            }
+        }
+        swap(source, target);
+    }
+    slot.result = source;
+}
+
+void DepthSlices::Run(const Image& scene, const vector<float>& depth, Image& output, const SliceSettings& settings,
+                      ThreadPool& pool) {
+    const auto width = scene.width();
+    const auto height = scene.height();
+    if (!depth.empty() && depth.size() != width * height)
+        throw invalid_argument("depth does not match the scene");
+    if (output.width() != width || output.height() != height)
+        output.Resize(width, height);
+    if (width == 0 || height == 0)
+        return;
+    m_aperture.Build(settings.sides, settings.angle);
+    const auto slices = max(1, settings.slices);
+    _slicePositions(scene, depth, settings, slices, pool);
+
+    m_weights.assign(slices, 0.0f);
+    m_cocs.assign(slices, 0.0f);
+    m_bounds.assign(slices, {width, height, 0, 0});
+    const auto grow = [&](const int slice, const size_t x, const size_t y) {
+        auto& b = m_bounds[slice];
+        b = {min(b.left, x), min(b.top, y), max(b.right, x + 1), max(b.bottom, y + 1)};
+    };
+    for (size_t y = 0; y < height; ++y) {
+        const auto* row = scene.row(y);
+        const auto* positions = m_positions.data() + y * width;
+        for (size_t x = 0; x < width; ++x) {
+            const auto below = min(static_cast<int>(positions[x]), slices - 1);
+            const auto f = positions[x] - static_cast<float>(below);
+            const auto coc = min(fabs(row[x].a), 1.0f);
+            if (f < 1.0f) {
+                m_weights[below] += 1.0f - f;
+                m_cocs[below] += (1.0f - f) * coc;
+                grow(below, x, y);
+            }
+            if (f > 0.0f && below + 1 < slices) {
+                m_weights[below + 1] += f;
+                m_cocs[below + 1] += f * coc;
+                grow(below + 1, x, y);
+            }
+        }
+    }
+    const auto radiusOf = [&](const int slice) { return settings.radius * m_cocs[slice] / m_weights[slice]; };
+    vector<int> used;
+    for (auto slice = 0; slice < slices; ++slice)
+        if (m_weights[slice] > 0.0f)
+            used.push_back(slice);
+
+    m_coverage.assign(width * height, 0.0f);
+    pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y)
+            fill(output.row(y), output.row(y) + width, Texel{});
+    });
+    m_slots.resize(min(used.size(), static_cast<size_t>(pool.threadCount())));
+    for (size_t first = 0; first < used.size(); first += m_slots.size()) {
+        const auto count = min(m_slots.size(), used.size() - first);
+        for (size_t i = 0; i < count; ++i) {
+            auto& slot = m_slots[i];
+            slot.slice = used[first + i];
+            // zeros around the slice as wide as its blur keep the clamp addressing of the lines off its pixels
+            const auto& b = m_bounds[slot.slice];
+            const auto reach = static_cast<size_t>(ceil(radiusOf(slot.slice))) + 2;
+            slot.bounds = {b.left - min(b.left, reach), b.top - min(b.top, reach), min(width, b.right + reach),
+                           min(height, b.bottom + reach)};
+        }
+        pool.ParallelFor(count, [&](const size_t begin, const size_t end) {
+            for (auto i = begin; i < end; ++i)
+                _blurSlice(scene, m_slots[i], radiusOf(m_slots[i].slice));
+        }, 1);
+
+        // front to back: what a slice adds shows through the coverage composited so far
+        pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+            for (auto y = begin; y < end; ++y) {
+                for (size_t i = 0; i < count; ++i) {
+                    const auto& b = m_slots[i].bounds;
+                    if (y < b.top || y >= b.bottom)
+                        continue;
+                    const auto* blurred = m_slots[i].result->row(y - b.top);
+                    auto* out = output.row(y) + b.left;
+                    auto* coverage = m_coverage.data() + y * width + b.left;
+                    for (size_t x = 0; x < b.right - b.left; ++x) {
+                        const auto through = 1.0f - coverage[x];
+                        out[x] += Texel{blurred[x].r, blurred[x].g, blurred[x].b, 0.0f} * through;
+                        coverage[x] += through * min(blurred[x].a, 1.0f);
+                    }
+                }
+            }
+        });
+    }
+
+    pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            const auto* in = scene.row(y);
+            auto* out = output.row(y);
+            const auto* coverage = m_coverage.data() + y * width;
+            for (size_t x = 0; x < width; ++x) {
+                const auto t = coverage[x] > 1e-4f ? out[x] * (1.0f / coverage[x]) : in[x];
+                out[x] = {t.r, t.g, t.b, 1.0f};
+            }
+        }
+    });
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "aperture.h"
+#include "image.h"
+#include "lineIntegral.h"
+#include "threadPool.h"
+#include <vector>
+
+namespace mini::bokeh {
+    struct SliceSettings {
+        //Sides of the aperture polygon, as BokehParams.
+        int sides = 6;
+        float angle = 0.0f;
+        //Circumradius in pixels of the blur of a CoC of 1, cocFactor * numSamples as for the other modes.
+        float radius = 16.0f;
+        //Slices from the nearest to the farthest depth of the frame.
+        int slices = 12;
+        //Without depth: negative CoCs are the near field and lie in front of everything else; otherwise the CoC is
+        //taken as growing with distance.
+        bool nearField = false;
+    };
+
+    //Depth of field at a cost linear in the number of slices, whatever the CoC does from pixel to pixel. The frame is
+    //cut into slices of equal steps in inverse depth, which for a thin lens are equal steps in CoC, and every pixel
+    //goes to the two slices around its depth with linear weights, carried along as coverage in alpha. Each slice is
+    //blurred once with the coverage-weighted mean CoC of its pixels: a uniform polygon is the Minkowski sum of its
+    //edges, so it is one box blur along every edge, read from the running sums of LineIntegral. The blurred slices
+    //are composited front to back with their coverage and the sum is divided by the total coverage, as
+    //FftConvolution does. Slices are blurred in parallel, one per thread, in waves as wide as the pool, so memory
+    //grows with the threads rather than with the slices. CoCs beyond 1 are clamped to 1.
+    class DepthSlices {
+    public:
+        //depth holds the distance of every pixel of scene, row by row; empty - the slices follow the CoC in the
+        //alpha of scene instead. output is resized to match scene and gets alpha 1.
+        void Run(const Image& scene, const std::vector<float>& depth, Image& output, const SliceSettings& settings,
+                 ThreadPool& pool);
+
+    private:
+        //Box of pixels, empty while right <= left.
+        struct Bounds {
+            size_t left, top, right, bottom;
+        };
+
+        //Scratch of the slice blurred by one thread.
+        struct Slot {
+            int slice = 0;
+            //Pixels of scene the layer spans: those of the slice and the reach of its blur.
+            Bounds bounds{};
+            Image layer;
+            Image blurred;
+            LineIntegral lines;
+            //layer or blurred, whichever holds the result.
+            const Image* result = nullptr;
+        };
+
+        //Position of every pixel between the slices, 0 for the nearest, in m_positions.
+        void _slicePositions(const Image& scene, const std::vector<float>& depth, const SliceSettings& settings,
+                             int slices, ThreadPool& pool);
+
+        //Weights slot.slice out of scene and blurs it with the polygon of circumradius radius.
+        void _blurSlice(const Image& scene, Slot& slot, float radius) const;
+
+        Aperture m_aperture;
+        std::vector<float> m_positions;
+        //Coverage and coverage-weighted absolute CoC of every slice.
+        std::vector<float> m_weights;
+        std::vector<float> m_cocs;
+        //Pixels of every slice with some coverage.
+        std::vector<Bounds> m_bounds;
+        std::vector<Slot> m_slots;
+        //Coverage composited so far, per pixel.
+        std::vector<float> m_coverage;
+    };
+}
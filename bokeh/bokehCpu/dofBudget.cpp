@@ -0,0 +1,67 @@
+#include "dofBudget.h"
+#include "blurKernel.h"
+#include <algorithm>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    //Work of the passes that run at full resolution whatever the quality (CoC, upsample, tonemap), in taps per
+    //pixel of the blurs.
+    constexpr float FULL_RESOLUTION_WORK = 2.0f;
+
+    //Taps of the longest blur at downscale, the full count halved with every level.
+    int levelTaps(const int maxSamples, const int downscale) noexcept {
+        return max(1, (maxSamples + (1 << downscale) - 1) >> downscale);
+    }
+}
+
+void DofBudget::SetSettings(const BudgetSettings& settings) {
+    m_settings = settings;
+    m_ladder.clear();
+    const auto lastLevel = max(0, settings.maxDownscale);
+    for (auto downscale = 0; downscale <= lastLevel; ++downscale) {
+        const auto taps = levelTaps(settings.maxSamples, downscale);
+        m_ladder.push_back({downscale, taps});
+        if (!settings.sampleSteps)
+            continue;
+        // the counts of the unrolled blur permutations below that, down to the taps of the next level: a level
+        // with fewer taps than the next one has would look worse than the next one and cost more
+        const auto fewest = downscale < lastLevel ? levelTaps(settings.maxSamples, downscale + 1)
+                                                  : settings.minSamples;
+        for (auto it = FixedSampleCounts.rbegin(); it != FixedSampleCounts.rend(); ++it)
+            if (*it < taps && *it >= fewest)
+                m_ladder.push_back({downscale, *it});
+    }
+}
+
+float DofBudget::_work(const DofQuality& quality) const noexcept {
+    const auto taps = min(quality.maxSamples, levelTaps(m_settings.maxSamples, quality.downscale));
+    const auto pixels = 1.0f / static_cast<float>(1 << (2 * quality.downscale));
+    return FULL_RESOLUTION_WORK + static_cast<float>(max(taps, 1)) * pixels;
+}
+
+float DofBudget::PredictedMilliseconds(const DofQuality& quality) const noexcept {
+    return m_millisecondsPerWork * _work(quality);
+}
+
+DofQuality DofBudget::Update(const float milliseconds, const DofQuality& ran) {
+    if (milliseconds > 0.0f) {
+        const auto measured = milliseconds / _work(ran);
+        m_millisecondsPerWork = m_millisecondsPerWork > 0.0f
+                                    ? m_millisecondsPerWork + (measured - m_millisecondsPerWork) * m_settings.smoothing
+                                    : measured;
+    }
+    if (m_millisecondsPerWork <= 0.0f || m_ladder.empty())
+        return ran;
+
+    const auto current = _work(ran);
+    for (const auto& quality : m_ladder) {
+        const auto limit = _work(quality) > current ? m_settings.headroom * m_settings.budgetMilliseconds
+                                                    : m_settings.budgetMilliseconds;
+        if (PredictedMilliseconds(quality) <= limit)
+            return quality;
+    }
+    return m_ladder.back();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+
+namespace mini::bokeh {
+    //Settings of the depth of field chain a DofBudget trades for time.
+    struct DofQuality {
+        //As bokeh_downscale: the blurs run at 1 / 2^downscale of the full resolution.
+        int downscale = 0;
+        //As max_samples: most taps of one blur.
+        int maxSamples = 32;
+
+        bool operator==(const DofQuality&) const = default;
+    };
+
+    struct BudgetSettings {
+        float budgetMilliseconds = 2.0f;
+        int maxDownscale = 2;
+        //Taps of the longest blur at full resolution, NUM_SAMPLES times the sample density; the reduced levels take
+        //a half and a quarter of them.
+        int maxSamples = 32;
+        int minSamples = 4;
+        //False when the taps do not follow max_samples, as with a sample_density of 0; only resolution is traded.
+        bool sampleSteps = true;
+        //A better quality is only taken while its predicted time stays below this share of the budget, so the
+        //controller does not flip between two settings on the edge of the budget.
+        float headroom = 0.85f;
+        //Weight of a new measurement in the running estimate of the time per unit of work.
+        float smoothing = 0.2f;
+    };
+
+    //Picks the quality of the next frame from the time the depth of field took, so a wide aperture with many taps
+    //costs resolution and taps instead of frames. The work of a quality is modelled as the taps per blur over the
+    //pixels of its level, plus the passes at full resolution that do not depend on either. The time per unit of
+    //work is learnt from the measurements, each against the quality it was measured at, so results that arrive
+    //frames late still fit the model. Every frame the best quality of the ladder predicted to fit the budget is taken.
+    class DofBudget {
+    public:
+        explicit DofBudget(const BudgetSettings& settings = {}) { SetSettings(settings); }
+
+        //Rebuilds the ladder; the learnt time per unit of work is kept.
+        void SetSettings(const BudgetSettings& settings);
+
+        [[nodiscard]] const BudgetSettings& settings() const noexcept { return m_settings; }
+
+        //Qualities from the best to the cheapest: every level from full resolution down, each with decreasing taps
+        //as long as it keeps more than the next level.
+        [[nodiscard]] const std::vector<DofQuality>& ladder() const noexcept { return m_ladder; }
+
+        //Feeds the milliseconds the depth of field took in a frame rendered at ran and returns the quality for the
+        //next frame. Measurements that are not positive are ignored.
+        DofQuality Update(float milliseconds, const DofQuality& ran);
+
+        //0 until the first measurement.
+        [[nodiscard]] float PredictedMilliseconds(const DofQuality& quality) const noexcept;
+
+        //Forgets the measurements.
+        void Reset() noexcept { m_millisecondsPerWork = 0.0f; }
+
+    private:
+        [[nodiscard]] float _work(const DofQuality& quality) const noexcept;
+
+        BudgetSettings m_settings;
+        std::vector<DofQuality> m_ladder;
+        float m_millisecondsPerWork = 0.0f;
+    };
+}
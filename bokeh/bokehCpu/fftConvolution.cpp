@@ -0,0 +1,259 @@
+#include "fftConvolution.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    using Complex = complex<float>;
+
+    //Columns gathered together, so each cache line read from the grid serves all of them.
+    constexpr size_t COLUMN_BLOCK = 8;
+    //Subsamples per kernel texel along each axis, to antialias small apertures.
+    constexpr int KERNEL_SUBSAMPLES = 4;
+
+    //The product written out: std::complex multiplication checks for infinities and NaNs at every call.
+    Complex multiply(const Complex a, const Complex b) noexcept {
+        return {a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real()};
+    }
+
+    size_t nextPowerOfTwo(const size_t n) noexcept {
+        size_t p = 1;
+        while (p < n)
+            p *= 2;
+        return p;
+    }
+}
+
+void Fft::Prepare(const size_t size) {
+    if (size == m_size)
+        return;
+    m_size = size;
+    auto bits = 0;
+    while ((size_t{1} << bits) < size)
+        ++bits;
+    m_reversed.resize(size);
+    for (size_t i = 0; i < size; ++i) {
+        uint32_t r = 0;
+        for (auto b = 0; b < bits; ++b)
+            r |= ((i >> b) & 1u) << (bits - 1 - b);
+        m_reversed[i] = r;
+    }
+    m_twiddles.resize(size / 2);
+    for (size_t k = 0; k < size / 2; ++k) {
+        const auto phase = -2.0 * 3.14159265358979323846 * static_cast<double>(k) / static_cast<double>(size);
+        m_twiddles[k] = {static_cast<float>(cos(phase)), static_cast<float>(sin(phase))};
+    }
+}
+
+void Fft::Transform(Complex* data, const bool inverse) const noexcept {
+    for (size_t i = 0; i < m_size; ++i)
+        if (i < m_reversed[i])
+            swap(data[i], data[m_reversed[i]]);
+    for (size_t length = 2; length <= m_size; length *= 2) {
+        const auto half = length / 2;
+        const auto stride = m_size / length;
+        for (size_t i = 0; i < m_size; i += length)
+            for (size_t j = 0; j < half; ++j) {
+                const auto w = inverse ? conj(m_twiddles[j * stride]) : m_twiddles[j * stride];
+                const auto u = data[i + j];
+                const auto v = multiply(data[i + j + half], w);
+                data[i + j] = u + v;
+                data[i + j + half] = u - v;
+            }
+    }
+}
+
+void FftConvolution::_transformColumns(vector<Complex>& grid, const bool inverse, ThreadPool& pool) const {
+    const auto width = m_gridWidth;
+    const auto height = m_gridHeight;
+    const auto blocks = (width + COLUMN_BLOCK - 1) / COLUMN_BLOCK;
+    pool.ParallelFor(blocks, [&](const size_t begin, const size_t end) {
+        vector<Complex> columns(COLUMN_BLOCK * height);
+        for (auto block = begin; block < end; ++block) {
+            const auto x0 = block * COLUMN_BLOCK;
+            const auto count = min(COLUMN_BLOCK, width - x0);
+            for (size_t y = 0; y < height; ++y)
+                for (size_t c = 0; c < count; ++c)
+                    columns[c * height + y] = grid[y * width + x0 + c];
+            for (size_t c = 0; c < count; ++c)
+                m_columnFft.Transform(columns.data() + c * height, inverse);
+            for (size_t y = 0; y < height; ++y)
+                for (size_t c = 0; c < count; ++c)
+                    grid[y * width + x0 + c] = columns[c * height + y];
+        }
+    });
+}
+
+void FftConvolution::_forward(vector<Complex>& grid, const size_t rows, ThreadPool& pool) const {
+    // the transform of a zero row is zero
+    pool.ParallelFor(rows, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y)
+            m_rowFft.Transform(grid.data() + y * m_gridWidth, false);
+    });
+    _transformColumns(grid, false, pool);
+}
+
+void FftConvolution::_inverse(vector<Complex>& grid, ThreadPool& pool) const {
+    _transformColumns(grid, true, pool);
+    pool.ParallelFor(m_gridHeight, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y)
+            m_rowFft.Transform(grid.data() + y * m_gridWidth, true);
+    });
+}
+
+float FftConvolution::_kernelTexel(const int dx, const int dy, const float radius) const noexcept {
+    auto covered = 0.0f;
+    for (auto sy = 0; sy < KERNEL_SUBSAMPLES; ++sy)
+        for (auto sx = 0; sx < KERNEL_SUBSAMPLES; ++sx) {
+            const auto ox = (static_cast<float>(sx) + 0.5f) / KERNEL_SUBSAMPLES - 0.5f;
+            const auto oy = (static_cast<float>(sy) + 0.5f) / KERNEL_SUBSAMPLES - 0.5f;
+            const Vec2 p{(static_cast<float>(dx) + ox) / radius, (static_cast<float>(dy) + oy) / radius};
+            if (m_mask.values.empty()) {
+                covered += m_aperture.Contains(p) ? 1.0f : 0.0f;
+                continue;
+            }
+            // the mask spans the square of side 2 around the centre
+            const auto u = (p.x + 1.0f) * 0.5f * static_cast<float>(m_mask.width);
+            const auto v = (p.y + 1.0f) * 0.5f * static_cast<float>(m_mask.height);
+            if (u >= 0.0f && v >= 0.0f && u < static_cast<float>(m_mask.width) &&
+                v < static_cast<float>(m_mask.height))
+                covered += max(0.0f, m_mask.values[static_cast<size_t>(v) * m_mask.width + static_cast<size_t>(u)]);
+        }
+    return covered;
+}
+
+void FftConvolution::_buildKernel(const float radius, ThreadPool& pool) {
+    fill(m_kernel.begin(), m_kernel.end(), Complex{});
+    const auto reach = static_cast<int>(ceil(radius));
+    const auto width = static_cast<int>(m_gridWidth);
+    const auto height = static_cast<int>(m_gridHeight);
+    auto total = 0.0f;
+    for (auto dy = -reach; dy <= reach; ++dy)
+        for (auto dx = -reach; dx <= reach; ++dx) {
+            const auto value = _kernelTexel(dx, dy, radius);
+            m_kernel[static_cast<size_t>((dy + height) % height) * m_gridWidth + (dx + width) % width] = value;
+            total += value;
+        }
+    if (total <= 0.0f) {
+        m_kernel[0] = 1.0f;
+        total = 1.0f;
+    }
+    // the 1 / size of the inverse transforms is folded in here
+    const auto scale = 1.0f / (total * static_cast<float>(m_gridWidth * m_gridHeight));
+    for (auto& k : m_kernel)
+        k *= scale;
+    _forward(m_kernel, m_gridHeight, pool);
+}
+
+void FftConvolution::Run(const Image& scene, Image& output, const ConvolutionSettings& settings, ThreadPool& pool) {
+    const auto width = scene.width();
+    const auto height = scene.height();
+    if (output.width() != width || output.height() != height)
+        output.Resize(width, height);
+    m_aperture.Build(settings.sides, settings.angle);
+    const auto layers = max(1, settings.layers);
+
+    // layers in front-to-back order, by CoC: the near field from the nearest, then outwards from the focus
+    const auto firstLayer = settings.nearField ? -layers : 0;
+    const auto layerOf = [&](const float coc) {
+        const auto c = settings.nearField ? clamp(coc, -1.0f, 1.0f) : min(fabs(coc), 1.0f);
+        return c * static_cast<float>(layers);
+    };
+    vector<char> used(static_cast<size_t>(layers - firstLayer + 1), 0);
+    for (size_t y = 0; y < height; ++y) {
+        const auto* row = scene.row(y);
+        for (size_t x = 0; x < width; ++x) {
+            const auto t = layerOf(row[x].a);
+            const auto below = static_cast<int>(floor(t));
+            used[below - firstLayer] = 1;
+            if (static_cast<float>(below) < t)
+                used[below + 1 - firstLayer] = 1;
+        }
+    }
+
+    // zero padding as wide as the largest blur keeps the convolution from wrapping around
+    const auto reach = static_cast<size_t>(ceil(settings.radius)) + 1;
+    m_gridWidth = nextPowerOfTwo(width + reach);
+    m_gridHeight = nextPowerOfTwo(height + reach);
+    m_rowFft.Prepare(m_gridWidth);
+    m_columnFft.Prepare(m_gridHeight);
+    const auto gridSize = m_gridWidth * m_gridHeight;
+    m_redGreen.resize(gridSize);
+    m_blueCoverage.resize(gridSize);
+    m_kernel.resize(gridSize);
+    m_coverage.assign(width * height, 0.0f);
+    pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y)
+            fill(output.row(y), output.row(y) + width, Texel{});
+    });
+
+    for (auto layer = firstLayer; layer <= layers; ++layer) {
+        if (!used[layer - firstLayer])
+            continue;
+        const auto radius = settings.radius * static_cast<float>(abs(layer)) / static_cast<float>(layers);
+        const auto convolve = radius >= 0.5f;
+
+        pool.ParallelFor(m_gridHeight, [&](const size_t begin, const size_t end) {
+            for (auto y = begin; y < end; ++y) {
+                auto* redGreen = m_redGreen.data() + y * m_gridWidth;
+                auto* blueCoverage = m_blueCoverage.data() + y * m_gridWidth;
+                fill(redGreen, redGreen + m_gridWidth, Complex{});
+                fill(blueCoverage, blueCoverage + m_gridWidth, Complex{});
+                if (y >= height)
+                    continue;
+                const auto* row = scene.row(y);
+                for (size_t x = 0; x < width; ++x) {
+                    const auto w = max(0.0f, 1.0f - fabs(layerOf(row[x].a) - static_cast<float>(layer)));
+                    redGreen[x] = {w * row[x].r, w * row[x].g};
+                    blueCoverage[x] = {w * row[x].b, w};
+                }
+            }
+        });
+        if (convolve) {
+            _buildKernel(radius, pool);
+            _forward(m_redGreen, height, pool);
+            _forward(m_blueCoverage, height, pool);
+            pool.ParallelFor(gridSize, [&](const size_t begin, const size_t end) {
+                for (auto i = begin; i < end; ++i) {
+                    m_redGreen[i] = multiply(m_redGreen[i], m_kernel[i]);
+                    m_blueCoverage[i] = multiply(m_blueCoverage[i], m_kernel[i]);
+                }
+            });
+            _inverse(m_redGreen, pool);
+            _inverse(m_blueCoverage, pool);
+        }
+
+        // front to back: what this layer adds shows through the coverage composited so far
+        pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+            for (auto y = begin; y < end; ++y) {
+                const auto* redGreen = m_redGreen.data() + y * m_gridWidth;
+                const auto* blueCoverage = m_blueCoverage.data() + y * m_gridWidth;
+                auto* out = output.row(y);
+                auto* coverage = m_coverage.data() + y * width;
+                for (size_t x = 0; x < width; ++x) {
+                    // the transforms ring slightly below zero around sharp edges
+                    const auto alpha = clamp(blueCoverage[x].imag(), 0.0f, 1.0f);
+                    const auto through = 1.0f - coverage[x];
+                    out[x] += Texel{max(0.0f, redGreen[x].real()), max(0.0f, redGreen[x].imag()),
+                                    max(0.0f, blueCoverage[x].real()), 0.0f} * through;
+                    coverage[x] += through * alpha;
+                }
+            }
+        });
+    }
+
+    pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            const auto* in = scene.row(y);
+            auto* out = output.row(y);
+            const auto* coverage = m_coverage.data() + y * width;
+            for (size_t x = 0; x < width; ++x) {
+                const auto t = coverage[x] > 1e-4f ? out[x] * (1.0f / coverage[x]) : in[x];
+                out[x] = {t.r, t.g, t.b, 1.0f};
+            }
+        }
+    });
+}
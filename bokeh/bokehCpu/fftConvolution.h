@@ -0,0 +1,95 @@
+#pragma once
+#include "aperture.h"
+#include "image.h"
+#include "threadPool.h"
+#include <complex>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace mini::bokeh {
+    //Greyscale picture of the aperture, e.g. a photographed or painted bokeh shape. Brighter texels pass more light;
+    //the picture is stretched over the diameter of the blur and its total is normalized away.
+    struct ApertureMask {
+        size_t width = 0;
+        size_t height = 0;
+        //Row-major, width * height values.
+        std::vector<float> values;
+    };
+
+    //In-place radix-2 complex FFT of one power-of-two size, its twiddles and bit reversal precomputed.
+    class Fft {
+    public:
+        void Prepare(size_t size);
+
+        [[nodiscard]] size_t size() const noexcept { return m_size; }
+
+        //The inverse is not scaled by 1 / size.
+        void Transform(std::complex<float>* data, bool inverse) const noexcept;
+
+    private:
+        size_t m_size = 0;
+        //exp(-2 pi i k / size) for k < size / 2.
+        std::vector<std::complex<float>> m_twiddles;
+        std::vector<std::uint32_t> m_reversed;
+    };
+
+    struct ConvolutionSettings {
+        //Sides of the aperture polygon, as BokehParams; ignored while a mask is set.
+        int sides = 6;
+        float angle = 0.0f;
+        //Circumradius in pixels of the blur of a CoC of 1, cocFactor * numSamples as for the other modes.
+        float radius = 16.0f;
+        //Layers over CoCs from 0 to 1, on either side of the focus with nearField.
+        int layers = 8;
+        //Negative CoCs are the near field and lie in front of everything else; otherwise the CoC is taken as
+        //growing with distance.
+        bool nearField = false;
+    };
+
+    //Final-quality blur for very large apertures: the scene is split into layers of similar CoC and every layer is
+    //convolved with the aperture at its radius through 2D FFTs, whose cost does not depend on the radius. Each pixel
+    //goes to the two layers around its CoC with linear weights, carried along as coverage in a fourth channel. The
+    //blurred layers are composited front to back with that coverage, and the sum is divided by the total coverage,
+    //which also keeps the frame edges from darkening. Pairs of the four real channels share one complex transform,
+    //the saving a real-to-complex FFT would bring. CoCs beyond 1 are clamped to 1.
+    class FftConvolution {
+    public:
+        void SetMask(ApertureMask mask) { m_mask = std::move(mask); }
+
+        void ClearMask() { m_mask = {}; }
+
+        [[nodiscard]] bool hasMask() const noexcept { return !m_mask.values.empty(); }
+
+        //output is resized to match scene and gets alpha 1.
+        void Run(const Image& scene, Image& output, const ConvolutionSettings& settings, ThreadPool& pool);
+
+    private:
+        //Transforms the rows of grid below rows, the rest being zero, then all its columns.
+        void _forward(std::vector<std::complex<float>>& grid, size_t rows, ThreadPool& pool) const;
+
+        void _inverse(std::vector<std::complex<float>>& grid, ThreadPool& pool) const;
+
+        void _transformColumns(std::vector<std::complex<float>>& grid, bool inverse, ThreadPool& pool) const;
+
+        //Draws the aperture of circumradius radius into m_kernel around texel (0, 0), wrapping around the grid,
+        //normalized to a total of 1.
+        void _buildKernel(float radius, ThreadPool& pool);
+
+        //Coverage of the kernel texel (dx, dy) for circumradius radius.
+        [[nodiscard]] float _kernelTexel(int dx, int dy, float radius) const noexcept;
+
+        ApertureMask m_mask;
+        Aperture m_aperture;
+        Fft m_rowFft;
+        Fft m_columnFft;
+        size_t m_gridWidth = 0;
+        size_t m_gridHeight = 0;
+        //Weighted red and green, and blue and coverage, of one layer as real and imaginary parts.
+        std::vector<std::complex<float>> m_redGreen;
+        std::vector<std::complex<float>> m_blueCoverage;
+        std::vector<std::complex<float>> m_kernel;
+        //Coverage composited so far, per pixel.
+        std::vector<float> m_coverage;
+    };
+}
@@ -0,0 +1,212 @@
+#include "frameIO.h"
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    constexpr float GAMMA = 2.2f;
+
+    [[noreturn]] void fail(const string& path, const string& message) {
+        throw runtime_error(path + ": " + message);
+    }
+
+    string extension(const string& path) {
+        const auto dot = path.find_last_of('.');
+        if (dot == string::npos)
+            return {};
+        auto ext = path.substr(dot + 1);
+        for (auto& c : ext)
+            c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        return ext;
+    }
+
+    float loadFloat(const uint8_t* bytes, const bool littleEndian) {
+        uint8_t ordered[4];
+        memcpy(ordered, bytes, 4);
+        if (littleEndian != (endian::native == endian::little))
+            reverse(begin(ordered), end(ordered));
+        float value;
+        memcpy(&value, ordered, 4);
+        return value;
+    }
+
+    //netpbm stores 16-bit samples most significant byte first.
+    unsigned loadSample(const uint8_t* bytes, const bool wide) {
+        return wide ? static_cast<unsigned>(bytes[0]) << 8 | bytes[1] : bytes[0];
+    }
+}
+
+void FrameCodec::_load(const string& path) {
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file)
+        fail(path, "cannot open");
+    const auto size = static_cast<size_t>(file.tellg());
+    m_bytes.resize(size);
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(m_bytes.data()), static_cast<streamsize>(size)))
+        fail(path, "cannot read");
+}
+
+FrameCodec::Header FrameCodec::_parseHeader(const string& path) const {
+    if (m_bytes.size() < 2 || m_bytes[0] != 'P' || !strchr("Ff56", m_bytes[1]))
+        fail(path, "not a PFM, PPM or PGM file");
+    Header header{static_cast<char>(m_bytes[1]), 0, 0, 0.0f, 2};
+    // three whitespace separated fields, skipping netpbm comments, then a single whitespace byte
+    string fields[3];
+    auto pos = header.dataOffset;
+    for (auto& field : fields) {
+        while (pos < m_bytes.size() && (isspace(m_bytes[pos]) || m_bytes[pos] == '#')) {
+            if (m_bytes[pos] == '#')
+                while (pos < m_bytes.size() && m_bytes[pos] != '\n')
+                    ++pos;
+            else
+                ++pos;
+        }
+        while (pos < m_bytes.size() && !isspace(m_bytes[pos]))
+            field += static_cast<char>(m_bytes[pos++]);
+    }
+    if (pos >= m_bytes.size() || fields[2].empty())
+        fail(path, "truncated header");
+    header.dataOffset = pos + 1;
+    try {
+        header.width = stoul(fields[0]);
+        header.height = stoul(fields[1]);
+        header.scale = stof(fields[2]);
+    } catch (const logic_error&) {
+        fail(path, "malformed header");
+    }
+    const auto pfm = header.kind == 'F' || header.kind == 'f';
+    if (header.width == 0 || header.height == 0 || header.scale == 0.0f ||
+        (!pfm && (header.scale < 1.0f || header.scale > 65535.0f)))
+        fail(path, "malformed header");
+    const size_t channels = header.kind == 'F' || header.kind == '6' ? 3 : 1;
+    const size_t sampleBytes = pfm ? 4 : header.scale > 255.0f ? 2 : 1;
+    if (m_bytes.size() - header.dataOffset < header.width * header.height * channels * sampleBytes)
+        fail(path, "truncated pixel data");
+    return header;
+}
+
+const vector<float>& FrameCodec::_toLinear(const unsigned maxval) {
+    if (m_toLinearMaxval != maxval) {
+        m_toLinear.resize(maxval + 1);
+        for (unsigned i = 0; i <= maxval; ++i)
+            m_toLinear[i] = pow(static_cast<float>(i) / static_cast<float>(maxval), GAMMA);
+        m_toLinearMaxval = maxval;
+    }
+    return m_toLinear;
+}
+
+void FrameCodec::ReadColor(const string& path, Image& image) {
+    _load(path);
+    const auto header = _parseHeader(path);
+    if (header.kind != 'F' && header.kind != '6')
+        fail(path, "expected a colour PFM or PPM");
+    if (image.width() != header.width || image.height() != header.height)
+        image.Resize(header.width, header.height);
+    const auto* data = m_bytes.data() + header.dataOffset;
+    if (header.kind == 'F') {
+        const auto littleEndian = header.scale < 0.0f;
+        for (size_t y = 0; y < header.height; ++y) {
+            auto* row = image.row(header.height - 1 - y);
+            for (size_t x = 0; x < header.width; ++x, data += 12)
+                row[x] = {loadFloat(data, littleEndian), loadFloat(data + 4, littleEndian),
+                          loadFloat(data + 8, littleEndian), 0.0f};
+        }
+        return;
+    }
+    const auto maxval = static_cast<unsigned>(header.scale);
+    const auto wide = maxval > 255;
+    const auto stride = wide ? 2 : 1;
+    const auto& toLinear = _toLinear(maxval);
+    for (size_t y = 0; y < header.height; ++y) {
+        auto* row = image.row(y);
+        for (size_t x = 0; x < header.width; ++x, data += 3 * stride)
+            row[x] = {toLinear[min(maxval, loadSample(data, wide))],
+                      toLinear[min(maxval, loadSample(data + stride, wide))],
+                      toLinear[min(maxval, loadSample(data + 2 * stride, wide))], 0.0f};
+    }
+}
+
+FrameCodec::Header FrameCodec::_readGrey(const string& path, vector<float>& values) {
+    _load(path);
+    const auto header = _parseHeader(path);
+    if (header.kind != 'f' && header.kind != '5')
+        fail(path, "expected a greyscale PFM or PGM");
+    const auto width = header.width;
+    const auto height = header.height;
+    values.resize(width * height);
+    const auto* data = m_bytes.data() + header.dataOffset;
+    if (header.kind == 'f') {
+        const auto littleEndian = header.scale < 0.0f;
+        for (size_t y = 0; y < height; ++y) {
+            auto* row = values.data() + (height - 1 - y) * width;
+            for (size_t x = 0; x < width; ++x, data += 4)
+                row[x] = loadFloat(data, littleEndian);
+        }
+        return header;
+    }
+    const auto maxval = static_cast<unsigned>(header.scale);
+    const auto wide = maxval > 255;
+    const auto step = 1.0f / static_cast<float>(maxval);
+    for (auto& v : values) {
+        v = step * static_cast<float>(min(maxval, loadSample(data, wide)));
+        data += wide ? 2 : 1;
+    }
+    return header;
+}
+
+void FrameCodec::ReadGrey(const string& path, size_t& width, size_t& height, vector<float>& values) {
+    const auto header = _readGrey(path, values);
+    width = header.width;
+    height = header.height;
+}
+
+void FrameCodec::ReadDepth(const string& path, const size_t width, const size_t height, const float nearPlane,
+                           const float farPlane, vector<float>& depth) {
+    const auto header = _readGrey(path, depth);
+    if (header.width != width || header.height != height)
+        fail(path, "depth is " + to_string(header.width) + "x" + to_string(header.height) + ", colour is " +
+                   to_string(width) + "x" + to_string(height));
+    if (header.kind == 'f')
+        return;
+    for (auto& d : depth)
+        d = nearPlane + (farPlane - nearPlane) * d;
+}
+
+void FrameCodec::WriteColor(const string& path, const Image& image) {
+    const auto ext = extension(path);
+    const auto pfm = ext == "pfm";
+    if (!pfm && ext != "ppm")
+        fail(path, "colour is written as .pfm or .ppm");
+    const auto width = image.width();
+    const auto height = image.height();
+    const auto header = (pfm ? "PF\n" : "P6\n") + to_string(width) + " " + to_string(height) +
+                        (pfm ? (endian::native == endian::little ? "\n-1.0\n" : "\n1.0\n") : "\n255\n");
+    m_bytes.resize(header.size() + width * height * (pfm ? 12 : 3));
+    memcpy(m_bytes.data(), header.data(), header.size());
+    auto* data = m_bytes.data() + header.size();
+    for (size_t y = 0; y < height; ++y) {
+        const auto* row = image.row(pfm ? height - 1 - y : y);
+        for (size_t x = 0; x < width; ++x) {
+            const float rgb[3] = {row[x].r, row[x].g, row[x].b};
+            if (pfm) {
+                memcpy(data, rgb, sizeof(rgb));
+                data += sizeof(rgb);
+                continue;
+            }
+            for (const auto c : rgb)
+                *data++ = static_cast<uint8_t>(lround(255.0f * pow(clamp(c, 0.0f, 1.0f), 1.0f / GAMMA)));
+        }
+    }
+    ofstream file(path, ios::binary);
+    if (!file.write(reinterpret_cast<const char*>(m_bytes.data()), static_cast<streamsize>(m_bytes.size())))
+        fail(path, "cannot write");
+}
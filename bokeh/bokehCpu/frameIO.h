@@ -0,0 +1,54 @@
+#pragma once
+#include "image.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mini::bokeh {
+    //Reads and writes the colour and depth planes of offline frames. The encoding follows the extension:
+    //.pfm - Portable Float Map, "PF" colour or "Pf" greyscale floats of either byte order, rows stored bottom to top.
+    //Colour is linear, depth is the distance along the view axis in scene units.
+    //.ppm, .pgm - binary netpbm (P6 colour, P5 greyscale) with 8 or 16 bits per channel. Colour is gamma 2.2
+    //encoded, depth spans nearPlane to farPlane over the full range of the integers.
+    //Errors throw std::runtime_error naming the file. Each codec keeps its buffers between frames, so one codec
+    //per thread reads or writes a sequence without allocating.
+    class FrameCodec {
+    public:
+        //Fills the rgb of image, resized to the file, and zeroes the CoC in alpha.
+        void ReadColor(const std::string& path, Image& image);
+
+        //Fills depth with one distance per pixel. Throws if the plane is not width x height.
+        void ReadDepth(const std::string& path, size_t width, size_t height, float nearPlane, float farPlane,
+                       std::vector<float>& depth);
+
+        //Fills values with a greyscale PFM as it is or a PGM scaled to [0, 1], e.g. for an ApertureMask.
+        void ReadGrey(const std::string& path, size_t& width, size_t& height, std::vector<float>& values);
+
+        //Writes the rgb of image; PFM keeps it linear, PPM clamps it to [0, 1] and gamma encodes it to 8 bits.
+        void WriteColor(const std::string& path, const Image& image);
+
+    private:
+        struct Header {
+            char kind;
+            size_t width;
+            size_t height;
+            //maxval of netpbm, the scale of PFM (negative for little endian).
+            float scale;
+            size_t dataOffset;
+        };
+
+        void _load(const std::string& path);
+
+        //ReadGrey, returning the header of the file.
+        Header _readGrey(const std::string& path, std::vector<float>& values);
+
+        [[nodiscard]] Header _parseHeader(const std::string& path) const;
+
+        //Linear value of every integer of a gamma encoded netpbm channel up to maxval.
+        const std::vector<float>& _toLinear(unsigned maxval);
+
+        std::vector<std::uint8_t> m_bytes;
+        std::vector<float> m_toLinear;
+        unsigned m_toLinearMaxval = 0;
+    };
+}
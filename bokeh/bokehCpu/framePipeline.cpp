@@ -0,0 +1,141 @@
+#include "framePipeline.h"
+#include "boundedQueue.h"
+#include "frameIO.h"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+FramePipeline::FramePipeline(const PipelineSettings& settings)
+    : m_settings(settings), m_engine(settings.blurThreads) {
+    if (settings.apertureMask.empty())
+        return;
+    ApertureMask mask;
+    FrameCodec().ReadGrey(settings.apertureMask, mask.width, mask.height, mask.values);
+    m_engine.SetApertureMask(move(mask));
+}
+
+void FramePipeline::_computeCoc(Frame& frame) {
+    auto& scene = frame.scene;
+    const auto width = scene.width();
+    // a CoC of 1 blurs numSamples pixels to each side, as in the demo; rebuilt only when the width changes
+    m_lut.Build(m_settings.lens, m_settings.nearPlane, m_settings.farPlane, static_cast<float>(width),
+                2 * m_settings.params.numSamples);
+    const auto nearField = m_settings.params.separateNearField;
+    const auto focus = m_settings.lens.focusDistance;
+    m_engine.pool().ParallelFor(scene.height(), [&](const size_t begin, const size_t end) {
+        for (auto y = begin; y < end; ++y) {
+            auto* row = scene.row(y);
+            const auto* depth = frame.depth.data() + y * width;
+            for (size_t x = 0; x < width; ++x) {
+                const auto coc = m_lut.Sample(depth[x]);
+                row[x].a = nearField && depth[x] < focus ? -coc : coc;
+            }
+        }
+    });
+}
+
+PipelineStats FramePipeline::Run(const vector<FrameJob>& jobs, const function<void(size_t)>& onFrameDone) {
+    using Clock = chrono::steady_clock;
+    // Every frame circulates idle -> loaded -> blurred -> idle, so at most queueDepth frames exist and no queue can
+    // hold more than that.
+    const auto frames = max<size_t>(1, m_settings.queueDepth);
+    BoundedQueue<unique_ptr<Frame>> idle(frames), loaded(frames), blurred(frames);
+    for (size_t i = 0; i < frames; ++i)
+        idle.Push(make_unique<Frame>());
+
+    mutex errorMutex;
+    exception_ptr error;
+    // called from a catch block: keeps the first error and unblocks every stage
+    const auto fail = [&] {
+        {
+            lock_guard lock(errorMutex);
+            if (!error)
+                error = current_exception();
+        }
+        idle.Cancel();
+        loaded.Cancel();
+        blurred.Cancel();
+    };
+
+    const auto start = Clock::now();
+    Clock::duration readTime{}, blurTime{}, writeTime{};
+    thread reader([&] {
+        try {
+            FrameCodec codec;
+            for (size_t i = 0; i < jobs.size(); ++i) {
+                unique_ptr<Frame> frame;
+                if (!idle.Pop(frame))
+                    return;
+                const auto begin = Clock::now();
+                codec.ReadColor(jobs[i].color, frame->scene);
+                codec.ReadDepth(jobs[i].depth, frame->scene.width(), frame->scene.height(), m_settings.nearPlane,
+                                m_settings.farPlane, frame->depth);
+                frame->index = i;
+                readTime += Clock::now() - begin;
+                if (!loaded.Push(move(frame)))
+                    return;
+            }
+            loaded.Close();
+        } catch (...) {
+            fail();
+        }
+    });
+    thread writer([&] {
+        try {
+            FrameCodec codec;
+            unique_ptr<Frame> frame;
+            while (blurred.Pop(frame)) {
+                const auto begin = Clock::now();
+                codec.WriteColor(jobs[frame->index].output, frame->output);
+                writeTime += Clock::now() - begin;
+                const auto index = frame->index;
+                if (!idle.Push(move(frame)))
+                    return;
+                if (onFrameDone)
+                    onFrameDone(index);
+            }
+        } catch (...) {
+            fail();
+        }
+    });
+
+    size_t done = 0;
+    try {
+        unique_ptr<Frame> frame;
+        auto params = m_settings.params;
+        while (loaded.Pop(frame)) {
+            const auto begin = Clock::now();
+            _computeCoc(*frame);
+            // the stochastic taps land elsewhere in every frame of the sequence
+            params.frame = m_settings.params.frame + static_cast<unsigned>(frame->index);
+            m_engine.Run(frame->scene, frame->depth, frame->output, params);
+            blurTime += Clock::now() - begin;
+            ++done;
+            if (!blurred.Push(move(frame)))
+                break;
+        }
+        blurred.Close();
+    } catch (...) {
+        fail();
+    }
+    reader.join();
+    writer.join();
+    if (error)
+        rethrow_exception(error);
+
+    using Seconds = chrono::duration<double>;
+    PipelineStats stats;
+    stats.frames = done;
+    stats.seconds = Seconds(Clock::now() - start).count();
+    stats.readSeconds = Seconds(readTime).count();
+    stats.blurSeconds = Seconds(blurTime).count();
+    stats.writeSeconds = Seconds(writeTime).count();
+    return stats;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "bokehEngine.h"
+#include "thinLens.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace mini::bokeh {
+    //Files of one frame of an offline sequence, see FrameCodec for the encodings.
+    struct FrameJob {
+        std::string color;
+        std::string depth;
+        std::string output;
+    };
+
+    struct PipelineSettings {
+        ThinLens lens;
+        //Distances the CoC table spans, and the depth range of integer depth planes.
+        float nearPlane = 0.1f;
+        float farPlane = 100.0f;
+        BokehParams params;
+        //Picture of the aperture for BlurMode::Convolution, a greyscale .pfm or .pgm; empty - the polygon of
+        //params.sides.
+        std::string apertureMask;
+        //Frames in flight between the stages. Each holds its scene, depth and output, so memory grows with it.
+        size_t queueDepth = 4;
+        //Threads of the blur stage, 0 - all hardware threads. The read and write stages add one thread each.
+        unsigned blurThreads = 0;
+    };
+
+    //Time every stage spent working rather than waiting on its queues; the busiest one bounds the throughput.
+    struct PipelineStats {
+        size_t frames = 0;
+        double seconds = 0.0;
+        double readSeconds = 0.0;
+        double blurSeconds = 0.0;
+        double writeSeconds = 0.0;
+
+        [[nodiscard]] double framesPerSecond() const noexcept { return seconds > 0.0 ? frames / seconds : 0.0; }
+    };
+
+    //Depth of field for sequences of colour and depth frames, as a post-production batch job. Three stages run
+    //concurrently and hand frames on through bounded queues: a reader thread loads and decodes the planes, the
+    //calling thread converts depth to CoC through a CocLut and blurs the frame with BokehEngine on its pool, and a
+    //writer thread encodes and stores the result. While one frame is blurred the next is read and the previous
+    //written, so disk I/O and decoding hide behind the blur. The frames are recycled, so a running sequence does
+    //not allocate.
+    class FramePipeline {
+    public:
+        explicit FramePipeline(const PipelineSettings& settings);
+
+        //Processes the jobs in order. onFrameDone, if set, gets the index of every job once its output is written,
+        //on the writer thread. The first error of any stage stops the others and is rethrown here.
+        PipelineStats Run(const std::vector<FrameJob>& jobs,
+                          const std::function<void(size_t)>& onFrameDone = nullptr);
+
+        [[nodiscard]] BokehEngine& engine() noexcept { return m_engine; }
+
+    private:
+        struct Frame {
+            size_t index = 0;
+            Image scene;
+            std::vector<float> depth;
+            Image output;
+        };
+
+        //Fills the alpha of frame.scene with the CoC of its depth, negative in front of the focus distance with
+        //BokehParams::separateNearField.
+        void _computeCoc(Frame& frame);
+
+        PipelineSettings m_settings;
+        BokehEngine m_engine;
+        CocLut m_lut;
+    };
+}
@@ -0,0 +1,137 @@
+#include "highlights.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    float luminance(const Texel& t) noexcept {
+        return 0.2126f * t.r + 0.7152f * t.g + 0.0722f * t.b;
+    }
+
+    //Fraction of the colour of t left to the gather, 1 if t is no highlight.
+    float gatherFraction(const Texel& t, const float threshold, const float minRadius, const float radiusScale) {
+        const auto lum = luminance(t);
+        const auto radius = fabs(t.a) * radiusScale;
+        if (lum <= threshold || radius <= 0.0f || radius < minRadius)
+            return 1.0f;
+        return max(0.0f, threshold) / lum;
+    }
+
+    //Circumradius a sprite is drawn with, its radius rounded to whole pixels so that sprites of one reach share
+    //their coverage.
+    long spriteReach(const Highlight& h) noexcept {
+        return lround(h.radius);
+    }
+}
+
+void HighlightScatter::Extract(const Image& scene, Image& gatherScene, const float threshold, const float minRadius,
+                               const float cocFactor, const int numSamples, ThreadPool& pool) {
+    const auto width = scene.width();
+    const auto height = scene.height();
+    if (gatherScene.width() != width || gatherScene.height() != height)
+        gatherScene.Resize(width, height);
+    const auto radiusScale = cocFactor * static_cast<float>(max(0, numSamples));
+    const auto bands = (height + BandRows - 1) / BandRows;
+    m_bandOffsets.assign(bands + 1, 0);
+
+    // count the highlights of every band
+    pool.ParallelFor(bands, [&](const size_t begin, const size_t end) {
+        for (auto band = begin; band < end; ++band) {
+            size_t count = 0;
+            const auto yEnd = min(height, (band + 1) * BandRows);
+            for (auto y = band * BandRows; y < yEnd; ++y) {
+                const auto* row = scene.row(y);
+                for (size_t x = 0; x < width; ++x)
+                    count += gatherFraction(row[x], threshold, minRadius, radiusScale) < 1.0f;
+            }
+            m_bandOffsets[band + 1] = count;
+        }
+    }, 1);
+
+    // exclusive scan of the counts, serial as there is one entry per band; each band then numbers its own
+    // highlights in the parallel pass below
+    for (size_t band = 0; band < bands; ++band)
+        m_bandOffsets[band + 1] += m_bandOffsets[band];
+    m_highlights.resize(m_bandOffsets[bands]);
+
+    pool.ParallelFor(bands, [&](const size_t begin, const size_t end) {
+        for (auto band = begin; band < end; ++band) {
+            auto next = m_bandOffsets[band];
+            const auto yEnd = min(height, (band + 1) * BandRows);
+            for (auto y = band * BandRows; y < yEnd; ++y) {
+                const auto* row = scene.row(y);
+                auto* gatherRow = gatherScene.row(y);
+                for (size_t x = 0; x < width; ++x) {
+                    const auto& t = row[x];
+                    const auto f = gatherFraction(t, threshold, minRadius, radiusScale);
+                    gatherRow[x] = {t.r * f, t.g * f, t.b * f, t.a};
+                    if (f < 1.0f)
+                        m_highlights[next++] = {static_cast<uint32_t>(x), static_cast<uint32_t>(y),
+                                                t.r * (1.0f - f), t.g * (1.0f - f), t.b * (1.0f - f),
+                                                fabs(t.a) * radiusScale};
+                }
+            }
+        }
+    }, 1);
+}
+
+void HighlightScatter::Splat(Image& output, const Aperture& aperture, ThreadPool& pool) {
+    if (m_highlights.empty())
+        return;
+    const auto width = static_cast<long>(output.width());
+    const auto widest = max_element(m_highlights.begin(), m_highlights.end(),
+                                    [](const Highlight& a, const Highlight& b) { return a.radius < b.radius; });
+    const auto maxReach = spriteReach(*widest);
+
+    // The sprites keep the energy of their highlights, so each spreads it over the pixels it actually covers, which
+    // for small radii differ from the area of the polygon. The count depends on the reach alone, so it is taken
+    // once for every reach some highlight has rather than once per highlight.
+    m_weights.assign(static_cast<size_t>(maxReach) + 1, 0.0f);
+    for (const auto& h : m_highlights)
+        m_weights[static_cast<size_t>(spriteReach(h))] = 1.0f;
+    pool.ParallelFor(m_weights.size(), [&](const size_t begin, const size_t end) {
+        for (auto i = begin; i < end; ++i) {
+            if (m_weights[i] == 0.0f)
+                continue;
+            const auto reach = static_cast<long>(i);
+            const auto scale = 1.0f / static_cast<float>(max(reach, 1L));
+            size_t covered = 0;
+            for (auto dy = -reach; dy <= reach; ++dy)
+                for (auto dx = -reach; dx <= reach; ++dx)
+                    covered += aperture.Contains({static_cast<float>(dx) * scale, static_cast<float>(dy) * scale});
+            m_weights[i] = 1.0f / static_cast<float>(max<size_t>(1, covered));
+        }
+    }, 1);
+
+    // The highlights are sorted by row, so the ones a band of rows can be reached by are a contiguous range.
+    pool.ParallelFor(output.height(), [&](const size_t begin, const size_t end) {
+        const auto rowBegin = static_cast<long>(begin);
+        const auto rowEnd = static_cast<long>(end);
+        const auto first = lower_bound(m_highlights.begin(), m_highlights.end(), rowBegin - maxReach,
+                                       [](const Highlight& h, const long y) { return static_cast<long>(h.y) < y; });
+        const auto last = lower_bound(first, m_highlights.end(), rowEnd + maxReach + 1,
+                                      [](const Highlight& h, const long y) { return static_cast<long>(h.y) < y; });
+        for (auto it = first; it != last; ++it) {
+            const auto& h = *it;
+            const auto reach = spriteReach(h);
+            const auto scale = 1.0f / static_cast<float>(max(reach, 1L));
+            const auto weight = m_weights[static_cast<size_t>(reach)];
+            const Texel color{h.r * weight, h.g * weight, h.b * weight, 0.0f};
+            const auto cx = static_cast<long>(h.x);
+            const auto cy = static_cast<long>(h.y);
+            const auto yBegin = max(rowBegin, cy - reach);
+            const auto yEnd = min(rowEnd, cy + reach + 1);
+            const auto xBegin = max(0L, cx - reach);
+            const auto xEnd = min(width, cx + reach + 1);
+            for (auto y = yBegin; y < yEnd; ++y) {
+                auto* row = output.row(static_cast<size_t>(y));
+                for (auto x = xBegin; x < xEnd; ++x)
+                    if (aperture.Contains({static_cast<float>(x - cx) * scale, static_cast<float>(y - cy) * scale}))
+                        row[x] += color;
+            }
+        }
+    });
+}
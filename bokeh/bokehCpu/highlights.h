@@ -0,0 +1,48 @@
+#pragma once
+#include "aperture.h"
+#include "image.h"
+#include "threadPool.h"
+#include <cstdint>
+
+namespace mini::bokeh {
+    //Pixel whose light is drawn as an aperture sprite instead of being gathered.
+    struct Highlight {
+        std::uint32_t x;
+        std::uint32_t y;
+        //Colour above the threshold, taken out of the gathered scene.
+        float r, g, b;
+        //Circumradius of the sprite in pixels.
+        float radius;
+    };
+
+    //Scatters the brightest out-of-focus pixels as crisp aperture sprites, which a gather smears out. The colour of
+    //a pixel brighter than the threshold is split at the threshold: the gather blurs the clamped scene and the rest
+    //is drawn as a sprite. Only a small fraction of pixels are highlights, so they are compacted into a list first.
+    //The demo does the same with a geometry shader that drops every other texel (bokehSpriteGS).
+    class HighlightScatter {
+    public:
+        //Rows of one band of the compaction.
+        static constexpr size_t BandRows = 16;
+
+        //Finds the pixels of scene with luminance above threshold whose blur radius, |CoC| * cocFactor * numSamples
+        //pixels, is at least minRadius. Writes scene with those clamped to the threshold into gatherScene.
+        //The pixels are compacted with a two-level prefix scan: every band counts its highlights in parallel, an
+        //exclusive scan of the counts gives each band its first slot, and the bands then write their highlights in
+        //parallel. The list stays in row-major order.
+        void Extract(const Image& scene, Image& gatherScene, float threshold, float minRadius, float cocFactor,
+                     int numSamples, ThreadPool& pool);
+
+        //Adds every highlight to output as a polygon of aperture with its radius rounded to whole pixels, spreading
+        //its colour evenly over the pixels it covers. Row bands of output run in parallel, each over the highlights
+        //that can reach it.
+        void Splat(Image& output, const Aperture& aperture, ThreadPool& pool);
+
+        [[nodiscard]] const std::vector<Highlight>& highlights() const noexcept { return m_highlights; }
+
+    private:
+        std::vector<size_t> m_bandOffsets;
+        std::vector<Highlight> m_highlights;
+        //Reciprocal of the number of pixels a sprite covers, by its rounded radius; 0 for radii no highlight has.
+        std::vector<float> m_weights;
+    };
+}
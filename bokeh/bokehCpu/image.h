@@ -0,0 +1,108 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace mini::bokeh {
+    struct Vec2 {
+        float x, y;
+    };
+
+    constexpr Vec2 operator+(const Vec2 a, const Vec2 b) noexcept { return {a.x + b.x, a.y + b.y}; }
+
+    constexpr Vec2 operator*(const Vec2 a, const float f) noexcept { return {a.x * f, a.y * f}; }
+
+    //Single RGBA texel. As in sceneTexture, the alpha channel carries the circle of confusion.
+    struct Texel {
+        float r, g, b, a;
+
+        constexpr Texel& operator+=(const Texel& t) noexcept {
+            r += t.r;
+            g += t.g;
+            b += t.b;
+            a += t.a;
+            return *this;
+        }
+
+        constexpr Texel& operator-=(const Texel& t) noexcept {
+            r -= t.r;
+            g -= t.g;
+            b -= t.b;
+            a -= t.a;
+            return *this;
+        }
+
+        constexpr Texel& operator*=(const float f) noexcept {
+            r *= f;
+            g *= f;
+            b *= f;
+            a *= f;
+            return *this;
+        }
+    };
+
+    constexpr Texel operator+(Texel a, const Texel& b) noexcept { return a += b; }
+
+    constexpr Texel operator-(Texel a, const Texel& b) noexcept { return a -= b; }
+
+    constexpr Texel operator*(Texel t, const float f) noexcept { return t *= f; }
+
+    //Row-major RGBA+CoC float image.
+    class Image {
+    public:
+        Image() = default;
+
+        Image(const size_t width, const size_t height) : m_width(width), m_height(height),
+                                                         m_texels(width * height, Texel{}) {}
+
+        void Resize(const size_t width, const size_t height) {
+            m_width = width;
+            m_height = height;
+            m_texels.assign(width * height, Texel{});
+        }
+
+        [[nodiscard]] size_t width() const noexcept { return m_width; }
+
+        [[nodiscard]] size_t height() const noexcept { return m_height; }
+
+        [[nodiscard]] bool empty() const noexcept { return m_texels.empty(); }
+
+        [[nodiscard]] Texel* row(const size_t y) noexcept { return m_texels.data() + y * m_width; }
+
+        [[nodiscard]] const Texel* row(const size_t y) const noexcept { return m_texels.data() + y * m_width; }
+
+        [[nodiscard]] Texel& at(const size_t x, const size_t y) noexcept { return m_texels[y * m_width + x]; }
+
+        [[nodiscard]] const Texel& at(const size_t x, const size_t y) const noexcept {
+            return m_texels[y * m_width + x];
+        }
+
+        //Bilinear fetch with clamp addressing, same as blurSampler. Coordinates are in pixels with texel centres
+        //at half-integers, i.e. uv * dimensions.
+        [[nodiscard]] Texel Sample(const Vec2 p) const noexcept {
+            const auto fx = p.x - 0.5f;
+            const auto fy = p.y - 0.5f;
+            const auto x0f = std::floor(fx);
+            const auto y0f = std::floor(fy);
+            const auto tx = fx - x0f;
+            const auto ty = fy - y0f;
+            const auto x0 = _clamp(x0f, m_width);
+            const auto x1 = _clamp(x0f + 1.0f, m_width);
+            const auto y0 = _clamp(y0f, m_height);
+            const auto y1 = _clamp(y0f + 1.0f, m_height);
+            const auto top = at(x0, y0) * (1.0f - tx) + at(x1, y0) * tx;
+            const auto bottom = at(x0, y1) * (1.0f - tx) + at(x1, y1) * tx;
+            return top * (1.0f - ty) + bottom * ty;
+        }
+
+    private:
+        //Clamped in float first, converting NaN or a value out of range of the index is undefined.
+        static size_t _clamp(const float i, const size_t size) noexcept {
+            return static_cast<size_t>(std::fmin(std::fmax(i, 0.0f), static_cast<float>(size - 1)));
+        }
+
+        size_t m_width = 0;
+        size_t m_height = 0;
+        std::vector<Texel> m_texels;
+    };
+}
@@ -0,0 +1,115 @@
+#include "lineIntegral.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    //Texels per block of float running sums; the float error grows with the sum of a block rather than of a line.
+    constexpr size_t SUM_BLOCK = 64;
+}
+
+void LineIntegral::_prepare(const Image& image, const Vec2 direction) {
+    m_direction = direction;
+    m_yMajor = fabs(direction.y) >= fabs(direction.x);
+    const auto major = m_yMajor ? direction.y : direction.x;
+    const auto minor = m_yMajor ? direction.x : direction.y;
+    m_slope = minor / major;
+    m_lineLength = m_yMajor ? image.height() : image.width();
+    const auto minorSize = m_yMajor ? image.width() : image.height();
+
+    // line k runs through minor coordinate k + slope * j at major coordinate j (texel centres at integers)
+    const auto drift = m_slope * static_cast<float>(m_lineLength > 0 ? m_lineLength - 1 : 0);
+    m_firstLine = static_cast<long>(floor(min(0.0f, -drift))) - 1;
+    const auto lastLine = static_cast<long>(minorSize) + static_cast<long>(ceil(max(0.0f, -drift)));
+    m_lineCount = static_cast<size_t>(lastLine - m_firstLine + 1);
+    m_blockCount = m_lineLength / SUM_BLOCK + 1;
+    m_sums.resize(m_lineCount * (m_lineLength + 1));
+    m_blockSums.resize(m_lineCount * m_blockCount);
+}
+
+void LineIntegral::_buildLine(const Image& image, const size_t k, const LineTerms terms) noexcept {
+    auto* sums = m_sums.data() + k * (m_lineLength + 1);
+    auto* blockSums = m_blockSums.data() + k * m_blockCount;
+    const auto line = static_cast<float>(static_cast<long>(k) + m_firstLine);
+    Sum before{};
+    Texel total{};
+    sums[0] = total;
+    blockSums[0] = before;
+    for (size_t j = 0; j < m_lineLength; ++j) {
+        const auto m = line + m_slope * static_cast<float>(j) + 0.5f;
+        const auto along = static_cast<float>(j) + 0.5f;
+        auto color = image.Sample(m_yMajor ? Vec2{m, along} : Vec2{along, m});
+        if (terms == LineTerms::Blur) {
+            const auto a = color.a;
+            color *= a;
+        }
+        total += color;
+        if ((j + 1) % SUM_BLOCK == 0) {
+            before = before + Sum{total.r, total.g, total.b, total.a};
+            blockSums[(j + 1) / SUM_BLOCK] = before;
+            total = Texel{};
+        }
+        sums[j + 1] = total;
+    }
+}
+
+void LineIntegral::Build(const Image& image, const Vec2 direction, ThreadPool& pool, const LineTerms terms) {
+    _prepare(image, direction);
+    pool.ParallelFor(m_lineCount, [&](const size_t begin, const size_t end) {
+        for (auto k = begin; k < end; ++k)
+            _buildLine(image, k, terms);
+    });
+}
+
+void LineIntegral::Build(const Image& image, const Vec2 direction, const LineTerms terms) {
+    _prepare(image, direction);
+    for (size_t k = 0; k < m_lineCount; ++k)
+        _buildLine(image, k, terms);
+}
+
+LineIntegral::Sum LineIntegral::_sum(const size_t k, const size_t j) const noexcept {
+    const auto& sum = m_sums[k * (m_lineLength + 1) + j];
+    return m_blockSums[k * m_blockCount + j / SUM_BLOCK] + Sum{sum.r, sum.g, sum.b, sum.a};
+}
+
+LineIntegral::Sum LineIntegral::_prefix(const size_t k, const float t) const noexcept {
+    // samples cover [j - 0.5, j + 0.5), so the integral up to t interpolates the running sums at t + 0.5
+    const auto pos = static_cast<double>(t) + 0.5;
+    const auto length = static_cast<double>(m_lineLength);
+    if (pos <= 0.0)
+        return _sum(k, 1) * pos;
+    if (pos >= length) {
+        const auto end = _sum(k, m_lineLength);
+        return end + (end - _sum(k, m_lineLength - 1)) * (pos - length);
+    }
+    const auto i = static_cast<size_t>(pos);
+    const auto f = pos - static_cast<double>(i);
+    return _sum(k, i) * (1.0 - f) + _sum(k, i + 1) * f;
+}
+
+Texel LineIntegral::Integrate(const Vec2 p, const float length) const noexcept {
+    if (m_lineLength == 0)
+        return {};
+    const Vec2 a{p.x - 0.5f, p.y - 0.5f};
+    const auto b = a + m_direction * length;
+    auto t0 = m_yMajor ? a.y : a.x;
+    auto t1 = m_yMajor ? b.y : b.x;
+    if (t0 > t1)
+        swap(t0, t1);
+    const auto c = (m_yMajor ? a.x : a.y) - m_slope * (m_yMajor ? a.y : a.x);
+    const auto cf = floor(c);
+    const auto w = static_cast<double>(c - cf);
+    // clamped in float before the conversion, which is undefined for NaN or out of range
+    const auto first = static_cast<float>(m_firstLine);
+    const auto last = static_cast<float>(m_lineCount - 1);
+    const auto k0 = static_cast<size_t>(fmin(fmax(cf - first, 0.0f), last));
+    const auto k1 = static_cast<size_t>(fmin(fmax(cf + 1.0f - first, 0.0f), last));
+    // the differences are taken in double, only the integral of the segment itself goes back to float
+    const auto line0 = _prefix(k0, t1) - _prefix(k0, t0);
+    const auto line1 = _prefix(k1, t1) - _prefix(k1, t0);
+    const auto sum = line0 * (1.0 - w) + line1 * w;
+    return {static_cast<float>(sum.r), static_cast<float>(sum.g), static_cast<float>(sum.b), static_cast<float>(sum.a)};
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "image.h"
+#include "threadPool.h"
+
+namespace mini::bokeh {
+    enum class LineTerms {
+        //rgb * CoC and CoC^2, the blur terms of BlurTexture.
+        Blur,
+        //The texels as they are, e.g. layers premultiplied by their coverage.
+        Plain
+    };
+
+    //Running sums of the blur terms of BlurTexture (rgb * CoC and CoC^2), or of the plain texels, along every line of
+    //one direction through an image. Lines advance one texel per step along the major axis of the direction and are
+    //spaced one texel apart along the minor axis, so a blur of any length costs two interpolated lookups on each of
+    //the two lines surrounding the blurred segment. The float sums restart every few texels on top of double totals
+    //of the blocks before them: a short segment far along a long line would otherwise be the difference of two
+    //large, nearly equal floats.
+    class LineIntegral {
+    public:
+        //Rebuilds the sums for image, reusing the allocation when the size allows.
+        void Build(const Image& image, Vec2 direction, ThreadPool& pool, LineTerms terms = LineTerms::Blur);
+
+        //Build on the calling thread, for callers that already run one build per thread.
+        void Build(const Image& image, Vec2 direction, LineTerms terms = LineTerms::Blur);
+
+        //Integral of the terms over the segment from p to p + direction * length, in pixel coordinates
+        //with texel centres at half-integers. Coordinates outside the image behave like clamp addressing. The
+        //integral takes one sample per texel along the major axis, so dividing it by length times the larger
+        //component of direction gives the mean.
+        [[nodiscard]] Texel Integrate(Vec2 p, float length) const noexcept;
+
+    private:
+        struct Sum {
+            double r, g, b, a;
+
+            Sum operator+(const Sum& s) const noexcept { return {r + s.r, g + s.g, b + s.b, a + s.a}; }
+
+            Sum operator-(const Sum& s) const noexcept { return {r - s.r, g - s.g, b - s.b, a - s.a}; }
+
+            Sum operator*(const double f) const noexcept { return {r * f, g * f, b * f, a * f}; }
+        };
+
+        //Sizes the lines for image and direction.
+        void _prepare(const Image& image, Vec2 direction);
+
+        void _buildLine(const Image& image, size_t k, LineTerms terms) noexcept;
+
+        //Running sum of line k before texel j.
+        [[nodiscard]] Sum _sum(size_t k, size_t j) const noexcept;
+
+        //Integral along line k from the start of the line to major coordinate t.
+        [[nodiscard]] Sum _prefix(size_t k, float t) const noexcept;
+
+        Vec2 m_direction{1.0f, 0.0f};
+        bool m_yMajor = false;
+        float m_slope = 0.0f;
+        long m_firstLine = 0;
+        size_t m_lineCount = 0;
+        size_t m_lineLength = 0;
+        size_t m_blockCount = 0;
+        //Sums from the start of the block of every texel, m_lineLength + 1 per line.
+        std::vector<Texel> m_sums;
+        //Sums before every block, m_blockCount per line.
+        std::vector<Sum> m_blockSums;
+    };
+}
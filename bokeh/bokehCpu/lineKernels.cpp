@@ -0,0 +1,643 @@
+#include "lineKernels.h"
+#include "blurKernel.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BOKEH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC lets every function use any intrinsic, GCC and Clang need the instruction set enabled per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define BOKEH_TARGET(isa)
+#else
+#define BOKEH_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    using Plane = PlanarImage::Plane;
+
+    struct Taps {
+        size_t i00, i10, i01, i11;
+        float tx, ty;
+    };
+
+    //Clamped in float before the conversion, which is undefined for NaN and for values out of range of the index;
+    //fmax and fmin drop a NaN in favour of the bound.
+    size_t clampIndex(const float i, const size_t size) noexcept {
+        return static_cast<size_t>(fmin(fmax(i, 0.0f), static_cast<float>(size - 1)));
+    }
+
+    // same addressing as Image::Sample
+    Taps bilinearTaps(const PlanarImage& tex, const Vec2 p) noexcept {
+        const auto fx = p.x - 0.5f;
+        const auto fy = p.y - 0.5f;
+        const auto x0f = floor(fx);
+        const auto y0f = floor(fy);
+        const auto x0 = clampIndex(x0f, tex.width());
+        const auto x1 = clampIndex(x0f + 1.0f, tex.width());
+        const auto row0 = (clampIndex(y0f, tex.height()) & tex.rowMask()) * tex.stride();
+        const auto row1 = (clampIndex(y0f + 1.0f, tex.height()) & tex.rowMask()) * tex.stride();
+        return {row0 + x0, row0 + x1, row1 + x0, row1 + x1, fx - x0f, fy - y0f};
+    }
+
+    float fetch(const float* plane, const Taps& t) noexcept {
+        const auto top = plane[t.i00] * (1.0f - t.tx) + plane[t.i10] * t.tx;
+        const auto bottom = plane[t.i01] * (1.0f - t.tx) + plane[t.i11] * t.tx;
+        return top * (1.0f - t.ty) + bottom * t.ty;
+    }
+
+    //Whether function weights the taps by their CoC, as BlurTexture.
+    constexpr bool weightsByCoc(const LineBlurFunction function) noexcept {
+        return function == LineBlurFunction::Texture || function == LineBlurFunction::StochasticTexture;
+    }
+
+    template <LineBlurFunction Function>
+    void blurLineScalar(const PlanarImage& tex, const size_t y, const size_t xBegin, const size_t xEnd,
+                        const Vec2 direction, const float* stepLength, const int* sampleCount,
+                        const float* firstTap, const int blurLength, const LineBlurOutput& out) {
+        const auto* r = tex.plane(Plane::R);
+        const auto* g = tex.plane(Plane::G);
+        const auto* b = tex.plane(Plane::B);
+        const auto* c = tex.plane(Plane::CoC);
+        const auto length = static_cast<float>(blurLength);
+        for (auto x = xBegin; x < xEnd; ++x) {
+            const auto step = direction * stepLength[x];
+            const auto distance = Function == LineBlurFunction::NearField ? sqrt(step.x * step.x + step.y * step.y)
+                                                                           : 0.0f;
+            const Vec2 pixel{static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f};
+            const auto first = firstTap ? firstTap[x] : 0.5f;
+            const auto uv = pixel + step * first;
+            // weight: the squared CoCs for Texture, the taps reaching the pixel for NearField, the coverage for
+            // Premultiplied
+            float sumR = 0, sumG = 0, sumB = 0, weight = 0, cocSum = 0;
+            for (int i = 0; i < sampleCount[x]; ++i) {
+                const auto t = bilinearTaps(tex, uv + step * static_cast<float>(i));
+                const auto a = fetch(c, t);
+                if constexpr (weightsByCoc(Function)) {
+                    sumR += fetch(r, t) * a;
+                    sumG += fetch(g, t) * a;
+                    sumB += fetch(b, t) * a;
+                    weight += a * a;
+                    cocSum += a;
+                } else if (Function == LineBlurFunction::Premultiplied ||
+                           (a > 0.0f && a * length >= distance * (static_cast<float>(i) + first))) {
+                    sumR += fetch(r, t);
+                    sumG += fetch(g, t);
+                    sumB += fetch(b, t);
+                    weight += Function == LineBlurFunction::NearField ? 1.0f : a;
+                }
+            }
+            if constexpr (weightsByCoc(Function)) {
+                const auto k = weight > 0.0f ? 1.0f / weight : 0.0f;
+                out.r[x] = sumR * k;
+                out.g[x] = sumG * k;
+                out.b[x] = sumB * k;
+                auto coc = fetch(c, bilinearTaps(tex, pixel + step * RescaleOffset(sampleCount[x], blurLength)));
+                if (Function == LineBlurFunction::StochasticTexture && weight > 0.0f)
+                    coc = copysign(min(fabs(coc), MaxStochasticRescale * weight / fabs(cocSum)), coc);
+                out.coc[x] = coc;
+            } else {
+                const auto k = sampleCount[x] > 0 ? 1.0f / static_cast<float>(sampleCount[x]) : 0.0f;
+                out.r[x] = sumR * k;
+                out.g[x] = sumG * k;
+                out.b[x] = sumB * k;
+                out.coc[x] = weight * k;
+            }
+        }
+    }
+
+#ifdef BOKEH_X86
+    //SSE4.1 has no gather instruction, lanes are fetched one by one and only the arithmetic is vectorized.
+    struct Taps4 {
+        alignas(16) int i00[4], i10[4], i01[4], i11[4];
+        __m128 tx, ty;
+    };
+
+    BOKEH_TARGET("sse4.1") inline void taps4(Taps4& t, const __m128 sx, const __m128 sy, const __m128i maxX,
+                                             const __m128i maxY, const __m128i stride,
+                                             const __m128i rowMask) noexcept {
+        const auto half = _mm_set1_ps(0.5f);
+        const auto zero = _mm_setzero_si128();
+        const auto one = _mm_set1_epi32(1);
+        const auto low = _mm_set1_ps(-1.0f);
+        const auto fx = _mm_min_ps(_mm_max_ps(_mm_sub_ps(sx, half), low), _mm_cvtepi32_ps(maxX));
+        const auto fy = _mm_min_ps(_mm_max_ps(_mm_sub_ps(sy, half), low), _mm_cvtepi32_ps(maxY));
+        const auto x0f = _mm_floor_ps(fx);
+        const auto y0f = _mm_floor_ps(fy);
+        t.tx = _mm_sub_ps(fx, x0f);
+        t.ty = _mm_sub_ps(fy, y0f);
+        const auto ix = _mm_cvttps_epi32(x0f);
+        const auto iy = _mm_cvttps_epi32(y0f);
+        const auto x0 = _mm_min_epi32(_mm_max_epi32(ix, zero), maxX);
+        const auto x1 = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(ix, one), zero), maxX);
+        const auto y0 = _mm_and_si128(_mm_min_epi32(_mm_max_epi32(iy, zero), maxY), rowMask);
+        const auto y1 = _mm_and_si128(_mm_min_epi32(_mm_max_epi32(_mm_add_epi32(iy, one), zero), maxY), rowMask);
+        const auto row0 = _mm_mullo_epi32(y0, stride);
+        const auto row1 = _mm_mullo_epi32(y1, stride);
+        _mm_store_si128(reinterpret_cast<__m128i*>(t.i00), _mm_add_epi32(row0, x0));
+        _mm_store_si128(reinterpret_cast<__m128i*>(t.i10), _mm_add_epi32(row0, x1));
+        _mm_store_si128(reinterpret_cast<__m128i*>(t.i01), _mm_add_epi32(row1, x0));
+        _mm_store_si128(reinterpret_cast<__m128i*>(t.i11), _mm_add_epi32(row1, x1));
+    }
+
+    //Largest of the lanes: the taps of the longest blur of a block, lanes needing fewer mask the rest out.
+    BOKEH_TARGET("sse4.1") inline int reduceMax4(__m128i v) noexcept {
+        v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+        v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(v);
+    }
+
+    BOKEH_TARGET("sse4.1") inline __m128 gather4(const float* plane, const int (&i)[4]) noexcept {
+        return _mm_setr_ps(plane[i[0]], plane[i[1]], plane[i[2]], plane[i[3]]);
+    }
+
+    BOKEH_TARGET("sse4.1") inline __m128 fetch4(const float* plane, const Taps4& t) noexcept {
+        const auto one = _mm_set1_ps(1.0f);
+        const auto itx = _mm_sub_ps(one, t.tx);
+        const auto top = _mm_add_ps(_mm_mul_ps(gather4(plane, t.i00), itx), _mm_mul_ps(gather4(plane, t.i10), t.tx));
+        const auto bottom = _mm_add_ps(_mm_mul_ps(gather4(plane, t.i01), itx),
+                                       _mm_mul_ps(gather4(plane, t.i11), t.tx));
+        return _mm_add_ps(_mm_mul_ps(top, _mm_sub_ps(one, t.ty)), _mm_mul_ps(bottom, t.ty));
+    }
+
+    template <LineBlurFunction Function>
+    BOKEH_TARGET("sse4.1") void blurLineSse41(const PlanarImage& tex, const size_t y, const size_t xBegin,
+                                              const size_t xEnd, const Vec2 direction, const float* stepLength,
+                                              const int* sampleCount, const float* firstTap,
+                                              const int blurLength, const LineBlurOutput& out) {
+        const auto* r = tex.plane(Plane::R);
+        const auto* g = tex.plane(Plane::G);
+        const auto* b = tex.plane(Plane::B);
+        const auto* c = tex.plane(Plane::CoC);
+        const auto maxX = _mm_set1_epi32(static_cast<int>(tex.width()) - 1);
+        const auto maxY = _mm_set1_epi32(static_cast<int>(tex.height()) - 1);
+        const auto stride = _mm_set1_epi32(static_cast<int>(tex.stride()));
+        const auto rowMask = _mm_set1_epi32(static_cast<int>(tex.rowMask()));
+        const auto half = _mm_set1_ps(0.5f);
+        const auto lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const auto length = _mm_set1_ps(static_cast<float>(max(blurLength, 1)));
+        const auto reach = _mm_set1_ps(static_cast<float>(blurLength));
+        const auto one = _mm_set1_ps(1.0f);
+        const auto zero = _mm_setzero_ps();
+        const auto sign = _mm_set1_ps(-0.0f);
+        const auto maxRescale = _mm_set1_ps(MaxStochasticRescale);
+        const auto dirX = _mm_set1_ps(direction.x);
+        const auto dirY = _mm_set1_ps(direction.y);
+        const auto py = _mm_set1_ps(static_cast<float>(y) + 0.5f);
+        Taps4 t;
+        auto x = xBegin;
+        for (; x + 4 <= xEnd; x += 4) {
+            const auto len = _mm_loadu_ps(stepLength + x);
+            const auto dx = _mm_mul_ps(dirX, len);
+            const auto dy = _mm_mul_ps(dirY, len);
+            const auto px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lanes);
+            const auto first = firstTap ? _mm_loadu_ps(firstTap + x) : half;
+            const auto ux = _mm_add_ps(px, _mm_mul_ps(dx, first));
+            const auto uy = _mm_add_ps(py, _mm_mul_ps(dy, first));
+            const auto distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+            auto sumR = zero, sumG = zero, sumB = zero, weight = zero, cocSum = zero;
+            const auto count = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sampleCount + x));
+            const auto n = _mm_cvtepi32_ps(count);
+            const auto taps = reduceMax4(count);
+            const auto last = _mm_max_ps(_mm_sub_ps(n, one), zero);
+            for (int i = 0; i < taps; ++i) {
+                const auto fi = _mm_set1_ps(static_cast<float>(i));
+                // lanes done with their taps repeat the last one rather than reading past the reach of their blur
+                const auto at = _mm_min_ps(fi, last);
+                taps4(t, _mm_add_ps(ux, _mm_mul_ps(dx, at)), _mm_add_ps(uy, _mm_mul_ps(dy, at)), maxX, maxY, stride,
+                      rowMask);
+                if constexpr (weightsByCoc(Function)) {
+                    // a zero weight drops the tap from all sums
+                    const auto a = _mm_and_ps(fetch4(c, t), _mm_cmplt_ps(fi, n));
+                    sumR = _mm_add_ps(sumR, _mm_mul_ps(fetch4(r, t), a));
+                    sumG = _mm_add_ps(sumG, _mm_mul_ps(fetch4(g, t), a));
+                    sumB = _mm_add_ps(sumB, _mm_mul_ps(fetch4(b, t), a));
+                    weight = _mm_add_ps(weight, _mm_mul_ps(a, a));
+                    cocSum = _mm_add_ps(cocSum, a);
+                } else {
+                    const auto a = fetch4(c, t);
+                    auto taken = _mm_cmplt_ps(fi, n);
+                    if constexpr (Function == LineBlurFunction::NearField) {
+                        const auto distances = _mm_mul_ps(distance, _mm_add_ps(fi, first));
+                        const auto reaches = _mm_cmpge_ps(_mm_mul_ps(a, reach), distances);
+                        taken = _mm_and_ps(taken, _mm_and_ps(_mm_cmpgt_ps(a, zero), reaches));
+                    }
+                    sumR = _mm_add_ps(sumR, _mm_and_ps(fetch4(r, t), taken));
+                    sumG = _mm_add_ps(sumG, _mm_and_ps(fetch4(g, t), taken));
+                    sumB = _mm_add_ps(sumB, _mm_and_ps(fetch4(b, t), taken));
+                    weight = _mm_add_ps(weight, _mm_and_ps(Function == LineBlurFunction::NearField ? one : a, taken));
+                }
+            }
+            if constexpr (weightsByCoc(Function)) {
+                const auto k = _mm_and_ps(_mm_cmpgt_ps(weight, zero), _mm_div_ps(one, weight));
+                _mm_storeu_ps(out.r + x, _mm_mul_ps(sumR, k));
+                _mm_storeu_ps(out.g + x, _mm_mul_ps(sumG, k));
+                _mm_storeu_ps(out.b + x, _mm_mul_ps(sumB, k));
+                const auto rescale = _mm_div_ps(_mm_mul_ps(n, half), length);
+                taps4(t, _mm_add_ps(px, _mm_mul_ps(dx, rescale)), _mm_add_ps(py, _mm_mul_ps(dy, rescale)), maxX,
+                      maxY, stride, rowMask);
+                auto coc = fetch4(c, t);
+                if constexpr (Function == LineBlurFunction::StochasticTexture) {
+                    const auto limit = _mm_div_ps(_mm_mul_ps(maxRescale, weight), _mm_andnot_ps(sign, cocSum));
+                    const auto limited = _mm_or_ps(_mm_min_ps(_mm_andnot_ps(sign, coc), limit), _mm_and_ps(sign, coc));
+                    coc = _mm_blendv_ps(coc, limited, _mm_cmpgt_ps(weight, zero));
+                }
+                _mm_storeu_ps(out.coc + x, coc);
+            } else {
+                const auto k = _mm_and_ps(_mm_cmpgt_ps(n, zero), _mm_div_ps(one, n));
+                _mm_storeu_ps(out.r + x, _mm_mul_ps(sumR, k));
+                _mm_storeu_ps(out.g + x, _mm_mul_ps(sumG, k));
+                _mm_storeu_ps(out.b + x, _mm_mul_ps(sumB, k));
+                _mm_storeu_ps(out.coc + x, _mm_mul_ps(weight, k));
+            }
+        }
+        blurLineScalar<Function>(tex, y, x, xEnd, direction, stepLength, sampleCount, firstTap, blurLength, out);
+    }
+
+    //x is clamped as a coordinate rather than as an index, so the right tap is always the padding-safe neighbour
+    //of the left one and both come from a single 64-bit gather.
+    struct Taps8 {
+        __m256i i0, i1;
+        __m256 tx, ty;
+    };
+
+    BOKEH_TARGET("avx2,fma") inline Taps8 taps8(const __m256 sx, const __m256 sy, const __m256 maxX,
+                                                const __m256i maxY, const __m256i stride,
+                                                const __m256i rowMask) noexcept {
+        const auto half = _mm256_set1_ps(0.5f);
+        const auto zero = _mm256_setzero_si256();
+        const auto fx = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(sx, half), _mm256_setzero_ps()), maxX);
+        const auto fy = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(sy, half), _mm256_set1_ps(-1.0f)),
+                                      _mm256_cvtepi32_ps(maxY));
+        const auto x0f = _mm256_floor_ps(fx);
+        const auto y0f = _mm256_floor_ps(fy);
+        const auto ix = _mm256_cvttps_epi32(x0f);
+        const auto iy = _mm256_cvttps_epi32(y0f);
+        const auto y0 = _mm256_and_si256(_mm256_min_epi32(_mm256_max_epi32(iy, zero), maxY), rowMask);
+        const auto y1 = _mm256_and_si256(
+            _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(iy, _mm256_set1_epi32(1)), zero), maxY), rowMask);
+        const auto row0 = _mm256_mullo_epi32(y0, stride);
+        const auto row1 = _mm256_mullo_epi32(y1, stride);
+        return {_mm256_add_epi32(row0, ix), _mm256_add_epi32(row1, ix), _mm256_sub_ps(fx, x0f), _mm256_sub_ps(fy, y0f)};
+    }
+
+    BOKEH_TARGET("avx2,fma") inline int reduceMax8(const __m256i v) noexcept {
+        return reduceMax4(_mm_max_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+    }
+
+    //Horizontal interpolation of the texel pairs starting at index.
+    BOKEH_TARGET("avx2,fma") inline __m256 lerpPairs8(const float* plane, const __m256i index,
+                                                     const __m256 tx) noexcept {
+        const auto* base = reinterpret_cast<const long long*>(plane);
+        const auto lo = _mm256_castsi256_ps(_mm256_i32gather_epi64(base, _mm256_castsi256_si128(index), 4));
+        const auto hi = _mm256_castsi256_ps(_mm256_i32gather_epi64(base, _mm256_extracti128_si256(index, 1), 4));
+        // shuffles work within 128-bit halves, the 64-bit permute restores lane order
+        const auto left = _mm256_castpd_ps(_mm256_permute4x64_pd(
+            _mm256_castps_pd(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+        const auto right = _mm256_castpd_ps(_mm256_permute4x64_pd(
+            _mm256_castps_pd(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+        return _mm256_fmadd_ps(_mm256_sub_ps(right, left), tx, left);
+    }
+
+    BOKEH_TARGET("avx2,fma") inline __m256 fetch8(const float* plane, const Taps8& t) noexcept {
+        const auto top = lerpPairs8(plane, t.i0, t.tx);
+        const auto bottom = lerpPairs8(plane, t.i1, t.tx);
+        return _mm256_fmadd_ps(_mm256_sub_ps(bottom, top), t.ty, top);
+    }
+
+    template <LineBlurFunction Function>
+    BOKEH_TARGET("avx2,fma") void blurLineAvx2(const PlanarImage& tex, const size_t y, const size_t xBegin,
+                                               const size_t xEnd, const Vec2 direction, const float* stepLength,
+                                               const int* sampleCount, const float* firstTap,
+                                               const int blurLength, const LineBlurOutput& out) {
+        const auto* r = tex.plane(Plane::R);
+        const auto* g = tex.plane(Plane::G);
+        const auto* b = tex.plane(Plane::B);
+        const auto* c = tex.plane(Plane::CoC);
+        const auto maxX = _mm256_set1_ps(static_cast<float>(tex.width() - 1));
+        const auto maxY = _mm256_set1_epi32(static_cast<int>(tex.height()) - 1);
+        const auto stride = _mm256_set1_epi32(static_cast<int>(tex.stride()));
+        const auto rowMask = _mm256_set1_epi32(static_cast<int>(tex.rowMask()));
+        const auto half = _mm256_set1_ps(0.5f);
+        const auto lanes = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+        const auto length = _mm256_set1_ps(static_cast<float>(max(blurLength, 1)));
+        const auto reach = _mm256_set1_ps(static_cast<float>(blurLength));
+        const auto one = _mm256_set1_ps(1.0f);
+        const auto zero = _mm256_setzero_ps();
+        const auto sign = _mm256_set1_ps(-0.0f);
+        const auto maxRescale = _mm256_set1_ps(MaxStochasticRescale);
+        const auto dirX = _mm256_set1_ps(direction.x);
+        const auto dirY = _mm256_set1_ps(direction.y);
+        const auto py = _mm256_set1_ps(static_cast<float>(y) + 0.5f);
+        const auto laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        for (auto x = xBegin; x < xEnd; x += 8) {
+            // lanes past xEnd load no taps and store nothing, so short runs need no scalar tail
+            const auto live = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(min<size_t>(xEnd - x, 8))),
+                                                 laneIndex);
+            const auto len = _mm256_maskload_ps(stepLength + x, live);
+            const auto dx = _mm256_mul_ps(dirX, len);
+            const auto dy = _mm256_mul_ps(dirY, len);
+            const auto px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lanes);
+            const auto first = firstTap ? _mm256_maskload_ps(firstTap + x, live) : half;
+            const auto ux = _mm256_fmadd_ps(dx, first, px);
+            const auto uy = _mm256_fmadd_ps(dy, first, py);
+            const auto distance = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+            auto sumR = zero, sumG = zero, sumB = zero, weight = zero, cocSum = zero;
+            const auto count = _mm256_maskload_epi32(sampleCount + x, live);
+            const auto n = _mm256_cvtepi32_ps(count);
+            const auto taps = reduceMax8(count);
+            const auto last = _mm256_max_ps(_mm256_sub_ps(n, one), zero);
+            for (int i = 0; i < taps; ++i) {
+                const auto fi = _mm256_set1_ps(static_cast<float>(i));
+                const auto at = _mm256_min_ps(fi, last);
+                const auto t = taps8(_mm256_fmadd_ps(dx, at, ux), _mm256_fmadd_ps(dy, at, uy), maxX, maxY, stride,
+                                     rowMask);
+                if constexpr (weightsByCoc(Function)) {
+                    const auto a = _mm256_and_ps(fetch8(c, t), _mm256_cmp_ps(fi, n, _CMP_LT_OQ));
+                    sumR = _mm256_fmadd_ps(fetch8(r, t), a, sumR);
+                    sumG = _mm256_fmadd_ps(fetch8(g, t), a, sumG);
+                    sumB = _mm256_fmadd_ps(fetch8(b, t), a, sumB);
+                    weight = _mm256_fmadd_ps(a, a, weight);
+                    cocSum = _mm256_add_ps(cocSum, a);
+                } else {
+                    const auto a = fetch8(c, t);
+                    auto taken = _mm256_cmp_ps(fi, n, _CMP_LT_OQ);
+                    if constexpr (Function == LineBlurFunction::NearField) {
+                        const auto distances = _mm256_mul_ps(distance, _mm256_add_ps(fi, first));
+                        const auto reaches = _mm256_cmp_ps(_mm256_mul_ps(a, reach), distances, _CMP_GE_OQ);
+                        taken = _mm256_and_ps(taken, _mm256_and_ps(_mm256_cmp_ps(a, zero, _CMP_GT_OQ), reaches));
+                    }
+                    sumR = _mm256_add_ps(sumR, _mm256_and_ps(fetch8(r, t), taken));
+                    sumG = _mm256_add_ps(sumG, _mm256_and_ps(fetch8(g, t), taken));
+                    sumB = _mm256_add_ps(sumB, _mm256_and_ps(fetch8(b, t), taken));
+                    weight = _mm256_add_ps(weight,
+                                           _mm256_and_ps(Function == LineBlurFunction::NearField ? one : a, taken));
+                }
+            }
+            if constexpr (weightsByCoc(Function)) {
+                const auto k = _mm256_and_ps(_mm256_cmp_ps(weight, zero, _CMP_GT_OQ), _mm256_div_ps(one, weight));
+                _mm256_maskstore_ps(out.r + x, live, _mm256_mul_ps(sumR, k));
+                _mm256_maskstore_ps(out.g + x, live, _mm256_mul_ps(sumG, k));
+                _mm256_maskstore_ps(out.b + x, live, _mm256_mul_ps(sumB, k));
+                const auto rescale = _mm256_div_ps(_mm256_mul_ps(n, half), length);
+                const auto t = taps8(_mm256_fmadd_ps(dx, rescale, px), _mm256_fmadd_ps(dy, rescale, py), maxX, maxY,
+                                     stride, rowMask);
+                auto coc = fetch8(c, t);
+                if constexpr (Function == LineBlurFunction::StochasticTexture) {
+                    const auto limit = _mm256_div_ps(_mm256_mul_ps(maxRescale, weight), _mm256_andnot_ps(sign, cocSum));
+                    const auto limited = _mm256_or_ps(_mm256_min_ps(_mm256_andnot_ps(sign, coc), limit),
+                                                      _mm256_and_ps(sign, coc));
+                    coc = _mm256_blendv_ps(coc, limited, _mm256_cmp_ps(weight, zero, _CMP_GT_OQ));
+                }
+                _mm256_maskstore_ps(out.coc + x, live, coc);
+            } else {
+                const auto k = _mm256_and_ps(_mm256_cmp_ps(n, zero, _CMP_GT_OQ), _mm256_div_ps(one, n));
+                _mm256_maskstore_ps(out.r + x, live, _mm256_mul_ps(sumR, k));
+                _mm256_maskstore_ps(out.g + x, live, _mm256_mul_ps(sumG, k));
+                _mm256_maskstore_ps(out.b + x, live, _mm256_mul_ps(sumB, k));
+                _mm256_maskstore_ps(out.coc + x, live, _mm256_mul_ps(weight, k));
+            }
+        }
+    }
+
+    // GCC 12 takes the self-initialised _mm512_undefined_* of its own intrinsics for uninitialised variables
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+    struct Taps16 {
+        __m512i i0, i1;
+        __m512 tx, ty;
+    };
+
+    BOKEH_TARGET("avx512f") inline Taps16 taps16(const __m512 sx, const __m512 sy, const __m512 maxX,
+                                                 const __m512i maxY, const __m512i stride,
+                                                 const __m512i rowMask) noexcept {
+        const auto half = _mm512_set1_ps(0.5f);
+        const auto zero = _mm512_setzero_si512();
+        const auto fx = _mm512_min_ps(_mm512_max_ps(_mm512_sub_ps(sx, half), _mm512_setzero_ps()), maxX);
+        const auto fy = _mm512_min_ps(_mm512_max_ps(_mm512_sub_ps(sy, half), _mm512_set1_ps(-1.0f)),
+                                      _mm512_cvtepi32_ps(maxY));
+        const auto x0f = _mm512_roundscale_ps(fx, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        const auto y0f = _mm512_roundscale_ps(fy, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        const auto ix = _mm512_cvttps_epi32(x0f);
+        const auto iy = _mm512_cvttps_epi32(y0f);
+        const auto y0 = _mm512_and_si512(_mm512_min_epi32(_mm512_max_epi32(iy, zero), maxY), rowMask);
+        const auto y1 = _mm512_and_si512(
+            _mm512_min_epi32(_mm512_max_epi32(_mm512_add_epi32(iy, _mm512_set1_epi32(1)), zero), maxY), rowMask);
+        const auto row0 = _mm512_mullo_epi32(y0, stride);
+        const auto row1 = _mm512_mullo_epi32(y1, stride);
+        return {_mm512_add_epi32(row0, ix), _mm512_add_epi32(row1, ix), _mm512_sub_ps(fx, x0f), _mm512_sub_ps(fy, y0f)};
+    }
+
+    BOKEH_TARGET("avx512f") inline __m512 lerpPairs16(const float* plane, const __m512i index,
+                                                     const __m512 tx) noexcept {
+        const auto evens = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+        const auto odds = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+        const auto lo = _mm512_castsi512_ps(_mm512_i32gather_epi64(_mm512_castsi512_si256(index), plane, 4));
+        const auto hi = _mm512_castsi512_ps(_mm512_i32gather_epi64(_mm512_extracti64x4_epi64(index, 1), plane, 4));
+        const auto left = _mm512_permutex2var_ps(lo, evens, hi);
+        const auto right = _mm512_permutex2var_ps(lo, odds, hi);
+        return _mm512_fmadd_ps(_mm512_sub_ps(right, left), tx, left);
+    }
+
+    BOKEH_TARGET("avx512f") inline __m512 fetch16(const float* plane, const Taps16& t) noexcept {
+        const auto top = lerpPairs16(plane, t.i0, t.tx);
+        const auto bottom = lerpPairs16(plane, t.i1, t.tx);
+        return _mm512_fmadd_ps(_mm512_sub_ps(bottom, top), t.ty, top);
+    }
+
+    template <LineBlurFunction Function>
+    BOKEH_TARGET("avx512f") void blurLineAvx512(const PlanarImage& tex, const size_t y, const size_t xBegin,
+                                                const size_t xEnd, const Vec2 direction, const float* stepLength,
+                                                const int* sampleCount, const float* firstTap,
+                                                const int blurLength, const LineBlurOutput& out) {
+        const auto* r = tex.plane(Plane::R);
+        const auto* g = tex.plane(Plane::G);
+        const auto* b = tex.plane(Plane::B);
+        const auto* c = tex.plane(Plane::CoC);
+        const auto maxX = _mm512_set1_ps(static_cast<float>(tex.width() - 1));
+        const auto maxY = _mm512_set1_epi32(static_cast<int>(tex.height()) - 1);
+        const auto stride = _mm512_set1_epi32(static_cast<int>(tex.stride()));
+        const auto rowMask = _mm512_set1_epi32(static_cast<int>(tex.rowMask()));
+        const auto half = _mm512_set1_ps(0.5f);
+        const auto lanes = _mm512_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f,
+                                          8.5f, 9.5f, 10.5f, 11.5f, 12.5f, 13.5f, 14.5f, 15.5f);
+        const auto length = _mm512_set1_ps(static_cast<float>(max(blurLength, 1)));
+        const auto reach = _mm512_set1_ps(static_cast<float>(blurLength));
+        const auto one = _mm512_set1_ps(1.0f);
+        const auto zero = _mm512_setzero_ps();
+        const auto maxRescale = _mm512_set1_ps(MaxStochasticRescale);
+        const auto dirX = _mm512_set1_ps(direction.x);
+        const auto dirY = _mm512_set1_ps(direction.y);
+        const auto py = _mm512_set1_ps(static_cast<float>(y) + 0.5f);
+        for (auto x = xBegin; x < xEnd; x += 16) {
+            // lanes past xEnd load no taps and store nothing, so short runs need no scalar tail
+            const auto live = static_cast<__mmask16>(xEnd - x >= 16 ? 0xFFFF : (1u << (xEnd - x)) - 1);
+            const auto len = _mm512_maskz_loadu_ps(live, stepLength + x);
+            const auto dx = _mm512_mul_ps(dirX, len);
+            const auto dy = _mm512_mul_ps(dirY, len);
+            const auto px = _mm512_add_ps(_mm512_set1_ps(static_cast<float>(x)), lanes);
+            const auto first = firstTap ? _mm512_maskz_loadu_ps(live, firstTap + x) : half;
+            const auto ux = _mm512_fmadd_ps(dx, first, px);
+            const auto uy = _mm512_fmadd_ps(dy, first, py);
+            const auto distance = _mm512_sqrt_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)));
+            auto sumR = zero, sumG = zero, sumB = zero, weight = zero, cocSum = zero;
+            const auto count = _mm512_maskz_loadu_epi32(live, sampleCount + x);
+            const auto n = _mm512_cvtepi32_ps(count);
+            const auto taps = _mm512_reduce_max_epi32(count);
+            const auto last = _mm512_max_ps(_mm512_sub_ps(n, one), zero);
+            for (int i = 0; i < taps; ++i) {
+                const auto fi = _mm512_set1_ps(static_cast<float>(i));
+                const auto at = _mm512_min_ps(fi, last);
+                const auto t = taps16(_mm512_fmadd_ps(dx, at, ux), _mm512_fmadd_ps(dy, at, uy), maxX, maxY,
+                                      stride, rowMask);
+                if constexpr (weightsByCoc(Function)) {
+                    const auto a = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(fi, n, _CMP_LT_OQ), fetch16(c, t));
+                    sumR = _mm512_fmadd_ps(fetch16(r, t), a, sumR);
+                    sumG = _mm512_fmadd_ps(fetch16(g, t), a, sumG);
+                    sumB = _mm512_fmadd_ps(fetch16(b, t), a, sumB);
+                    weight = _mm512_fmadd_ps(a, a, weight);
+                    cocSum = _mm512_add_ps(cocSum, a);
+                } else {
+                    const auto a = fetch16(c, t);
+                    auto taken = _mm512_cmp_ps_mask(fi, n, _CMP_LT_OQ);
+                    if constexpr (Function == LineBlurFunction::NearField) {
+                        taken &= _mm512_cmp_ps_mask(a, zero, _CMP_GT_OQ);
+                        taken &= _mm512_cmp_ps_mask(_mm512_mul_ps(a, reach),
+                                                    _mm512_mul_ps(distance, _mm512_add_ps(fi, first)), _CMP_GE_OQ);
+                    }
+                    sumR = _mm512_mask_add_ps(sumR, taken, sumR, fetch16(r, t));
+                    sumG = _mm512_mask_add_ps(sumG, taken, sumG, fetch16(g, t));
+                    sumB = _mm512_mask_add_ps(sumB, taken, sumB, fetch16(b, t));
+                    weight = _mm512_mask_add_ps(weight, taken, weight,
+                                                Function == LineBlurFunction::NearField ? one : a);
+                }
+            }
+            if constexpr (weightsByCoc(Function)) {
+                const auto k = _mm512_maskz_div_ps(_mm512_cmp_ps_mask(weight, zero, _CMP_GT_OQ), one, weight);
+                _mm512_mask_storeu_ps(out.r + x, live, _mm512_mul_ps(sumR, k));
+                _mm512_mask_storeu_ps(out.g + x, live, _mm512_mul_ps(sumG, k));
+                _mm512_mask_storeu_ps(out.b + x, live, _mm512_mul_ps(sumB, k));
+                const auto rescale = _mm512_div_ps(_mm512_mul_ps(n, half), length);
+                const auto t = taps16(_mm512_fmadd_ps(dx, rescale, px), _mm512_fmadd_ps(dy, rescale, py), maxX, maxY,
+                                      stride, rowMask);
+                auto coc = fetch16(c, t);
+                if constexpr (Function == LineBlurFunction::StochasticTexture) {
+                    const auto limit = _mm512_div_ps(_mm512_mul_ps(maxRescale, weight), _mm512_abs_ps(cocSum));
+                    auto limited = _mm512_min_ps(_mm512_abs_ps(coc), limit);
+                    limited = _mm512_mask_sub_ps(limited, _mm512_cmp_ps_mask(coc, zero, _CMP_LT_OQ), zero, limited);
+                    coc = _mm512_mask_mov_ps(coc, _mm512_cmp_ps_mask(weight, zero, _CMP_GT_OQ), limited);
+                }
+                _mm512_mask_storeu_ps(out.coc + x, live, coc);
+            } else {
+                const auto k = _mm512_maskz_div_ps(_mm512_cmp_ps_mask(n, zero, _CMP_GT_OQ), one, n);
+                _mm512_mask_storeu_ps(out.r + x, live, _mm512_mul_ps(sumR, k));
+                _mm512_mask_storeu_ps(out.g + x, live, _mm512_mul_ps(sumG, k));
+                _mm512_mask_storeu_ps(out.b + x, live, _mm512_mul_ps(sumB, k));
+                _mm512_mask_storeu_ps(out.coc + x, live, _mm512_mul_ps(weight, k));
+            }
+        }
+    }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    Isa detectCpu() noexcept {
+        int info[4];
+        __cpuid(info, 0);
+        const auto maxLeaf = info[0];
+        __cpuid(info, 1);
+        const bool sse41 = info[2] & (1 << 19);
+        const bool fma = info[2] & (1 << 12);
+        const bool osxsave = info[2] & (1 << 27);
+        const bool avx = info[2] & (1 << 28);
+        const auto xcr0 = osxsave ? _xgetbv(0) : 0;
+        bool avx2 = false, avx512 = false;
+        if (maxLeaf >= 7) {
+            __cpuidex(info, 7, 0);
+            avx2 = info[1] & (1 << 5);
+            avx512 = info[1] & (1 << 16);
+        }
+        if (avx512 && (xcr0 & 0xE6) == 0xE6)
+            return Isa::Avx512;
+        if (avx && avx2 && fma && (xcr0 & 0x6) == 0x6)
+            return Isa::Avx2;
+        return sse41 ? Isa::Sse41 : Isa::Scalar;
+    }
+#else
+    Isa detectCpu() noexcept {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return Isa::Avx512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return Isa::Avx2;
+        return __builtin_cpu_supports("sse4.1") ? Isa::Sse41 : Isa::Scalar;
+    }
+#endif
+#else
+    Isa detectCpu() noexcept {
+        return Isa::Scalar;
+    }
+#endif
+
+    template <LineBlurFunction Function>
+    LineBlurKernel lineBlurKernel(const Isa isa) noexcept {
+#ifdef BOKEH_X86
+        switch (isa) {
+            case Isa::Avx512:
+                return blurLineAvx512<Function>;
+            case Isa::Avx2:
+                return blurLineAvx2<Function>;
+            case Isa::Sse41:
+                return blurLineSse41<Function>;
+            default:
+                break;
+        }
+#else
+        (void)isa;
+#endif
+        return blurLineScalar<Function>;
+    }
+}
+
+Isa bokeh::DetectIsa() noexcept {
+    static const auto isa = detectCpu();
+    return isa;
+}
+
+const char* bokeh::IsaName(const Isa isa) noexcept {
+    switch (isa) {
+        case Isa::Sse41:
+            return "sse4.1";
+        case Isa::Avx2:
+            return "avx2";
+        case Isa::Avx512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
+
+LineBlurKernel bokeh::GetLineBlurKernel(const Isa isa, const LineBlurFunction function) noexcept {
+    switch (function) {
+        case LineBlurFunction::NearField:
+            return lineBlurKernel<LineBlurFunction::NearField>(isa);
+        case LineBlurFunction::Premultiplied:
+            return lineBlurKernel<LineBlurFunction::Premultiplied>(isa);
+        case LineBlurFunction::StochasticTexture:
+            return lineBlurKernel<LineBlurFunction::StochasticTexture>(isa);
+        default:
+            return lineBlurKernel<LineBlurFunction::Texture>(isa);
+    }
+}
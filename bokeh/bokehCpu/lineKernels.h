@@ -0,0 +1,52 @@
+#pragma once
+#include "planarImage.h"
+
+namespace mini::bokeh {
+    //Instruction sets the line blur kernels are compiled for, in ascending order.
+    enum class Isa {
+        Scalar,
+        Sse41,
+        Avx2,
+        Avx512
+    };
+
+    //Best instruction set supported by both the build and the CPU it runs on.
+    [[nodiscard]] Isa DetectIsa() noexcept;
+
+    [[nodiscard]] const char* IsaName(Isa isa) noexcept;
+
+    //Destination planes of a line blur, indexed by absolute x.
+    struct LineBlurOutput {
+        float* r;
+        float* g;
+        float* b;
+        float* coc;
+    };
+
+    //Blur a line kernel evaluates, after the function of blurKernel.h it stands in for.
+    enum class LineBlurFunction {
+        //BlurTexture: the colour weighted by the squared CoC; out.coc receives the rescaling CoC.
+        Texture,
+        //BlurNearField: the colours of the taps whose CoC reaches the pixel over all taps; out.coc receives the
+        //share of taps that reach it.
+        NearField,
+        //BlurPremultiplied: the plain mean of the taps; out.coc receives the mean of the CoC plane, e.g. the
+        //coverage of a premultiplied layer.
+        Premultiplied,
+        //StochasticBlurTexture<true>: Texture with the rescaling CoC limited by MaxStochasticRescale.
+        StochasticTexture
+    };
+
+    //Evaluates a blur of blurKernel.h for pixels [xBegin, xEnd) of row y. Pixel x takes sampleCount[x] taps, each
+    //direction * stepLength[x] apart, covering blurLength CoCs. The first lies firstTap[x] steps from the pixel, or
+    //half a step without firstTap as in BlurTexture. out receives the colour and, in coc, the fourth channel of the
+    //scalar function, see LineBlurFunction. No texel past the last tap of a pixel is read, so rows of tex beyond the
+    //reach of the blurs may change meanwhile. The padding column of tex has to be filled, see PlanarImage::PadRows.
+    using LineBlurKernel = void (*)(const PlanarImage& tex, size_t y, size_t xBegin, size_t xEnd, Vec2 direction,
+                                    const float* stepLength, const int* sampleCount, const float* firstTap,
+                                    int blurLength, const LineBlurOutput& out);
+
+    //Kernel of function for isa, falling back to the best narrower one this build provides.
+    [[nodiscard]] LineBlurKernel GetLineBlurKernel(Isa isa,
+                                                   LineBlurFunction function = LineBlurFunction::Texture) noexcept;
+}
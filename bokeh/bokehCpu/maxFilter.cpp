@@ -0,0 +1,55 @@
+#include "maxFilter.h"
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    //Maximum over [x - radius, x + radius] of count values spaced stride apart. prefix and suffix hold
+    //count + 2 * radius floats: the line padded with radius lowest values at both ends.
+    void maxLine(const float* in, float* out, const size_t count, const size_t stride, const size_t radius,
+                 float* prefix, float* suffix) {
+        const auto window = 2 * radius + 1;
+        const auto padded = count + 2 * radius;
+        const auto value = [&](const size_t j) {
+            return j < radius || j >= count + radius ? numeric_limits<float>::lowest() : in[(j - radius) * stride];
+        };
+        for (size_t j = 0; j < padded; ++j)
+            prefix[j] = j % window == 0 ? value(j) : max(prefix[j - 1], value(j));
+        for (auto j = padded; j-- > 0;)
+            suffix[j] = j % window == window - 1 || j == padded - 1 ? value(j) : max(suffix[j + 1], value(j));
+        // the window of x is [x, x + 2 * radius] in padded coordinates
+        for (size_t x = 0; x < count; ++x)
+            out[x * stride] = max(suffix[x], prefix[x + 2 * radius]);
+    }
+}
+
+void MaxFilter::Apply(vector<float>& values, const size_t width, const size_t height, const size_t radius,
+                      ThreadPool& pool) {
+    if (radius == 0 || width == 0 || height == 0)
+        return;
+    m_rows.resize(values.size());
+    pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+        vector<float> scratch(2 * (width + 2 * radius));
+        for (auto y = begin; y < end; ++y)
+            maxLine(values.data() + y * width, m_rows.data() + y * width, width, 1, radius, scratch.data(),
+                    scratch.data() + width + 2 * radius);
+    });
+    pool.ParallelFor(width, [&](const size_t begin, const size_t end) {
+        vector<float> scratch(2 * (height + 2 * radius));
+        for (auto x = begin; x < end; ++x)
+            maxLine(m_rows.data() + x, values.data() + x, height, width, radius, scratch.data(),
+                    scratch.data() + height + 2 * radius);
+    });
+}
+
+void MaxFilter::ApplyMin(vector<float>& values, const size_t width, const size_t height, const size_t radius,
+                         ThreadPool& pool) {
+    for (auto& v : values)
+        v = -v;
+    Apply(values, width, height, radius, pool);
+    for (auto& v : values)
+        v = -v;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "threadPool.h"
+#include <vector>
+
+namespace mini::bokeh {
+    //Maximum over the (2 * radius + 1)^2 window around every value of a row-major grid, done separably along rows
+    //and columns after van Herk and Gil & Werman. Each line is cut into blocks as long as the window; the window
+    //around any position covers the tail of one block and the head of the next, so it is the larger of a running
+    //suffix and a running prefix maximum. That takes three comparisons per value and pass, whatever the radius.
+    //Values outside the grid are ignored.
+    class MaxFilter {
+    public:
+        //Filters values, width * height of them, in place.
+        void Apply(std::vector<float>& values, size_t width, size_t height, size_t radius, ThreadPool& pool);
+
+        //Minimum over the same window.
+        void ApplyMin(std::vector<float>& values, size_t width, size_t height, size_t radius, ThreadPool& pool);
+
+    private:
+        std::vector<float> m_rows;
+    };
+}
@@ -0,0 +1,58 @@
+#include "mipPyramid.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+void MipPyramid::Build(const Image& image, ThreadPool& pool) {
+    auto width = image.width();
+    auto height = image.height();
+    size_t count = 1;
+    for (auto w = width, h = height; w > 1 || h > 1; w = max<size_t>(1, w / 2), h = max<size_t>(1, h / 2))
+        ++count;
+    m_levels.resize(count);
+    m_scales.resize(count);
+    m_levels[0] = image;
+    m_scales[0] = {1.0f, 1.0f};
+    for (size_t i = 1; i < count; ++i) {
+        const auto& above = m_levels[i - 1];
+        auto& level = m_levels[i];
+        width = max<size_t>(1, width / 2);
+        height = max<size_t>(1, height / 2);
+        if (level.width() != width || level.height() != height)
+            level.Resize(width, height);
+        m_scales[i] = {static_cast<float>(width) / static_cast<float>(image.width()),
+                       static_cast<float>(height) / static_cast<float>(image.height())};
+        // odd sizes drop the last row or column above, a single row or column is averaged with itself
+        const auto x1 = above.width() > 1 ? 1 : 0;
+        const auto y1 = above.height() > 1 ? 1 : 0;
+        pool.ParallelFor(height, [&](const size_t begin, const size_t end) {
+            for (auto y = begin; y < end; ++y) {
+                const auto* top = above.row(2 * y * y1);
+                const auto* bottom = above.row(2 * y * y1 + y1);
+                auto* row = level.row(y);
+                for (size_t x = 0; x < width; ++x) {
+                    const auto left = 2 * x * x1;
+                    row[x] = (top[left] + top[left + x1] + bottom[left] + bottom[left + x1]) * 0.25f;
+                }
+            }
+        });
+    }
+}
+
+Texel MipPyramid::Sample(const Vec2 p, float lod) const noexcept {
+    if (m_levels.empty())
+        return {};
+    lod = clamp(lod, 0.0f, static_cast<float>(m_levels.size() - 1));
+    const auto i = static_cast<size_t>(lod);
+    const auto t = lod - static_cast<float>(i);
+    const auto at = [&](const size_t level) {
+        return m_levels[level].Sample({p.x * m_scales[level].x, p.y * m_scales[level].y});
+    };
+    const auto fine = at(i);
+    if (t == 0.0f)
+        return fine;
+    return fine * (1.0f - t) + at(i + 1) * t;
+}
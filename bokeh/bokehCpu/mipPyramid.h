@@ -0,0 +1,27 @@
+#pragma once
+#include "image.h"
+#include "threadPool.h"
+#include <vector>
+
+namespace mini::bokeh {
+    //Mip chain of an image down to 1x1, the CPU counterpart of the chain bokehMipPS samples. Every level halves the
+    //size of the one above, rounding down as Direct3D does, and each texel averages the 2x2 texels above it.
+    class MipPyramid {
+    public:
+        void Build(const Image& image, ThreadPool& pool);
+
+        [[nodiscard]] size_t levels() const noexcept { return m_levels.size(); }
+
+        [[nodiscard]] const Image& level(const size_t i) const noexcept { return m_levels[i]; }
+
+        //Trilinear fetch as with blurSampler: bilinear in the two levels around lod, blended by its fraction.
+        //p is in pixels of level 0. lod is clamped to the chain.
+        [[nodiscard]] Texel Sample(Vec2 p, float lod) const noexcept;
+
+    private:
+        //Level 0 is a copy of the image, so the pyramid stays valid when the image changes.
+        std::vector<Image> m_levels;
+        //Size of every level over the size of level 0, mapping pixels of level 0 to the same uv in that level.
+        std::vector<Vec2> m_scales;
+    };
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include "image.h"
+
+namespace mini::bokeh {
+    //Structure-of-arrays RGBA+CoC image used by the vectorized kernels. Every channel is stored in its own plane and
+    //rows are padded to a multiple of 16 floats, so a row of any plane can be walked with full-width vector loads.
+    //There is always at least one padding column; PadRows copies the last texel of a row into it, which lets the
+    //kernels fetch both horizontal bilinear taps with one 64-bit load.
+    //An image resized with ResizeRing keeps only a power of two rows of its height: row y lives in row y & rowMask()
+    //of the storage, so a stripe of rows can be produced and consumed while older rows are overwritten. The kernels
+    //clamp a row to the height first and mask it after, the same for both kinds of image.
+    class PlanarImage {
+    public:
+        enum Plane : size_t { R, G, B, CoC, PlaneCount };
+
+        static constexpr size_t RowAlignment = 16;
+
+        PlanarImage() = default;
+
+        PlanarImage(const size_t width, const size_t height) { Resize(width, height); }
+
+        //Floats per row of an image width texels wide, padding included.
+        [[nodiscard]] static constexpr size_t Stride(const size_t width) noexcept {
+            return (width + RowAlignment) / RowAlignment * RowAlignment;
+        }
+
+        void Resize(const size_t width, const size_t height) {
+            m_width = width;
+            m_height = height;
+            m_stride = Stride(width);
+            m_planeSize = m_stride * height;
+            m_rowMask = ~size_t{0};
+            m_data.assign(m_planeSize * PlaneCount, 0.0f);
+        }
+
+        //An image of height rows of which only the last rows written are stored; rows must be a power of two.
+        void ResizeRing(const size_t width, const size_t height, const size_t rows) {
+            m_width = width;
+            m_height = height;
+            m_stride = Stride(width);
+            m_planeSize = m_stride * rows;
+            m_rowMask = rows - 1;
+            m_data.assign(m_planeSize * PlaneCount, 0.0f);
+        }
+
+        [[nodiscard]] size_t width() const noexcept { return m_width; }
+
+        [[nodiscard]] size_t height() const noexcept { return m_height; }
+
+        //Distance in floats between the starts of two consecutive rows.
+        [[nodiscard]] size_t stride() const noexcept { return m_stride; }
+
+        //Mask of the row in storage; all ones unless resized with ResizeRing.
+        [[nodiscard]] size_t rowMask() const noexcept { return m_rowMask; }
+
+        //Rows stored: the height, or the rows of a ring.
+        [[nodiscard]] size_t storedRows() const noexcept { return m_stride > 0 ? m_planeSize / m_stride : 0; }
+
+        //Memory of all planes.
+        [[nodiscard]] size_t bytes() const noexcept { return m_data.size() * sizeof(float); }
+
+        [[nodiscard]] float* plane(const Plane p) noexcept { return m_data.data() + p * m_planeSize; }
+
+        [[nodiscard]] const float* plane(const Plane p) const noexcept { return m_data.data() + p * m_planeSize; }
+
+        [[nodiscard]] float* row(const Plane p, const size_t y) noexcept {
+            return plane(p) + (y & m_rowMask) * m_stride;
+        }
+
+        [[nodiscard]] const float* row(const Plane p, const size_t y) const noexcept {
+            return plane(p) + (y & m_rowMask) * m_stride;
+        }
+
+        //Copies rows [rowBegin, rowEnd) of image, which must have the same dimensions.
+        void CopyRows(const Image& image, const size_t rowBegin, const size_t rowEnd) noexcept {
+            for (auto y = rowBegin; y < rowEnd; ++y) {
+                const auto* src = image.row(y);
+                auto* r = row(R, y);
+                auto* g = row(G, y);
+                auto* b = row(B, y);
+                auto* coc = row(CoC, y);
+                for (size_t x = 0; x < m_width; ++x) {
+                    r[x] = src[x].r;
+                    g[x] = src[x].g;
+                    b[x] = src[x].b;
+                    coc[x] = src[x].a;
+                }
+            }
+            PadRows(rowBegin, rowEnd);
+        }
+
+        //Replicates the last column of rows [rowBegin, rowEnd) into the padding column.
+        void PadRows(const size_t rowBegin, const size_t rowEnd) noexcept {
+            if (m_width == 0)
+                return;
+            for (size_t p = 0; p < PlaneCount; ++p)
+                for (auto y = rowBegin; y < rowEnd; ++y) {
+                    auto* r = row(static_cast<Plane>(p), y);
+                    r[m_width] = r[m_width - 1];
+                }
+        }
+
+    private:
+        size_t m_width = 0;
+        size_t m_height = 0;
+        size_t m_stride = 0;
+        size_t m_planeSize = 0;
+        size_t m_rowMask = ~size_t{0};
+        std::vector<float> m_data;
+    };
+}
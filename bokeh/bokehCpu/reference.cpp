@@ -0,0 +1,250 @@
+#include "reference.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+namespace {
+    constexpr double PI = 3.14159265358979323846;
+
+    using Colour = array<double, 4>;
+
+    struct Direction {
+        double x, y;
+    };
+
+    //fmax and fmin drop a NaN in favour of the bound, clamp would pass it on to the conversion.
+    size_t clampIndex(const double i, const size_t size) noexcept {
+        return static_cast<size_t>(fmin(fmax(i, 0.0), static_cast<double>(size - 1)));
+    }
+
+    //RGBA image in double precision, alpha holding the CoC as in Image.
+    class Grid {
+    public:
+        Grid(const size_t width, const size_t height) : m_width(width), m_height(height), m_texels(width * height) {}
+
+        [[nodiscard]] Colour& at(const size_t x, const size_t y) noexcept { return m_texels[y * m_width + x]; }
+
+        [[nodiscard]] const Colour& at(const size_t x, const size_t y) const noexcept {
+            return m_texels[y * m_width + x];
+        }
+
+        //Bilinear fetch with clamp addressing at (x, y) in pixels, texel centres at half-integers.
+        [[nodiscard]] Colour Sample(const double x, const double y) const noexcept {
+            const auto x0 = floor(x - 0.5);
+            const auto y0 = floor(y - 0.5);
+            const auto tx = x - 0.5 - x0;
+            const auto ty = y - 0.5 - y0;
+            Colour result{};
+            for (auto j = 0; j < 2; ++j)
+                for (auto i = 0; i < 2; ++i) {
+                    const auto weight = (i == 0 ? 1.0 - tx : tx) * (j == 0 ? 1.0 - ty : ty);
+                    const auto& texel = at(clampIndex(x0 + i, m_width), clampIndex(y0 + j, m_height));
+                    for (size_t c = 0; c < 4; ++c)
+                        result[c] += weight * texel[c];
+                }
+            return result;
+        }
+
+    private:
+        size_t m_width;
+        size_t m_height;
+        vector<Colour> m_texels;
+    };
+
+    //Taps of a blur over coc * blurLength pixels and the distance between them in units of the direction.
+    struct Line {
+        int taps;
+        float step;
+    };
+
+    Line line(const BokehParams& params, const int blurLength, const float coc) {
+        if (params.sampleDensity <= 0.0f)
+            return {blurLength, coc};
+        const auto maxTaps = static_cast<float>(max(static_cast<int>(lround(params.maxSamples)), 1));
+        const auto taps = static_cast<int>(
+            clamp(ceil(coc * static_cast<float>(blurLength) * params.sampleDensity), 1.0f, maxTaps));
+        return {taps, taps == blurLength ? coc : coc * static_cast<float>(blurLength) / static_cast<float>(taps)};
+    }
+
+    //BlurTexture of bokeh1PS: the colour of the taps half a step past the pixel and on, weighted by their squared
+    //CoC, and in alpha the CoC half the blur length along, which the passes rescale with.
+    Colour blurTexture(const Grid& tex, const double x, const double y, const Direction d, const Line l,
+                       const int blurLength) {
+        const auto sx = d.x * l.step;
+        const auto sy = d.y * l.step;
+        const auto rescale = blurLength > 0 ? 0.5 * l.taps / blurLength : 0.5;
+        const auto coc = tex.Sample(x + sx * rescale, y + sy * rescale)[3];
+        Colour sum{};
+        auto weight = 0.0;
+        for (auto i = 0; i < l.taps; ++i) {
+            const auto texel = tex.Sample(x + sx * (i + 0.5), y + sy * (i + 0.5));
+            for (size_t c = 0; c < 3; ++c)
+                sum[c] += texel[c] * texel[3];
+            weight += texel[3] * texel[3];
+        }
+        if (weight <= 0.0)
+            return {0.0, 0.0, 0.0, coc};
+        return {sum[0] / weight, sum[1] / weight, sum[2] / weight, coc};
+    }
+
+    //The near field gather of bokeh1PS: the colour of the taps whose own CoC spreads back over the pixel, over all
+    //taps, and that share in alpha.
+    Colour blurNearField(const Grid& tex, const double x, const double y, const Direction d, const Line l,
+                         const int blurLength) {
+        const auto sx = d.x * l.step;
+        const auto sy = d.y * l.step;
+        const auto stepLength = hypot(sx, sy);
+        Colour sum{};
+        for (auto i = 0; i < l.taps; ++i) {
+            const auto texel = tex.Sample(x + sx * (i + 0.5), y + sy * (i + 0.5));
+            if (texel[3] > 0.0 && texel[3] * blurLength >= stepLength * (i + 0.5))
+                sum = {sum[0] + texel[0], sum[1] + texel[1], sum[2] + texel[2], sum[3] + 1.0};
+        }
+        for (auto& c : sum)
+            c /= max(l.taps, 1);
+        return sum;
+    }
+
+    //Plain mean of the taps, the second pass of the near field.
+    Colour blurPremultiplied(const Grid& tex, const double x, const double y, const Direction d, const Line l) {
+        Colour sum{};
+        for (auto i = 0; i < l.taps; ++i) {
+            const auto texel = tex.Sample(x + d.x * l.step * (i + 0.5), y + d.y * l.step * (i + 0.5));
+            for (size_t c = 0; c < 4; ++c)
+                sum[c] += texel[c];
+        }
+        for (auto& c : sum)
+            c /= max(l.taps, 1);
+        return sum;
+    }
+
+    //Largest of values, width * height of them, within radius rows and columns of every one.
+    vector<float> dilate(const vector<float>& values, const size_t width, const size_t height, const size_t radius) {
+        vector<float> rows(values.size());
+        vector<float> result(values.size());
+        for (size_t y = 0; y < height; ++y)
+            for (size_t x = 0; x < width; ++x) {
+                auto m = 0.0f;
+                for (auto i = x > radius ? x - radius : 0; i <= min(width - 1, x + radius); ++i)
+                    m = max(m, values[y * width + i]);
+                rows[y * width + x] = m;
+            }
+        for (size_t y = 0; y < height; ++y)
+            for (size_t x = 0; x < width; ++x) {
+                auto m = 0.0f;
+                for (auto j = y > radius ? y - radius : 0; j <= min(height - 1, y + radius); ++j)
+                    m = max(m, rows[j * width + x]);
+                result[y * width + x] = m;
+            }
+        return result;
+    }
+}
+
+void bokeh::RenderReference(const Image& scene, Image& output, const BokehParams& params) {
+    if (params.sides != 6)
+        throw invalid_argument("RenderReference: " + to_string(params.sides) + " sides, only the hexagon is covered");
+    const auto width = scene.width();
+    const auto height = scene.height();
+    output.Resize(width, height);
+    if (width == 0 || height == 0)
+        return;
+    const auto blurLength = params.numSamples > 0.0f ? static_cast<int>(ceil(params.numSamples)) : 0;
+    const auto angle = static_cast<double>(params.angle);
+    const auto vertical = Direction{cos(angle + PI / 2), sin(angle + PI / 2)};
+    const auto diagonal = Direction{cos(angle - PI / 6), sin(angle - PI / 6)};
+    const auto diagonal2 = Direction{cos(angle - 5 * PI / 6), sin(angle - 5 * PI / 6)};
+    const auto separate = params.separateNearField;
+
+    // with the near field split off, the rest is blurred as if all of it lay behind the focus
+    Grid source(width, height);
+    Grid nearScene(width, height);
+    vector<float> nearCoc(width * height);
+    for (size_t y = 0; y < height; ++y)
+        for (size_t x = 0; x < width; ++x) {
+            const auto& t = scene.at(x, y);
+            const auto coc = separate && t.a < 0.0f ? -params.cocFactor * t.a : 0.0f;
+            source.at(x, y) = {t.r, t.g, t.b, separate ? fabs(t.a) : t.a};
+            nearScene.at(x, y) = {t.r, t.g, t.b, coc};
+            nearCoc[y * width + x] = coc;
+        }
+
+    Grid first(width, height);
+    Grid first2(width, height);
+    for (size_t y = 0; y < height; ++y)
+        for (size_t x = 0; x < width; ++x) {
+            const auto px = x + 0.5;
+            const auto py = y + 0.5;
+            const auto coc = params.cocFactor * static_cast<float>(source.at(x, y)[3]);
+            const auto l = line(params, blurLength, coc);
+            const auto color = blurTexture(source, px, py, vertical, l, blurLength);
+            const auto color2 = blurTexture(source, px, py, diagonal, l, blurLength);
+            const auto k = color[3] * coc;
+            const auto k2 = color2[3] * coc;
+            auto& v = first.at(x, y);
+            v = {color[0] * k, color[1] * k, color[2] * k, coc};
+            first2.at(x, y) = {0.5 * (color2[0] * k2 + v[0]), 0.5 * (color2[1] * k2 + v[1]),
+                               0.5 * (color2[2] * k2 + v[2]), coc};
+        }
+    for (size_t y = 0; y < height; ++y)
+        for (size_t x = 0; x < width; ++x) {
+            const auto coc = static_cast<float>(first.at(x, y)[3]);
+            const auto coc2 = static_cast<float>(first2.at(x, y)[3]);
+            auto& out = output.at(x, y);
+            if (coc == 0.0f) {
+                out = {scene.at(x, y).r, scene.at(x, y).g, scene.at(x, y).b, 1.0f};
+                continue;
+            }
+            const auto color = blurTexture(first, x + 0.5, y + 0.5, diagonal, line(params, blurLength, coc),
+                                           blurLength);
+            const auto color2 = blurTexture(first2, x + 0.5, y + 0.5, diagonal2, line(params, blurLength, coc2),
+                                            blurLength);
+            const auto k = color[3] > 0.0 ? coc / color[3] : 0.0;
+            const auto k2 = color2[3] > 0.0 ? coc2 / color2[3] : 0.0;
+            out = {static_cast<float>(0.5 * (color[0] * k + color2[0] * k2)),
+                   static_cast<float>(0.5 * (color[1] * k + color2[1] * k2)),
+                   static_cast<float>(0.5 * (color[2] * k + color2[2] * k2)), 1.0f};
+        }
+    if (!separate)
+        return;
+
+    // the near field reaches every pixel within the blur of a near pixel, bilinear footprint included
+    const auto maxCoc = *max_element(nearCoc.begin(), nearCoc.end());
+    if (maxCoc <= 0.0f)
+        return;
+    const auto covered = dilate(nearCoc, width, height, static_cast<size_t>(ceil(maxCoc * blurLength + 1.0f)));
+    Grid nearFirst(width, height);
+    Grid nearFirst2(width, height);
+    for (size_t y = 0; y < height; ++y)
+        for (size_t x = 0; x < width; ++x) {
+            const auto coc = covered[y * width + x];
+            if (coc <= 0.0f)
+                continue;
+            const auto l = line(params, blurLength, coc);
+            const auto color = blurNearField(nearScene, x + 0.5, y + 0.5, vertical, l, blurLength);
+            const auto color2 = blurNearField(nearScene, x + 0.5, y + 0.5, diagonal, l, blurLength);
+            nearFirst.at(x, y) = color;
+            for (size_t c = 0; c < 4; ++c)
+                nearFirst2.at(x, y)[c] = 0.5 * (color2[c] + color[c]);
+        }
+    for (size_t y = 0; y < height; ++y)
+        for (size_t x = 0; x < width; ++x) {
+            const auto coc = covered[y * width + x];
+            if (coc <= 0.0f)
+                continue;
+            const auto l = line(params, blurLength, coc);
+            const auto color = blurPremultiplied(nearFirst, x + 0.5, y + 0.5, diagonal, l);
+            const auto color2 = blurPremultiplied(nearFirst2, x + 0.5, y + 0.5, diagonal2, l);
+            const auto coverage = 0.5 * (color[3] + color2[3]);
+            auto& out = output.at(x, y);
+            out = {static_cast<float>(0.5 * (color[0] + color2[0]) + (1.0 - coverage) * out.r),
+                   static_cast<float>(0.5 * (color[1] + color2[1]) + (1.0 - coverage) * out.g),
+                   static_cast<float>(0.5 * (color[2] + color2[2]) + (1.0 - coverage) * out.b), 1.0f};
+        }
+}
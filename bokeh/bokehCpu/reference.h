@@ -0,0 +1,13 @@
+#pragma once
+#include "bokehEngine.h"
+
+namespace mini::bokeh {
+    //The hexagonal gather of bokeh1PS and bokeh2PS and its separate near field, written out as plainly as possible
+    //for the benchmark to check BokehEngine against. Every tap is a bilinear fetch summed in double precision, one
+    //pixel at a time on one thread, without tiles, fixed tap counts, planar rows or vector kernels; nothing but
+    //Image is shared with the engine, so a slip in a helper all of its paths use shows up too. Tap counts and step
+    //lengths are worked out in float as in the shaders, so a CoC on the edge between two counts rounds the same way.
+    //Follows the angle, numSamples, sampleDensity, maxSamples, cocFactor and separateNearField of params; throws
+    //std::invalid_argument for other apertures than the hexagon.
+    void RenderReference(const Image& scene, Image& output, const BokehParams& params);
+}
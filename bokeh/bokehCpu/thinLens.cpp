@@ -0,0 +1,50 @@
+#include "thinLens.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+float ThinLens::CocFraction(const float distance) const noexcept {
+    // lens dimensions in metres, like the distances
+    const auto f = focalLength * 0.001f;
+    const auto sensor = sensorWidth * 0.001f;
+    if (distance <= 0.0f || focusDistance <= f || fStop <= 0.0f || sensor <= 0.0f)
+        return 0.0f;
+    const auto aperture = f / fStop;
+    const auto diameter = aperture * f * fabs(distance - focusDistance) / (distance * (focusDistance - f));
+    return diameter / sensor;
+}
+
+bool CocLut::Build(const ThinLens& lens, const float nearPlane, const float farPlane, const float imageWidth,
+                   const float maxCocPixels, const size_t size) {
+    if (m_values.size() == size && m_lens == lens && m_nearPlane == nearPlane && m_farPlane == farPlane &&
+        m_imageWidth == imageWidth && m_maxCocPixels == maxCocPixels)
+        return false;
+    m_lens = lens;
+    m_nearPlane = nearPlane;
+    m_farPlane = farPlane;
+    m_imageWidth = imageWidth;
+    m_maxCocPixels = maxCocPixels;
+    m_values.resize(size);
+    const auto last = static_cast<float>(size > 1 ? size - 1 : 1);
+    for (size_t i = 0; i < size; ++i) {
+        const auto distance = nearPlane + (farPlane - nearPlane) * static_cast<float>(i) / last;
+        const auto pixels = lens.CocFraction(distance) * imageWidth;
+        m_values[i] = pixels < 1.0f || maxCocPixels <= 0.0f ? 0.0f : min(1.0f, pixels / maxCocPixels);
+    }
+    return true;
+}
+
+float CocLut::Sample(const float distance) const noexcept {
+    if (m_values.empty())
+        return 0.0f;
+    const auto range = m_farPlane - m_nearPlane;
+    const auto t = range > 0.0f ? clamp((distance - m_nearPlane) / range, 0.0f, 1.0f) : 0.0f;
+    const auto pos = t * static_cast<float>(m_values.size() - 1);
+    const auto i = min(static_cast<size_t>(pos), m_values.size() - 1);
+    const auto next = min(i + 1, m_values.size() - 1);
+    const auto w = pos - static_cast<float>(i);
+    return m_values[i] * (1.0f - w) + m_values[next] * w;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace mini::bokeh {
+    //Thin lens camera. Lens dimensions are in millimetres, as printed on a lens or stored in image metadata, while
+    //distances in the scene are in scene units taken to be metres.
+    struct ThinLens {
+        float focalLength = 85.0f;
+        float fStop = 2.0f;
+        float focusDistance = 5.0f;
+        //Width of the sensor or film, 36 mm for full frame.
+        float sensorWidth = 36.0f;
+
+        //Diameter of the circle of confusion of a point at distance along the view axis, as a fraction of the
+        //sensor width. Zero at the focus distance, growing quickly towards the camera and slowly towards infinity.
+        [[nodiscard]] float CocFraction(float distance) const noexcept;
+
+        bool operator==(const ThinLens&) const = default;
+    };
+
+    //Scene CoC (cocTexture in the demo, the alpha channel of Image here, 1 being the longest blur) as a function of
+    //linear depth, baked for one lens and view so the CoC pass replaces evaluating the lens with a single fetch.
+    class CocLut {
+    public:
+        static constexpr size_t DefaultSize = 1024;
+
+        //Samples the lens at size distances spread evenly from nearPlane to farPlane. maxCocPixels is the CoC
+        //diameter, in pixels of an imageWidth pixels wide image, that maps to 1; larger circles saturate. Circles
+        //narrower than a pixel are in focus and get exactly 0, which the in-focus CoC tiles test for.
+        //Returns false and keeps the table when nothing changed since the last call.
+        bool Build(const ThinLens& lens, float nearPlane, float farPlane, float imageWidth, float maxCocPixels,
+                   size_t size = DefaultSize);
+
+        [[nodiscard]] const std::vector<float>& values() const noexcept { return m_values; }
+
+        [[nodiscard]] float nearPlane() const noexcept { return m_nearPlane; }
+
+        [[nodiscard]] float farPlane() const noexcept { return m_farPlane; }
+
+        //Linearly interpolated CoC at distance, clamped to the ends of the table. Same lookup as DepthToCoc in
+        //cocLut.hlsli.
+        [[nodiscard]] float Sample(float distance) const noexcept;
+
+    private:
+        ThinLens m_lens;
+        float m_nearPlane = 0.0f;
+        float m_farPlane = 0.0f;
+        float m_imageWidth = 0.0f;
+        float m_maxCocPixels = 0.0f;
+        std::vector<float> m_values;
+    };
+}
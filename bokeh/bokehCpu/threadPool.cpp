@@ -0,0 +1,96 @@
+#include "threadPool.h"
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+using namespace mini;
+using namespace bokeh;
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    if (threadCount == 0)
+        threadCount = max(1u, thread::hardware_concurrency());
+    m_workers.reserve(threadCount - 1);
+    for (unsigned i = 1; i < threadCount; ++i)
+        m_workers.emplace_back([this, i] { _workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& w : m_workers)
+        w.join();
+}
+
+void ThreadPool::ParallelFor(const size_t count, const BandFunction& body, const size_t bandSize) {
+    ParallelFor(count, ThreadBandFunction([&body](const size_t begin, const size_t end, unsigned) {
+        body(begin, end);
+    }), bandSize);
+}
+
+void ThreadPool::ParallelFor(const size_t count, const ThreadBandFunction& body, size_t bandSize) {
+    if (count == 0)
+        return;
+    if (bandSize == 0)
+        bandSize = max<size_t>(1, count / (static_cast<size_t>(threadCount()) * 4));
+    if (m_workers.empty() || bandSize >= count) {
+        body(0, count, 0);
+        return;
+    }
+    {
+        lock_guard lock(m_mutex);
+        m_body = &body;
+        m_count = count;
+        m_bandSize = bandSize;
+        m_next = 0;
+        m_error = nullptr;
+        m_busy = static_cast<unsigned>(m_workers.size());
+        ++m_generation;
+    }
+    m_wake.notify_all();
+    _runBands(0);
+
+    unique_lock lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busy == 0; });
+    m_body = nullptr;
+    if (m_error)
+        rethrow_exception(exchange(m_error, nullptr));
+}
+
+void ThreadPool::_runBands(const unsigned thread) noexcept {
+    for (;;) {
+        const auto begin = m_next.fetch_add(m_bandSize);
+        if (begin >= m_count)
+            return;
+        try {
+            (*m_body)(begin, min(begin + m_bandSize, m_count), thread);
+        } catch (...) {
+            lock_guard lock(m_mutex);
+            if (!m_error)
+                m_error = current_exception();
+            m_next = m_count;
+        }
+    }
+}
+
+void ThreadPool::_workerLoop(const unsigned thread) {
+    size_t seen = 0;
+    for (;;) {
+        {
+            unique_lock lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+            if (m_stop)
+                return;
+            seen = m_generation;
+        }
+        _runBands(thread);
+        {
+            lock_guard lock(m_mutex);
+            if (--m_busy != 0)
+                continue;
+        }
+        m_done.notify_one();
+    }
+}
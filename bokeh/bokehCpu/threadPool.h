@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mini::bokeh {
+    //Fixed set of worker threads executing row bands of a frame. The calling thread takes part in the work too,
+    //so a pool created with threadCount == 1 runs everything inline.
+    class ThreadPool {
+    public:
+        using BandFunction = std::function<void(size_t begin, size_t end)>;
+        using ThreadBandFunction = std::function<void(size_t begin, size_t end, unsigned thread)>;
+
+        //threadCount == 0 uses all hardware threads.
+        explicit ThreadPool(unsigned threadCount = 0);
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        [[nodiscard]] unsigned threadCount() const noexcept { return static_cast<unsigned>(m_workers.size()) + 1; }
+
+        //Splits [0, count) into bands of at most bandSize items and blocks until body has run on all of them.
+        //bandSize == 0 picks a size giving every thread a few bands to balance uneven rows.
+        //The first exception thrown by body is rethrown here. Not reentrant.
+        void ParallelFor(size_t count, const BandFunction& body, size_t bandSize = 0);
+
+        //ParallelFor passing body the index of the thread running the band as well, in [0, threadCount()), for
+        //working memory kept per thread. The calling thread is 0.
+        void ParallelFor(size_t count, const ThreadBandFunction& body, size_t bandSize = 0);
+
+    private:
+        void _workerLoop(unsigned thread);
+
+        void _runBands(unsigned thread) noexcept;
+
+        std::vector<std::thread> m_workers;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+
+        const ThreadBandFunction* m_body = nullptr;
+        size_t m_count = 0;
+        size_t m_bandSize = 1;
+        std::atomic<size_t> m_next{0};
+        size_t m_generation = 0;
+        unsigned m_busy = 0;
+        bool m_stop = false;
+        std::exception_ptr m_error;
+    };
+}
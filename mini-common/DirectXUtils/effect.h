@@ -419,6 +419,26 @@ namespace mini
 		dx_ptr<ID3D11RasterizerState> m_state;
 	};
 
+	class BlendStateEffect : public EffectComponent
+	{
+	public:
+		//A null state restores the default of no blending.
+		explicit BlendStateEffect(dx_ptr<ID3D11BlendState>&& state = nullptr)
+			: m_state(std::move(state)) { }
+
+		BlendStateEffect(BlendStateEffect&& other) = default;
+
+		void Begin(const dx_ptr<ID3D11DeviceContext>& context) const override
+		{
+			context->OMSetBlendState(m_state.get(), nullptr, UINT_MAX);
+		}
+
+		void SetState(dx_ptr<ID3D11BlendState>&& state) { m_state = std::move(state); }
+
+	private:
+		dx_ptr<ID3D11BlendState> m_state;
+	};
+
 	class DynamicEffect : public EffectComponent
 	{
 	public: